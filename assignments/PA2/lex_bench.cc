@@ -0,0 +1,83 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  lex_bench.cc
+//
+//  Measures the throughput of the flex scanner and of the hand-written
+//  one, in megabytes of source per second.  Each scanner reads every file
+//  named on the command line until it has read at least 100MB in all
+//  (or the number of megabytes given with -n), with the tokens discarded.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "cool-parse.h"
+#include "cool-scan.h"
+#include "utilities.h"
+
+thread_local int curr_lineno = 1;
+thread_local char *curr_filename = "<stdin>";
+thread_local FILE *fin;                     // the file the scanners read
+thread_local YYSTYPE cool_yylval;           // Not compiled with parser, so must define this.
+int cool_yydebug;
+
+static double seconds_since(clock_t start)
+{
+  return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void bench(const char *what, int (*lex)(), char **files, int nfiles,
+		  double megabytes)
+{
+  double bytes = 0;
+  long tokens = 0;
+  clock_t start = clock();
+
+  while (bytes < megabytes * 1e6) {
+    for (int i = 0; i < nfiles; i++) {
+      struct stat st;
+      if ((fin = fopen(files[i], "r")) == NULL || fstat(fileno(fin), &st) != 0)
+	fatal_error("Could not open input file\n");
+      curr_lineno = 1;
+      while (lex() != 0)
+	tokens++;
+      fclose(fin);
+      bytes += st.st_size;
+    }
+    if (bytes == 0)
+      break;
+  }
+
+  double secs = seconds_since(start);
+  printf("%-10s %10.1f MB %10ld tokens %8.3f s %10.1f MB/s\n",
+	 what, bytes / 1e6, tokens, secs, bytes / 1e6 / secs);
+}
+
+int main(int argc, char *argv[])
+{
+  double megabytes = 100;
+  int first = 1;
+
+  if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+    megabytes = atof(argv[2]);
+    first = 3;
+  }
+  if (first >= argc) {
+    fprintf(stderr, "usage: %s [-n megabytes] file.cl ...\n", argv[0]);
+    exit(1);
+  }
+
+  bench("flex", flex_yylex, argv + first, argc - first, megabytes);
+  bench("scanner", scan_yylex, argv + first, argc - first, megabytes);
+  printf("(scanner vectors: %s)\n", scan_vector_isa);
+  return 0;
+}
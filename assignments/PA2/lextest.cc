@@ -18,21 +18,22 @@
 #include <unistd.h>     // for getopt
 #include "cool-parse.h" // bison-generated file; defines tokens
 #include "utilities.h"
+#include "token-binary.h"
 
 //
 //  The lexer keeps this global variable up to date with the line number
 //  of the current line read from the input.
 //
-int curr_lineno = 1;
-char *curr_filename = "<stdin>"; // this name is arbitrary
-FILE *fin;   // This is the file pointer from which the lexer reads its input.
+thread_local int curr_lineno = 1;
+thread_local char *curr_filename = "<stdin>"; // this name is arbitrary
+thread_local FILE *fin;   // This is the file pointer from which the lexer reads its input.
 
 //
 //  cool_yylex() is the function produced by flex. It returns the next
 //  token each time it is called.
 //
 extern int cool_yylex();
-YYSTYPE cool_yylval;           // Not compiled with parser, so must define this.
+thread_local YYSTYPE cool_yylval;           // Not compiled with parser, so must define this.
 
 extern int optind;  // used for option processing (man 3 getopt for more info)
 
@@ -42,6 +43,7 @@ extern int optind;  // used for option processing (man 3 getopt for more info)
 //
 extern int yy_flex_debug;      // Flex debugging; see flex documentation.
 extern int lex_verbose;        // Controls printing of tokens.
+extern int ast_binary;         // Option -b: write the tokens in binary form.
 void handle_flags(int argc, char *argv[]);
 
 //
@@ -59,6 +61,7 @@ extern void dump_cool_token(ostream& out, int lineno,
 
 int main(int argc, char** argv) {
 	int token;
+	TokenWriter w;
 	
 	handle_flags(argc,argv);
 
@@ -77,13 +80,21 @@ int main(int argc, char** argv) {
 	    //
 	    // Scan and print all tokens.
 	    //
-	    cout << "#name \"" << argv[optind] << "\"" << endl;
-	    while ((token = cool_yylex()) != 0) {
-		dump_cool_token(cout, curr_lineno, token, cool_yylval);
+	    if (ast_binary) {
+		w.file(argv[optind]);
+		while ((token = cool_yylex()) != 0)
+		    w.token(curr_lineno, token, cool_yylval);
+	    } else {
+		cout << "#name \"" << argv[optind] << "\"" << endl;
+		while ((token = cool_yylex()) != 0) {
+		    dump_cool_token(cout, curr_lineno, token, cool_yylval);
+		}
 	    }
 	    fclose(fin);
 	    optind++;
 	}
+	if (ast_binary)
+	    w.write(cout);
 	exit(0);
 }
 
@@ -0,0 +1,756 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  ast-binary.cc
+//
+//  Writing and reading the binary form of the abstract syntax tree
+//  described in ast-binary.h.  The dump_binary methods below mirror the
+//  dump_with_types methods in dumptype.cc, and must visit the components
+//  of each node in the same order.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cool-tree.h"
+#include "ast-binary.h"
+#include "utilities.h"
+
+extern thread_local int node_lineno;        // defined in tree.cc
+
+/////////////////////////////////////////////////////////////////////////
+//
+//  AstWriter
+//
+/////////////////////////////////////////////////////////////////////////
+
+void AstWriter::put(std::string& out, unsigned n)
+{
+  char b[4] = { (char) n, (char) (n >> 8), (char) (n >> 16), (char) (n >> 24) };
+  out.append(b, 4);
+}
+
+int AstWriter::intern(AstTable table, std::string_view s)
+{
+  std::unordered_map<std::string_view, int>::iterator it = index[table].find(s);
+  if (it != index[table].end())
+    return it->second;
+  index[table][s] = syms[table].size();
+  syms[table].push_back(s);
+  return syms[table].size() - 1;
+}
+
+void AstWriter::begin(AstTag tag, tree_node *node)
+{
+  nodes.push_back((char) tag);
+  open.push_back(nodes.size());
+  put(nodes, 0);                     // the size, filled in by end()
+  put(nodes, node->get_line_number());
+}
+
+void AstWriter::end()
+{
+  size_t at = open.back();
+  unsigned n = nodes.size() - at - 4;
+  open.pop_back();
+  for (int i = 0; i < 4; i++)
+    nodes[at + i] = (char) (n >> (8 * i));
+}
+
+void AstWriter::symbol(AstTable table, std::string_view s)
+{
+  put(nodes, intern(table, s));
+}
+
+void AstWriter::symbol(AstTable table, Symbol sym)
+{
+  symbol(table, sym->get_view());
+}
+
+void AstWriter::type(Symbol type)
+{
+  if (type == NULL) {
+    put(nodes, 0);
+    return;
+  }
+  flags |= AST_TYPED;
+  put(nodes, intern(AST_ID, type->get_view()) + 1);
+}
+
+void AstWriter::write(ostream& s)
+{
+  std::string symbols;
+  for (int t = 0; t < AST_NTABLES; t++) {
+    put(symbols, syms[t].size());
+    for (size_t i = 0; i < syms[t].size(); i++) {
+      put(symbols, syms[t][i].size());
+      symbols.append(syms[t][i].data(), syms[t][i].size());
+      symbols.push_back('\0');
+    }
+  }
+
+  std::string head(AST_MAGIC, AST_MAGIC_LEN);
+  put(head, AST_VERSION);
+  put(head, flags);
+  put(head, symbols.size());
+  s.write(head.data(), head.size());
+  s.write(symbols.data(), symbols.size());
+
+  head.clear();
+  put(head, nodes.size());
+  s.write(head.data(), head.size());
+  s.write(nodes.data(), nodes.size());
+
+  if (flags & AST_HIERARCHY) {
+    head.clear();
+    put(head, hier.size());
+    s.write(head.data(), head.size());
+    s.write(hier.data(), hier.size());
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+//  dump_binary for each kind of node
+//
+/////////////////////////////////////////////////////////////////////////
+
+void program_class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_PROGRAM, this);
+   w.length(classes->len());
+   for (Class_ c : *classes)
+     c->dump_binary(w);
+   w.end();
+}
+
+void class__class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_CLASS, this);
+   w.symbol(AST_ID, name);
+   w.symbol(AST_ID, parent);
+   w.symbol(AST_STR, filename);
+   w.length(features->len());
+   for (Feature f : *features)
+     f->dump_binary(w);
+   w.end();
+}
+
+void method_class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_METHOD, this);
+   w.symbol(AST_ID, name);
+   w.length(formals->len());
+   for (Formal f : *formals)
+     f->dump_binary(w);
+   w.symbol(AST_ID, return_type);
+   expr->dump_binary(w);
+   w.end();
+}
+
+void attr_class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_ATTR, this);
+   w.symbol(AST_ID, name);
+   w.symbol(AST_ID, type_decl);
+   init->dump_binary(w);
+   w.end();
+}
+
+void formal_class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_FORMAL, this);
+   w.symbol(AST_ID, name);
+   w.symbol(AST_ID, type_decl);
+   w.end();
+}
+
+void branch_class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_BRANCH, this);
+   w.symbol(AST_ID, name);
+   w.symbol(AST_ID, type_decl);
+   expr->dump_binary(w);
+   w.end();
+}
+
+void assign_class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_ASSIGN, this);
+   w.symbol(AST_ID, name);
+   expr->dump_binary(w);
+   w.type(type);
+   w.end();
+}
+
+void static_dispatch_class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_STATIC_DISPATCH, this);
+   expr->dump_binary(w);
+   w.symbol(AST_ID, type_name);
+   w.symbol(AST_ID, name);
+   w.length(actual->len());
+   for (Expression e : *actual)
+     e->dump_binary(w);
+   w.type(type);
+   w.end();
+}
+
+void dispatch_class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_DISPATCH, this);
+   expr->dump_binary(w);
+   w.symbol(AST_ID, name);
+   w.length(actual->len());
+   for (Expression e : *actual)
+     e->dump_binary(w);
+   w.type(type);
+   w.end();
+}
+
+void cond_class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_COND, this);
+   pred->dump_binary(w);
+   then_exp->dump_binary(w);
+   else_exp->dump_binary(w);
+   w.type(type);
+   w.end();
+}
+
+void loop_class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_LOOP, this);
+   pred->dump_binary(w);
+   body->dump_binary(w);
+   w.type(type);
+   w.end();
+}
+
+void typcase_class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_TYPCASE, this);
+   expr->dump_binary(w);
+   w.length(cases->len());
+   for (Case c : *cases)
+     c->dump_binary(w);
+   w.type(type);
+   w.end();
+}
+
+void block_class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_BLOCK, this);
+   w.length(body->len());
+   for (Expression e : *body)
+     e->dump_binary(w);
+   w.type(type);
+   w.end();
+}
+
+void let_class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_LET, this);
+   w.symbol(AST_ID, identifier);
+   w.symbol(AST_ID, type_decl);
+   init->dump_binary(w);
+   body->dump_binary(w);
+   w.type(type);
+   w.end();
+}
+
+//
+// The arithmetic and comparison operators all have one or two operands.
+//
+static void dump_binary_op(AstWriter& w, AstTag tag, Expression_class *node,
+			   Expression e1, Expression e2)
+{
+   w.begin(tag, node);
+   e1->dump_binary(w);
+   if (e2)
+     e2->dump_binary(w);
+   w.type(node->get_type());
+   w.end();
+}
+
+void plus_class::dump_binary(AstWriter& w)   { dump_binary_op(w, AST_PLUS, this, e1, e2); }
+void sub_class::dump_binary(AstWriter& w)    { dump_binary_op(w, AST_SUB, this, e1, e2); }
+void mul_class::dump_binary(AstWriter& w)    { dump_binary_op(w, AST_MUL, this, e1, e2); }
+void divide_class::dump_binary(AstWriter& w) { dump_binary_op(w, AST_DIVIDE, this, e1, e2); }
+void neg_class::dump_binary(AstWriter& w)    { dump_binary_op(w, AST_NEG, this, e1, NULL); }
+void lt_class::dump_binary(AstWriter& w)     { dump_binary_op(w, AST_LT, this, e1, e2); }
+void eq_class::dump_binary(AstWriter& w)     { dump_binary_op(w, AST_EQ, this, e1, e2); }
+void leq_class::dump_binary(AstWriter& w)    { dump_binary_op(w, AST_LEQ, this, e1, e2); }
+void comp_class::dump_binary(AstWriter& w)   { dump_binary_op(w, AST_COMP, this, e1, NULL); }
+void isvoid_class::dump_binary(AstWriter& w) { dump_binary_op(w, AST_ISVOID, this, e1, NULL); }
+
+void int_const_class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_INT_CONST, this);
+   w.symbol(AST_INT, token);
+   w.type(type);
+   w.end();
+}
+
+//
+// The text form prints a boolean as 1 or 0, which the AST lexer enters
+// in the int table; do the same so the tables are numbered alike.
+//
+void bool_const_class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_BOOL_CONST, this);
+   w.symbol(AST_INT, val ? "1" : "0");
+   w.type(type);
+   w.end();
+}
+
+void string_const_class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_STRING_CONST, this);
+   w.symbol(AST_STR, token);
+   w.type(type);
+   w.end();
+}
+
+void new__class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_NEW, this);
+   w.symbol(AST_ID, type_name);
+   w.type(type);
+   w.end();
+}
+
+void no_expr_class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_NO_EXPR, this);
+   w.type(type);
+   w.end();
+}
+
+void object_class::dump_binary(AstWriter& w)
+{
+   w.begin(AST_OBJECT, this);
+   w.symbol(AST_ID, name);
+   w.type(type);
+   w.end();
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+//  Reading
+//
+/////////////////////////////////////////////////////////////////////////
+
+class AstReader {
+private:
+  const char *p, *lim;                   // the unread part of the input
+  std::vector<Symbol> syms[AST_NTABLES];
+
+  void error(const char *msg)
+  {
+    cerr << "Malformed binary AST: " << msg << endl;
+    exit(1);
+  }
+  unsigned get();
+  Symbol symbol(AstTable table);
+  Symbol type();
+  const char *node(AstTag& tag);
+  void finish(const char *end);
+  void read_symbols();
+
+  template <class Elem> list_node<Elem> *list(Elem (AstReader::*elem)());
+  Class_ read_class();
+  Feature read_feature();
+  Formal read_formal();
+  Case read_case();
+  Expression read_expr();
+public:
+  AstReader(const char *buf, size_t len) : p(buf), lim(buf + len) { }
+  Program read(std::string *hierarchy);
+};
+
+unsigned AstReader::get()
+{
+  if (lim - p < 4)
+    error("unexpected end of input");
+  const unsigned char *b = (const unsigned char *) p;
+  p += 4;
+  return b[0] | (b[1] << 8) | (b[2] << 16) | ((unsigned) b[3] << 24);
+}
+
+Symbol AstReader::symbol(AstTable table)
+{
+  unsigned i = get();
+  if (i >= syms[table].size())
+    error("symbol index out of range");
+  return syms[table][i];
+}
+
+Symbol AstReader::type()
+{
+  unsigned i = get();
+  if (i == 0)
+    return NULL;
+  if (i > syms[AST_ID].size())
+    error("symbol index out of range");
+  return syms[AST_ID][i - 1];
+}
+
+//
+// node reads the tag and size at the start of a node and returns where
+// the node ends.  The caller reads the line number and the components,
+// checks them against the end with finish(), and sets node_lineno just
+// before building the node, since building the components changed it.
+//
+const char *AstReader::node(AstTag& tag)
+{
+  if (p >= lim)
+    error("unexpected end of input");
+  tag = (AstTag) (unsigned char) *p++;
+  unsigned size = get();
+  if (size > (size_t) (lim - p))
+    error("node extends past the end of the input");
+  return p + size;
+}
+
+void AstReader::finish(const char *end)
+{
+  if (p != end)
+    error("node size does not match its contents");
+}
+
+//
+// Lists are rebuilt in the shape the AST parser gives them: nil, or a
+// single followed by one append per further element.
+//
+template <class Elem>
+list_node<Elem> *AstReader::list(Elem (AstReader::*elem)())
+{
+  unsigned n = get();
+  if (n == 0)
+    return list_node<Elem>::nil();
+  list_node<Elem> *l = list_node<Elem>::single((this->*elem)());
+  for (unsigned i = 1; i < n; i++)
+    l = list_node<Elem>::append(l, list_node<Elem>::single((this->*elem)()));
+  return l;
+}
+
+//
+// The symbol section is entered into the string tables in order, which
+// is the order the AST lexer would have met the symbols in the text.
+//
+void AstReader::read_symbols()
+{
+  unsigned size = get();
+  if (size > (size_t) (lim - p))
+    error("symbol section extends past the end of the input");
+  const char *end = p + size;
+
+  for (int t = 0; t < AST_NTABLES; t++) {
+    unsigned n = get();
+    syms[t].reserve(n);
+    for (unsigned i = 0; i < n; i++) {
+      unsigned len = get();
+      if (len >= (size_t) (end - p) || p[len] != '\0')
+	error("bad symbol");
+      char *s = (char *) p;
+      switch (t) {
+      case AST_ID:  syms[t].push_back(idtable.add_string(s, len)); break;
+      case AST_STR: syms[t].push_back(stringtable.add_string(s, len)); break;
+      case AST_INT: syms[t].push_back(inttable.add_string(s, len)); break;
+      }
+      p += len + 1;
+    }
+  }
+  finish(end);
+}
+
+Program AstReader::read(std::string *hierarchy)
+{
+  if (lim - p < AST_MAGIC_LEN || memcmp(p, AST_MAGIC, AST_MAGIC_LEN) != 0)
+    error("bad magic number");
+  p += AST_MAGIC_LEN;
+  if (get() != AST_VERSION)
+    error("unsupported version");
+  unsigned flags = get();                // AST_TYPED is informational only
+  read_symbols();
+
+  // the hierarchy section, if any, follows the nodes
+  unsigned size = get();
+  const char *nodes_end = p + size;
+  if (size > (size_t) (lim - p) ||
+      (!(flags & AST_HIERARCHY) && nodes_end != lim))
+    error("node section size does not match the input");
+  const char *all_end = lim;
+  lim = nodes_end;
+
+  AstTag tag;
+  const char *end = node(tag);
+  int line = get();
+  if (tag != AST_PROGRAM)
+    error("expected a program");
+  Classes classes = list<Class_>(&AstReader::read_class);
+  finish(end);
+  node_lineno = line;
+
+  if (flags & AST_HIERARCHY) {
+    lim = all_end;
+    size = get();
+    if (size != (size_t) (lim - p))
+      error("hierarchy section size does not match the input");
+    if (hierarchy != NULL)
+      hierarchy->assign(p, size);
+  }
+  return program(classes);
+}
+
+Class_ AstReader::read_class()
+{
+  AstTag tag;
+  const char *end = node(tag);
+  int line = get();
+  if (tag != AST_CLASS)
+    error("expected a class");
+  Symbol name = symbol(AST_ID);
+  Symbol parent = symbol(AST_ID);
+  Symbol filename = symbol(AST_STR);
+  Features features = list<Feature>(&AstReader::read_feature);
+  finish(end);
+  node_lineno = line;
+  return class_(name, parent, features, filename);
+}
+
+Feature AstReader::read_feature()
+{
+  AstTag tag;
+  const char *end = node(tag);
+  int line = get();
+  Feature f = NULL;
+
+  if (tag == AST_METHOD) {
+    Symbol name = symbol(AST_ID);
+    Formals formals = list<Formal>(&AstReader::read_formal);
+    Symbol return_type = symbol(AST_ID);
+    Expression expr = read_expr();
+    node_lineno = line;
+    f = method(name, formals, return_type, expr);
+  } else if (tag == AST_ATTR) {
+    Symbol name = symbol(AST_ID);
+    Symbol type_decl = symbol(AST_ID);
+    Expression init = read_expr();
+    node_lineno = line;
+    f = attr(name, type_decl, init);
+  } else
+    error("expected a feature");
+  finish(end);
+  return f;
+}
+
+Formal AstReader::read_formal()
+{
+  AstTag tag;
+  const char *end = node(tag);
+  int line = get();
+  if (tag != AST_FORMAL)
+    error("expected a formal");
+  Symbol name = symbol(AST_ID);
+  Symbol type_decl = symbol(AST_ID);
+  finish(end);
+  node_lineno = line;
+  return formal(name, type_decl);
+}
+
+Case AstReader::read_case()
+{
+  AstTag tag;
+  const char *end = node(tag);
+  int line = get();
+  if (tag != AST_BRANCH)
+    error("expected a branch");
+  Symbol name = symbol(AST_ID);
+  Symbol type_decl = symbol(AST_ID);
+  Expression expr = read_expr();
+  finish(end);
+  node_lineno = line;
+  return branch(name, type_decl, expr);
+}
+
+Expression AstReader::read_expr()
+{
+  AstTag tag;
+  const char *end = node(tag);
+  int line = get();
+  Expression e = NULL;
+
+  switch (tag) {
+  case AST_ASSIGN: {
+    Symbol name = symbol(AST_ID);
+    Expression expr = read_expr();
+    node_lineno = line;
+    e = assign(name, expr);
+    break;
+  }
+  case AST_STATIC_DISPATCH: {
+    Expression expr = read_expr();
+    Symbol type_name = symbol(AST_ID);
+    Symbol name = symbol(AST_ID);
+    Expressions actual = list<Expression>(&AstReader::read_expr);
+    node_lineno = line;
+    e = static_dispatch(expr, type_name, name, actual);
+    break;
+  }
+  case AST_DISPATCH: {
+    Expression expr = read_expr();
+    Symbol name = symbol(AST_ID);
+    Expressions actual = list<Expression>(&AstReader::read_expr);
+    node_lineno = line;
+    e = dispatch(expr, name, actual);
+    break;
+  }
+  case AST_COND: {
+    Expression pred = read_expr();
+    Expression then_exp = read_expr();
+    Expression else_exp = read_expr();
+    node_lineno = line;
+    e = cond(pred, then_exp, else_exp);
+    break;
+  }
+  case AST_LOOP: {
+    Expression pred = read_expr();
+    Expression body = read_expr();
+    node_lineno = line;
+    e = loop(pred, body);
+    break;
+  }
+  case AST_TYPCASE: {
+    Expression expr = read_expr();
+    Cases cases = list<Case>(&AstReader::read_case);
+    node_lineno = line;
+    e = typcase(expr, cases);
+    break;
+  }
+  case AST_BLOCK: {
+    Expressions body = list<Expression>(&AstReader::read_expr);
+    node_lineno = line;
+    e = block(body);
+    break;
+  }
+  case AST_LET: {
+    Symbol identifier = symbol(AST_ID);
+    Symbol type_decl = symbol(AST_ID);
+    Expression init = read_expr();
+    Expression body = read_expr();
+    node_lineno = line;
+    e = let(identifier, type_decl, init, body);
+    break;
+  }
+  case AST_PLUS: case AST_SUB: case AST_MUL: case AST_DIVIDE:
+  case AST_LT: case AST_EQ: case AST_LEQ: {
+    Expression e1 = read_expr();
+    Expression e2 = read_expr();
+    node_lineno = line;
+    switch (tag) {
+    case AST_PLUS:   e = plus(e1, e2); break;
+    case AST_SUB:    e = sub(e1, e2); break;
+    case AST_MUL:    e = mul(e1, e2); break;
+    case AST_DIVIDE: e = divide(e1, e2); break;
+    case AST_LT:     e = lt(e1, e2); break;
+    case AST_EQ:     e = eq(e1, e2); break;
+    default:         e = leq(e1, e2); break;
+    }
+    break;
+  }
+  case AST_NEG: case AST_COMP: case AST_ISVOID: {
+    Expression e1 = read_expr();
+    node_lineno = line;
+    switch (tag) {
+    case AST_NEG:  e = neg(e1); break;
+    case AST_COMP: e = comp(e1); break;
+    default:       e = isvoid(e1); break;
+    }
+    break;
+  }
+  case AST_INT_CONST: {
+    Symbol token = symbol(AST_INT);
+    node_lineno = line;
+    e = int_const(token);
+    break;
+  }
+  case AST_BOOL_CONST: {
+    Symbol val = symbol(AST_INT);
+    node_lineno = line;
+    e = bool_const(*val->get_string() == '1');
+    break;
+  }
+  case AST_STRING_CONST: {
+    Symbol token = symbol(AST_STR);
+    node_lineno = line;
+    e = string_const(token);
+    break;
+  }
+  case AST_NEW: {
+    Symbol type_name = symbol(AST_ID);
+    node_lineno = line;
+    e = new_(type_name);
+    break;
+  }
+  case AST_NO_EXPR:
+    node_lineno = line;
+    e = no_expr();
+    break;
+  case AST_OBJECT: {
+    Symbol name = symbol(AST_ID);
+    node_lineno = line;
+    e = object(name);
+    break;
+  }
+  default:
+    error("expected an expression");
+  }
+
+  Symbol t = type();
+  if (t)
+    e->set_type(t);
+  finish(end);
+  return e;
+}
+
+//
+// The input is mapped when it is a regular file, and read into memory
+// when it is a pipe.  Everything the tree needs is copied out of it, so
+// it is released again before returning.
+//
+Program read_ast_binary(FILE *in, std::string *hierarchy)
+{
+  int c = getc(in);
+  if (c == EOF)
+    return NULL;
+  ungetc(c, in);
+  if (c != AST_MAGIC[0])
+    return NULL;
+
+  struct stat st;
+  int fd = fileno(in);
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+      ftell(in) == 0) {
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      Program prog = AstReader((const char *) map, st.st_size).read(hierarchy);
+      munmap(map, st.st_size);
+      return prog;
+    }
+  }
+
+  std::vector<char> buf;
+  char chunk[1 << 16];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof chunk, in)) > 0)
+    buf.insert(buf.end(), chunk, chunk + n);
+  return AstReader(buf.data(), buf.size()).read(hierarchy);
+}
@@ -9,7 +9,7 @@
 #include "cool.h"
 #include "stringtab.h"
 #define yylineno curr_lineno;
-extern int yylineno;
+extern thread_local int yylineno;
 
 inline Boolean copy_Boolean(Boolean b) {return b; }
 inline void assert_Boolean(Boolean) {}
@@ -20,6 +20,9 @@ void dump_Symbol(ostream& stream, int padding, Symbol b);
 void assert_Symbol(Symbol b);
 Symbol copy_Symbol(Symbol b);
 
+class AstWriter;
+class TypedDump;
+struct TypedDumpFrame;
 class Program_class;
 typedef Program_class *Program;
 class Class__class;
@@ -45,62 +48,81 @@ typedef list_node<Case> Cases_class;
 typedef Cases_class *Cases;
 
 #define Program_EXTRAS                          \
-virtual void dump_with_types(ostream&, int) = 0; 
+virtual void dump_with_types(ostream&, int) = 0; \
+virtual void dump_binary(AstWriter&) = 0;
 
 
 
 #define program_EXTRAS                          \
-void dump_with_types(ostream&, int);            
+void dump_with_types(ostream&, int); \
+void dump_binary(AstWriter&);
 
 #define Class__EXTRAS                   \
 virtual Symbol get_filename() = 0;      \
-virtual void dump_with_types(ostream&,int) = 0; 
+virtual void dump_with_types(ostream&,int) = 0; \
+virtual void dump_binary(AstWriter&) = 0;
 
 
 #define class__EXTRAS                                 \
 Symbol get_filename() { return filename; }             \
-void dump_with_types(ostream&,int);                    
+void dump_with_types(ostream&,int); \
+void dump_binary(AstWriter&);
 
 
 #define Feature_EXTRAS                                        \
-virtual void dump_with_types(ostream&,int) = 0; 
+virtual void dump_with_types(ostream&,int) = 0; \
+virtual void dump_binary(AstWriter&) = 0;
 
 
 #define Feature_SHARED_EXTRAS                                       \
-void dump_with_types(ostream&,int);    
+void dump_with_types(ostream&,int); \
+void dump_binary(AstWriter&);
 
 
 
 
 
 #define Formal_EXTRAS                              \
-virtual void dump_with_types(ostream&,int) = 0;
+virtual void dump_with_types(ostream&,int) = 0; \
+virtual void dump_binary(AstWriter&) = 0;
 
 
 #define formal_EXTRAS                           \
-void dump_with_types(ostream&,int);
+void dump_with_types(ostream&,int); \
+void dump_binary(AstWriter&);
 
 
+//
+// dump_with_types walks the expression on a stack of its own (see
+// walk.h), so that it can dump trees of any depth; step is the part of
+// each node in the walk.  A branch is dumped by the walk of its case:
+// dump_branch prints the branch up to its expression, which it returns.
+//
 #define Case_EXTRAS                             \
-virtual void dump_with_types(ostream& ,int) = 0;
+virtual Expression dump_branch(ostream&, int) = 0; \
+virtual void dump_binary(AstWriter&) = 0;
 
 
 #define branch_EXTRAS                                   \
-void dump_with_types(ostream& ,int);
+Expression dump_branch(ostream&, int); \
+void dump_binary(AstWriter&);
 
 
 #define Expression_EXTRAS                    \
 Symbol type;                                 \
 Symbol get_type() { return type; }           \
 Expression set_type(Symbol s) { type = s; return this; } \
-virtual void dump_with_types(ostream&,int) = 0;  \
+void dump_with_types(ostream&,int);  \
+virtual bool step(TypedDump&, TypedDumpFrame&) = 0; \
+virtual void dump_binary(AstWriter&) = 0; \
 void dump_type(ostream&, int);               \
 Expression_class() { type = (Symbol) NULL; }
 
 
 
 #define Expression_SHARED_EXTRAS           \
-void dump_with_types(ostream&,int); 
+bool step(TypedDump&, TypedDumpFrame&) override; \
+void dump_binary(AstWriter&);
 
 
 #endif
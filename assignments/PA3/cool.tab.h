@@ -147,7 +147,7 @@ struct YYLTYPE
 #endif
 
 
-extern YYSTYPE cool_yylval;
+extern thread_local YYSTYPE cool_yylval;
 extern YYLTYPE cool_yylloc;
 int cool_yyparse (void);
 
@@ -5,19 +5,21 @@
 */
 %{
   #include <iostream>
+  #include <sstream>
+  #include <string>
+  #include <vector>
   #include "cool-tree.h"
   #include "stringtab.h"
   #include "utilities.h"
   
-  extern char *curr_filename;
+  extern thread_local char *curr_filename;
+  extern thread_local int curr_lineno;
   
   
   /* Locations */
   #define YYLTYPE int              /* the type of locations */
-  #define cool_yylloc curr_lineno  /* use the curr_lineno from the lexer
-  for the location of tokens */
     
-    extern int node_lineno;          /* set before constructing a tree node
+    extern thread_local int node_lineno; /* set before constructing a tree node
     to whatever you want the line number
     for the tree node to be */
       
@@ -74,17 +76,43 @@
     
     
     
-    void yyerror(char *s);        /*  defined below; called for each parse error */
+    void parse_error(YYLTYPE *llocp, char *s, int token); /* defined below; called for each parse error */
     extern int yylex();           /*  the entry point to the lexer  */
     
     /************************************************************************/
     /*                DONT CHANGE ANYTHING IN THIS SECTION                  */
     
-    Program ast_root;	      /* the result of the parse  */
-    Classes parse_results;        /* for use in semantic analysis */
-    int omerrs = 0;               /* number of errors in lexing and parsing */
+    /* The parser is pure, and these are per thread, so that coolc -j can
+    parse several files at once.  See yylex and parse_error below. */
+    thread_local Program ast_root;	      /* the result of the parse  */
+    thread_local Classes parse_results;   /* for use in semantic analysis */
+    thread_local int omerrs = 0;          /* number of errors in lexing and parsing */
+    
+    /* if set, parse_error adds its messages here instead of printing them */
+    thread_local std::vector<std::string> *parse_errors;
     %}
     
+    %define api.pure full
+    
+    %code {
+      /* The lexer leaves the value of each token in cool_yylval, and its
+      line in curr_lineno; yylex passes them on to the parser. */
+      extern thread_local YYSTYPE cool_yylval;
+      
+      static int yylex(YYSTYPE *lvalp, YYLTYPE *llocp)
+      {
+        int token = yylex();
+        *lvalp = cool_yylval;
+        *llocp = curr_lineno;
+        return token;
+      }
+      
+      /* The lookahead token of a pure parser is local to yyparse, so
+      parse_error is called in its place and given it. */
+      #undef yyerror
+      #define yyerror(llocp, s) parse_error(llocp, s, yychar)
+    }
+    
     /* A union of all the types that can be the result of parsing actions. */
     %union {
       Boolean boolean;
@@ -175,7 +203,7 @@
     class
     : CLASS TYPEID '{' features '}' ';'                 { $$ = class_($2, idtable.add_string("Object"), $4, stringtable.add_string(curr_filename)); }
     | CLASS TYPEID INHERITS TYPEID '{' features '}' ';' { $$ = class_($2, $4, $6, stringtable.add_string(curr_filename)); }
-    | error ';'
+    | error ';'                                         { $$ = NULL; }
     ;
     
     /* Feature list may be empty, but no empty features in list. */
@@ -188,7 +216,7 @@
     : OBJECTID '(' maybe_formals ')' ':' TYPEID '{' expr '}' ';' { $$ = method($1, $3, $6, $8); }
     | OBJECTID ':' TYPEID ';'                                    { $$ = attr($1, $3, no_expr()); }
     | OBJECTID ':' TYPEID ASSIGN expr ';'                        { $$ = attr($1, $3, $5); }
-    | error ';'
+    | error ';'                                                  { $$ = NULL; }
     ;
 
     maybe_formals
@@ -242,13 +270,13 @@
     args
     : expr          { $$ = single_Expressions($1); }
     | expr ',' args { $$ = append_Expressions(single_Expressions($1), $3); }
-    | error ')'
+    | error ')'     { $$ = NULL; }
     ;
 
     exprs
     : expr ';'       { $$ = single_Expressions($1); }
     | exprs expr ';' { $$ = append_Expressions($1, single_Expressions($2)); }
-    | error ';'
+    | error ';'      { $$ = NULL; }
     ;
 
     let
@@ -256,8 +284,8 @@
     | OBJECTID ':' TYPEID ASSIGN expr IN expr { $$ = let($1, $3, $5, $7); }
     | OBJECTID ':' TYPEID ',' let             { $$ = let($1, $3, no_expr(), $5); }
     | OBJECTID ':' TYPEID ASSIGN expr ',' let { $$ = let($1, $3, $5, $7); }
-    | error ',' let
-    | error IN expr
+    | error ',' let                           { $$ = NULL; }
+    | error IN expr                           { $$ = NULL; }
     ;
 
     cases
@@ -273,13 +301,22 @@
     %%
     
     /* This function is called automatically when Bison detects a parse error. */
-    void yyerror(char *s)
+    void parse_error(YYLTYPE *llocp, char *s, int token)
     {
-      extern int curr_lineno;
+      if (parse_errors != NULL) {
+        std::ostringstream msg;
+        msg << "\"" << curr_filename << "\", line " << curr_lineno << ": " \
+        << s << " at or near ";
+        print_cool_token(msg, token);
+        msg << endl;
+        parse_errors->push_back(msg.str());
+        omerrs++;
+        return;
+      }
       
       cerr << "\"" << curr_filename << "\", line " << curr_lineno << ": " \
       << s << " at or near ";
-      print_cool_token(yychar);
+      print_cool_token(token);
       cerr << endl;
       omerrs++;
       
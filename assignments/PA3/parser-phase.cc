@@ -18,29 +18,53 @@
 #include "cool-tree.h"
 #include "utilities.h"  // for fatal_error
 #include "cool-parse.h"
+#include "ast-binary.h"
+#include "token-binary.h"
 
 //
 // These globals keep everything working.
 //
 FILE *token_file = stdin;		// we read from this file
-extern Classes parse_results;	 // list of classes; used for multiple files 
-extern Program ast_root;	 // the AST produced by the parse
+extern thread_local Classes parse_results; // list of classes; used for multiple files 
+extern thread_local Program ast_root;	 // the AST produced by the parse
 
-char *curr_filename = "<stdin>";
+thread_local char *curr_filename = "<stdin>";
+thread_local int curr_lineno;  // of the last token read
+thread_local YYSTYPE cool_yylval; // the value of the last token read
 
-extern int omerrs;             // a count of lex and parse errors
+extern thread_local int omerrs; // a count of lex and parse errors
+extern int ast_binary;         // write the AST in binary form
 
 extern int cool_yyparse();
 void handle_flags(int argc, char *argv[]);
 
+//
+// The tokens come in the text form dump_cool_token writes, which
+// text_yylex reads, or in the binary form of token-binary.h.
+//
+extern int text_yylex();
+static int binary_tokens;
+
+int cool_yylex()
+{
+    return binary_tokens ? binary_yylex() : text_yylex();
+}
+
 int main(int argc, char *argv[]) {
     handle_flags(argc, argv);
+    binary_tokens = read_token_binary(token_file);
     cool_yyparse();
     if (omerrs != 0) {
 	cerr << "Compilation halted due to lex and parse errors\n";
 	exit(1);
     }
-    ast_root->dump_with_types(cout,0);
+    if (ast_binary) {
+	AstWriter w;
+	ast_root->dump_binary(w);
+	w.write(cout);
+    } else
+	ast_root->dump_with_types(cout,0);
+    tree_node::release_all();
     return 0;
 }
 
@@ -24,6 +24,9 @@ Entry::Entry(char *s, int l, int i) : len(l), index(i) {
   str[len] = '\0';
 }
 
+Entry::Entry(char *s, int l, int i, StringArena &a)
+  : str(a.copy_string(s, l)), len(l), index(i) { }
+
 int Entry::equal_string(char *string, int length) const
 {
   return (len == length) && (strncmp(str,string,len) == 0);
@@ -74,6 +77,64 @@ StringEntry::StringEntry(char *s, int l, int i) : Entry(s,l,i) { }
 IdEntry::IdEntry(char *s, int l, int i) : Entry(s,l,i) { }
 IntEntry::IntEntry(char *s, int l, int i) : Entry(s,l,i) { }
 
+StringEntry::StringEntry(char *s, int l, int i, StringArena &a)
+  : Entry(s,l,i,a) { }
+IdEntry::IdEntry(char *s, int l, int i, StringArena &a)
+  : Entry(s,l,i,a) { }
+IntEntry::IntEntry(char *s, int l, int i, StringArena &a)
+  : Entry(s,l,i,a) { }
+
+void *StringArena::allocate(size_t n, size_t align)
+{
+  size_t pad = (align - ((size_t) next & (align - 1))) & (align - 1);
+  if (pad + n > left) {
+    //
+    // Start a new chunk.  Requests too big for a chunk get one of their
+    // own, which is slotted in behind the current chunk so the free space
+    // there is not lost.
+    //
+    if (n + align > CHUNK_SIZE) {
+      char *big = new char[n + align];
+      chunks.insert(chunks.end() - (chunks.empty() ? 0 : 1), big);
+      size_t bpad = (align - ((size_t) big & (align - 1))) & (align - 1);
+      return big + bpad;
+    }
+    next = new char[CHUNK_SIZE];
+    left = CHUNK_SIZE;
+    chunks.push_back(next);
+    pad = (align - ((size_t) next & (align - 1))) & (align - 1);
+  }
+  char *p = next + pad;
+  next = p + n;
+  left -= pad + n;
+  return p;
+}
+
+char *StringArena::copy_string(const char *s, int len)
+{
+  char *p = (char *) allocate(len + 1, 1);
+  memcpy(p, s, len);
+  p[len] = '\0';
+  return p;
+}
+
+void StringArena::adopt(StringArena &other)
+{
+  chunks.insert(chunks.end(), other.chunks.begin(), other.chunks.end());
+  other.chunks.clear();
+  other.next = NULL;
+  other.left = 0;
+}
+
+void StringArena::release()
+{
+  for (size_t i = 0; i < chunks.size(); i++)
+    delete [] chunks[i];
+  chunks.clear();
+  next = NULL;
+  left = 0;
+}
+
 IdTable idtable;
 IntTable inttable;
 StrTable stringtable;
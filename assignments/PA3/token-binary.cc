@@ -0,0 +1,279 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  token-binary.cc
+//
+//  Writing and reading the binary token stream described in
+//  token-binary.h.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include "token-binary.h"
+
+extern thread_local int curr_lineno;
+extern thread_local char *curr_filename;
+
+/////////////////////////////////////////////////////////////////////////
+//
+//  Writing
+//
+/////////////////////////////////////////////////////////////////////////
+
+void TokenWriter::put(std::string& out, unsigned n)
+{
+  while (n >= 0x80) {
+    out += (char) (n | 0x80);
+    n >>= 7;
+  }
+  out += (char) n;
+}
+
+void TokenWriter::put_string(std::string& out, const char *s, int len)
+{
+  put(out, len);
+  out.append(s, len);
+  out += '\0';
+}
+
+void TokenWriter::file(const char *name)
+{
+  tokens += (char) TOK_FILE;
+  put_string(tokens, name, strlen(name));
+  line = 0;
+}
+
+void TokenWriter::token(int lineno, int token, YYSTYPE& yylval)
+{
+  tokens += (char) (token < TOK_NAMED ? token : TOK_NAMED + token - CLASS);
+  int delta = lineno - line;
+  put(tokens, (delta << 1) ^ (delta >> 31));
+  line = lineno;
+
+  switch (token) {
+  case TYPEID:
+  case OBJECTID:
+  case STR_CONST:
+  case INT_CONST:
+    put(tokens, yylval.symbol->get_index());
+    break;
+  case BOOL_CONST:
+    put(tokens, yylval.boolean ? 1 : 0);
+    break;
+  case ERROR:
+    put_string(tokens, yylval.error_msg, strlen(yylval.error_msg));
+    break;
+  }
+}
+
+template <class Elem>
+void TokenWriter::put_table(std::string& out, StringTable<Elem>& table)
+{
+  int n = 0;
+  for (int i = table.first(); table.more(i); i = table.next(i))
+    n++;
+  put(out, n);
+  for (int i = table.first(); table.more(i); i = table.next(i)) {
+    Elem *e = table.lookup(i);
+    put_string(out, e->get_string(), e->get_len());
+  }
+}
+
+void TokenWriter::write(ostream& s)
+{
+  std::string head(TOKEN_MAGIC, TOKEN_MAGIC_LEN);
+  put(head, TOKEN_VERSION);
+  put_table(head, idtable);
+  put_table(head, stringtable);
+  put_table(head, inttable);
+  s.write(head.data(), head.size());
+
+  tokens += (char) TOK_END;
+  s.write(tokens.data(), tokens.size());
+}
+
+/////////////////////////////////////////////////////////////////////////
+//
+//  Reading
+//
+/////////////////////////////////////////////////////////////////////////
+
+class TokenReader {
+private:
+  const char *p, *lim;                   // the unread part of the input
+  std::vector<Symbol> syms[3];           // id, string and int symbols
+  int line;                              // of the last token
+
+  void error(const char *msg)
+  {
+    cerr << "Malformed binary token stream: " << msg << endl;
+    exit(1);
+  }
+  unsigned get();
+  const char *get_string(int& len);
+  template <class Elem>
+  void get_table(std::vector<Symbol>& syms, StringTable<Elem>& table);
+  Symbol symbol(int table);
+public:
+  TokenReader(const char *buf, size_t len);
+  int next();
+};
+
+unsigned TokenReader::get()
+{
+  unsigned n = 0;
+  for (int shift = 0; shift < 32; shift += 7) {
+    if (p >= lim)
+      error("unexpected end of input");
+    unsigned char b = *p++;
+    n |= (unsigned) (b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return n;
+  }
+  error("number too large");
+  return 0;
+}
+
+//
+// get_string returns a pointer to the characters of a symbol entry,
+// which are followed by a '\0' in the input.
+//
+const char *TokenReader::get_string(int& len)
+{
+  len = get();
+  if ((size_t) len >= (size_t) (lim - p) || p[len] != '\0')
+    error("bad string");
+  const char *s = p;
+  p += len + 1;
+  return s;
+}
+
+template <class Elem>
+void TokenReader::get_table(std::vector<Symbol>& syms, StringTable<Elem>& table)
+{
+  unsigned n = get();
+  syms.reserve(n);
+  for (unsigned i = 0; i < n; i++) {
+    int len;
+    const char *s = get_string(len);
+    syms.push_back(table.add_string((char *) s, len));
+  }
+}
+
+Symbol TokenReader::symbol(int table)
+{
+  unsigned i = get();
+  if (i >= syms[table].size())
+    error("symbol index out of range");
+  return syms[table][i];
+}
+
+TokenReader::TokenReader(const char *buf, size_t len)
+  : p(buf), lim(buf + len), line(0)
+{
+  if (len < TOKEN_MAGIC_LEN || memcmp(buf, TOKEN_MAGIC, TOKEN_MAGIC_LEN) != 0)
+    error("bad magic number");
+  p += TOKEN_MAGIC_LEN;
+  if (get() != TOKEN_VERSION)
+    error("unknown version");
+  get_table(syms[0], idtable);
+  get_table(syms[1], stringtable);
+  get_table(syms[2], inttable);
+}
+
+int TokenReader::next()
+{
+  for (;;) {
+    if (p >= lim)
+      error("unexpected end of input");
+    int token = (unsigned char) *p++;
+    if (token == TOK_END) {
+      p--;                               // stay at the end
+      return 0;
+    }
+    if (token == TOK_FILE) {
+      int len;
+      curr_filename = (char *) get_string(len);
+      line = 0;
+      continue;
+    }
+    if (token >= TOK_NAMED)
+      token += CLASS - TOK_NAMED;
+
+    unsigned delta = get();
+    line += (int) (delta >> 1) ^ -(int) (delta & 1);
+    curr_lineno = line;
+
+    switch (token) {
+    case TYPEID:
+    case OBJECTID:
+      cool_yylval.symbol = symbol(0);
+      break;
+    case STR_CONST:
+      cool_yylval.symbol = symbol(1);
+      break;
+    case INT_CONST:
+      cool_yylval.symbol = symbol(2);
+      break;
+    case BOOL_CONST:
+      cool_yylval.boolean = get();
+      break;
+    case ERROR: {
+      int len;
+      cool_yylval.error_msg = (char *) get_string(len);
+      break;
+    }
+    }
+    return token;
+  }
+}
+
+//
+// The input is mapped when it is a regular file, and read into memory
+// when it is a pipe.  File names and error messages point into it, so it
+// is kept until the program exits.
+//
+static TokenReader *reader;
+
+int read_token_binary(FILE *in)
+{
+  int c = getc(in);
+  if (c == EOF)
+    return 0;
+  ungetc(c, in);
+  if (c != TOKEN_MAGIC[0])
+    return 0;
+
+  struct stat st;
+  int fd = fileno(in);
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+      ftell(in) == 0) {
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      reader = new TokenReader((const char *) map, st.st_size);
+      return 1;
+    }
+  }
+
+  std::vector<char> *buf = new std::vector<char>;
+  char chunk[1 << 16];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof chunk, in)) > 0)
+    buf->insert(buf->end(), chunk, chunk + n);
+  reader = new TokenReader(buf->data(), buf->size());
+  return 1;
+}
+
+int binary_yylex()
+{
+  return reader->next();
+}
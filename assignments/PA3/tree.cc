@@ -13,10 +13,44 @@
 //
 ///////////////////////////////////////////////////////////////////////////
 
+#include <mutex>
 #include "tree.h"
 
 /* line number to assign to the current node being constructed */
-int node_lineno = 1;
+thread_local int node_lineno = 1;
+
+/* a region of nodes, and the nodes in it that own memory of their own,
+   whose destructors are run when it is released */
+struct NodeRegion {
+    StringArena arena;
+    std::vector<tree_node *> owners;
+
+    ~NodeRegion() { release(); }
+    void release();
+    void adopt(NodeRegion &other);
+};
+
+void NodeRegion::release()
+{
+    for (tree_node *node : owners)
+	node->~tree_node();
+    owners.clear();
+    arena.release();
+}
+
+void NodeRegion::adopt(NodeRegion &other)
+{
+    arena.adopt(other.arena);
+    owners.insert(owners.end(), other.owners.begin(), other.owners.end());
+    other.owners.clear();
+}
+
+/* the region from which this thread allocates tree nodes */
+static thread_local NodeRegion node_region;
+
+/* the nodes of threads that have called keep_thread_nodes */
+static NodeRegion kept_nodes;
+static std::mutex kept_nodes_lock;
 
 ///////////////////////////////////////////////////////////////////////////
 //
@@ -47,3 +81,57 @@ tree_node *tree_node::set(tree_node *t) {
    line_number = t->line_number;
    return this;
 }
+
+///////////////////////////////////////////////////////////////////////////
+//
+// tree_node::operator new
+//
+// allocate a node from the region.  No member of a node needs more than
+// pointer alignment.
+//
+///////////////////////////////////////////////////////////////////////////
+void *tree_node::operator new(size_t size)
+{
+    return node_region.arena.allocate(size, sizeof(void *));
+}
+
+///////////////////////////////////////////////////////////////////////////
+//
+// tree_node::owns_memory
+//
+// have the destructor of this node run when its region is released
+//
+///////////////////////////////////////////////////////////////////////////
+void tree_node::owns_memory()
+{
+    node_region.owners.push_back(this);
+}
+
+///////////////////////////////////////////////////////////////////////////
+//
+// tree_node::release_all
+//
+// free every node in one step, running the destructors of those that
+// own memory
+//
+///////////////////////////////////////////////////////////////////////////
+void tree_node::release_all()
+{
+    node_region.release();
+    std::lock_guard<std::mutex> guard(kept_nodes_lock);
+    kept_nodes.release();
+}
+
+///////////////////////////////////////////////////////////////////////////
+//
+// tree_node::keep_thread_nodes
+//
+// hand the region of this thread over to kept_nodes, so that its nodes
+// outlive the thread
+//
+///////////////////////////////////////////////////////////////////////////
+void tree_node::keep_thread_nodes()
+{
+    std::lock_guard<std::mutex> guard(kept_nodes_lock);
+    kept_nodes.adopt(node_region);
+}
@@ -14,8 +14,11 @@
 //#include "semant.h"
 #include "cool-tree.handcode.h"
 
-using SymTab = SymbolTable<Symbol, Symbol>;
+using SymTab = HashedSymbolTable<Symbol, Symbol>;
 class ClassTable;
+class Typecheck;
+struct TypecheckFrame;
+class TreeKey;
 
 // define the class for phylum
 // define simple phylum - Program
@@ -61,6 +64,7 @@ public:
    virtual Feature copy_Feature() = 0;
    virtual void declare(Class_, ClassTable*) = 0;
    virtual void semant(Class_, ClassTable*, SymTab&) = 0;
+   virtual void key(TreeKey&) = 0;
 
 #ifdef Feature_EXTRAS
    Feature_EXTRAS
@@ -92,7 +96,9 @@ class Expression_class : public tree_node {
 public:
    tree_node *copy()		 { return copy_Expression(); }
    virtual Expression copy_Expression() = 0;
-   virtual Symbol typecheck(Class_, ClassTable*, SymTab&) = 0;
+   Symbol typecheck(Class_, ClassTable*, SymTab&);
+   virtual bool step(Typecheck&, TypecheckFrame&) = 0;
+   virtual void key(TreeKey&) = 0;
 
 #ifdef Expression_EXTRAS
    Expression_EXTRAS
@@ -108,7 +114,10 @@ public:
    tree_node *copy()		 { return copy_Case(); }
    virtual Case copy_Case() = 0;
    virtual Symbol getType() const = 0;
-   virtual Symbol typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) = 0;
+   // checks the type of the branch, and if it is a class, enters a scope
+   // with the branch's variable in it and returns the expression to check
+   virtual Expression typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) = 0;
+   virtual void key(TreeKey&) = 0;
 
 #ifdef Case_EXTRAS
    Case_EXTRAS
@@ -225,8 +234,8 @@ public:
   ) override;
 
   void declare(Class_, ClassTable*) override;
+  void key(TreeKey&) override;
   bool checkInheritanceTypes(method_class* b);
-  bool checkArgs(Class_, ClassTable*, SymTab&, Expressions);
   Formals getFormals() { return formals; }
   Symbol getRetType() { return return_type; }
   Symbol getName() { return name; }
@@ -261,6 +270,7 @@ public:
   ) override;
 
   void declare(Class_, ClassTable*) override;
+  void key(TreeKey&) override;
 
   Symbol getName() { return name; }
   Symbol getType() { return type_decl; }
@@ -314,7 +324,8 @@ public:
    }
    Case copy_Case();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) override;
+   Expression typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) override;
+   void key(TreeKey&) override;
    Symbol getType() const override { return type_decl; }
 
 #ifdef Case_SHARED_EXTRAS
@@ -338,7 +349,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -365,7 +377,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -387,10 +400,12 @@ public:
       expr = a1;
       name = a2;
       actual = a3;
+      owns_memory();
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -415,7 +430,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -438,7 +454,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -461,7 +478,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -482,7 +500,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -509,7 +528,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -532,7 +552,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -555,7 +576,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -578,7 +600,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -601,7 +624,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -622,7 +646,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -645,7 +670,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -668,7 +694,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -691,7 +718,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -712,7 +740,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -733,7 +762,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -754,7 +784,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -775,7 +806,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -796,7 +828,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -817,7 +850,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -836,7 +870,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -857,7 +892,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   Symbol typecheck(Class_, ClassTable*, SymTab&) override;
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -9,7 +9,7 @@
 #include "cool.h"
 #include "stringtab.h"
 #define yylineno curr_lineno;
-extern int yylineno;
+extern thread_local int yylineno;
 
 inline Boolean copy_Boolean(Boolean b) {return b; }
 inline void assert_Boolean(Boolean) {}
@@ -20,6 +20,10 @@ void dump_Symbol(ostream& stream, int padding, Symbol b);
 void assert_Symbol(Symbol b);
 Symbol copy_Symbol(Symbol b);
 
+class AstWriter;
+class TypedDump;
+struct TypedDumpFrame;
+class Hierarchy;
 class Program_class;
 typedef Program_class *Program;
 class Class__class;
@@ -46,60 +50,166 @@ typedef Cases_class *Cases;
 
 #define Program_EXTRAS                          \
 virtual void semant() = 0;			\
-virtual void dump_with_types(ostream&, int) = 0; 
+virtual void dump_with_types(ostream&, int) = 0; \
+virtual void dump_binary(AstWriter&) = 0; \
+virtual Classes get_classes() = 0; \
+Hierarchy *hierarchy = NULL;   /* of the classes, once semant has built it */
 
 
 
 #define program_EXTRAS                          \
 void semant();     				\
-void dump_with_types(ostream&, int);            
+void dump_with_types(ostream&, int); \
+void dump_binary(AstWriter&); \
+Classes get_classes() { return classes; }
 
 #define Class__EXTRAS                   \
+virtual Features get_features() = 0; \
 virtual Symbol get_filename() = 0;      \
-virtual void dump_with_types(ostream&,int) = 0; 
+virtual void dump_with_types(ostream&,int) = 0; \
+virtual void dump_binary(AstWriter&) = 0;
 
 
 #define class__EXTRAS                                 \
+Features get_features() { return features; } \
 Symbol get_filename() { return filename; }             \
-void dump_with_types(ostream&,int);                    
+void dump_with_types(ostream&,int); \
+void dump_binary(AstWriter&);
 
 
 #define Feature_EXTRAS                                        \
-virtual void dump_with_types(ostream&,int) = 0; 
+virtual bool is_method() = 0; \
+virtual void children(std::vector<Expression *>&) = 0; \
+virtual void dump_with_types(ostream&,int) = 0; \
+virtual void dump_binary(AstWriter&) = 0;
 
 
 #define Feature_SHARED_EXTRAS                                       \
-void dump_with_types(ostream&,int);    
+void dump_with_types(ostream&,int); \
+void dump_binary(AstWriter&);
+
+#define method_EXTRAS                        \
+bool is_method() override { return true; } \
+void children(std::vector<Expression *>& out) override { out.push_back(&expr); }
+
+
+#define attr_EXTRAS                          \
+bool is_method() override { return false; } \
+void children(std::vector<Expression *>& out) override { out.push_back(&init); }
 
 
 
 
 
 #define Formal_EXTRAS                              \
-virtual void dump_with_types(ostream&,int) = 0;
+virtual void dump_with_types(ostream&,int) = 0; \
+virtual void dump_binary(AstWriter&) = 0;
 
 
 #define formal_EXTRAS                           \
-void dump_with_types(ostream&,int);
+void dump_with_types(ostream&,int); \
+void dump_binary(AstWriter&);
 
 
+//
+// dump_with_types and typecheck walk the expression on a stack of their
+// own (see walk.h), so that they can handle trees of any depth; step is
+// the part of each node in one of those walks.  A branch is handled by
+// the walk of its case: dump_branch prints the branch up to its
+// expression, which it returns.
+//
 #define Case_EXTRAS                             \
-virtual void dump_with_types(ostream& ,int) = 0;
+virtual void children(std::vector<Expression *>&) = 0; \
+virtual Expression dump_branch(ostream&, int) = 0; \
+virtual void dump_binary(AstWriter&) = 0;
 
 
 #define branch_EXTRAS                                   \
-void dump_with_types(ostream& ,int);
+void children(std::vector<Expression *>& out) override { out.push_back(&expr); } \
+Expression dump_branch(ostream&, int); \
+void dump_binary(AstWriter&);
 
 
 #define Expression_EXTRAS                    \
 Symbol type;                                 \
 Symbol get_type() { return type; }           \
 Expression set_type(Symbol s) { type = s; return this; } \
-virtual void dump_with_types(ostream&,int) = 0;  \
+virtual void children(std::vector<Expression *>&) { } \
+virtual int resolve(Class_, const Hierarchy&) { return 0; } \
+void dump_with_types(ostream&,int);  \
+virtual bool step(TypedDump&, TypedDumpFrame&) = 0; \
+virtual void dump_binary(AstWriter&) = 0; \
 void dump_type(ostream&, int);               \
 Expression_class() { type = (Symbol) NULL; }
 
 #define Expression_SHARED_EXTRAS           \
-void dump_with_types(ostream&,int); 
+bool step(TypedDump&, TypedDumpFrame&) override; \
+void dump_binary(AstWriter&);
+
+//
+// children gives a pass the places of the subexpressions of a node, in
+// the order they are written, so that it can walk the tree without a
+// method of its own in every node, or put another tree in their place.
+//
+#define EXPRESSIONS_CHILDREN(list, out) \
+{ int n; Expression *e = list->elements(n); for (int i = 0; i < n; i++) out.push_back(e + i); }
+
+#define assign_EXTRAS \
+void children(std::vector<Expression *>& out) override { out.push_back(&expr); }
+
+#define static_dispatch_EXTRAS \
+void children(std::vector<Expression *>& out) override \
+  { out.push_back(&expr); EXPRESSIONS_CHILDREN(actual, out) }
+
+//
+// resolve gives a dispatch the classes whose methods it may reach, as
+// the class hierarchy analysis finds them (see hierarchy.h), and returns
+// how many there are: with one, the dispatch is monomorphic.  Since
+// targets holds memory of its own, a dispatch owns_memory (see tree.h).
+//
+#define dispatch_EXTRAS \
+std::vector<Symbol> targets; \
+int resolve(Class_, const Hierarchy&) override; \
+void children(std::vector<Expression *>& out) override \
+  { out.push_back(&expr); EXPRESSIONS_CHILDREN(actual, out) }
+
+#define cond_EXTRAS \
+void children(std::vector<Expression *>& out) override \
+  { out.push_back(&pred); out.push_back(&then_exp); out.push_back(&else_exp); }
+
+#define loop_EXTRAS \
+void children(std::vector<Expression *>& out) override \
+  { out.push_back(&pred); out.push_back(&body); }
+
+#define typcase_EXTRAS \
+void children(std::vector<Expression *>& out) override \
+  { out.push_back(&expr); \
+    for (int i = cases->first(); cases->more(i); i = cases->next(i)) \
+      cases->nth(i)->children(out); }
+
+#define block_EXTRAS \
+void children(std::vector<Expression *>& out) override \
+  EXPRESSIONS_CHILDREN(body, out)
+
+#define let_EXTRAS \
+void children(std::vector<Expression *>& out) override \
+  { out.push_back(&init); out.push_back(&body); }
+
+#define BINARY_CHILDREN \
+void children(std::vector<Expression *>& out) override \
+  { out.push_back(&e1); out.push_back(&e2); }
+#define UNARY_CHILDREN \
+void children(std::vector<Expression *>& out) override { out.push_back(&e1); }
+
+#define plus_EXTRAS BINARY_CHILDREN
+#define sub_EXTRAS BINARY_CHILDREN
+#define mul_EXTRAS BINARY_CHILDREN
+#define divide_EXTRAS BINARY_CHILDREN
+#define lt_EXTRAS BINARY_CHILDREN
+#define eq_EXTRAS BINARY_CHILDREN
+#define leq_EXTRAS BINARY_CHILDREN
+#define neg_EXTRAS UNARY_CHILDREN
+#define comp_EXTRAS UNARY_CHILDREN
+#define isvoid_EXTRAS UNARY_CHILDREN
 
 #endif
@@ -31,6 +31,10 @@ extern int cool_yydebug;        // for the parser
 
        int cgen_optimize;       // optimize switch for code generator 
        char *out_filename;      // file name for generated code
+       int ast_binary;          // write tokens or the AST in binary form
+       int fast_lex;            // use the hand-written scanner (cool-scan.h)
+       int jobs;                // threads to use, if more than one
+       char *semant_cache;      // file of the classes semant has checked
        Memmgr cgen_Memmgr = GC_NOGC;      // enable/disable garbage collection
        Memmgr_Test cgen_Memmgr_Test = GC_NORMAL;  // normal/test GC
        Memmgr_Debug cgen_Memmgr_Debug = GC_QUICK; // check heap frequently
@@ -51,9 +55,13 @@ void handle_flags(int argc, char *argv[]) {
   cgen_debug = 0;
   cgen_optimize = 0;
   disable_reg_alloc = 0;
+  ast_binary = 0;
+  fast_lex = 0;
+  jobs = 1;
+  semant_cache = NULL;
   
 
-  while ((c = getopt(argc, argv, "lpscvrOo:gtT")) != -1) {
+  while ((c = getopt(argc, argv, "lpscvrOo:gtTbfj:C:")) != -1) {
     switch (c) {
 #ifdef DEBUG
     case 'l':
@@ -99,6 +107,20 @@ void handle_flags(int argc, char *argv[]) {
     case 'O':  // enable optimization
       cgen_optimize = 1;
       break;
+    case 'b':  // pass tokens or the AST to the next phase in binary form
+      ast_binary = 1;
+      break;
+    case 'f':  // scan with the hand-written scanner rather than flex's
+      fast_lex = 1;
+      break;
+    case 'j':  // do independent work on this many threads at once
+      jobs = atoi(optarg);
+      if (jobs < 1)
+        unknownopt = 1;
+      break;
+    case 'C':  // keep what semant learns of each class in this file
+      semant_cache = optarg;
+      break;
     case '?':
       unknownopt = 1;
       break;
@@ -111,9 +133,9 @@ void handle_flags(int argc, char *argv[]) {
   if (unknownopt) {
       cerr << "usage: " << argv[0] << 
 #ifdef DEBUG
-	  " [-lvpscOgtTr -o outname] [input-files]\n";
+	  " [-lvpscOgtTrbf -o outname -j jobs -C cache] [input-files]\n";
 #else
-      " [-OgtT -o outname] [input-files]\n";
+      " [-OgtTbf -o outname -j jobs -C cache] [input-files]\n";
 #endif
       exit(1);
   }
@@ -0,0 +1,476 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  hierarchy.cc
+//
+//  Builds the class hierarchy from the classes of a program, and writes
+//  and reads it (see hierarchy.h).
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <limits.h>
+#include <algorithm>
+#include "hierarchy.h"
+
+//
+// The basic classes are the same trees for every phase of a process, so
+// that the members semant finds in them are the ones cgen lays out.
+//
+Classes basic_classes()
+{
+  static Classes basic = NULL;
+  if (basic != NULL)
+    return basic;
+
+  Symbol arg = idtable.add_string("arg"),
+         arg2 = idtable.add_string("arg2"),
+         Bool = idtable.add_string("Bool"),
+         Int = idtable.add_string("Int"),
+         IO = idtable.add_string("IO"),
+         No_class = idtable.add_string("_no_class"),
+         Object = idtable.add_string("Object"),
+         prim_slot = idtable.add_string("_prim_slot"),
+         SELF_TYPE = idtable.add_string("SELF_TYPE"),
+         Str = idtable.add_string("String"),
+         val = idtable.add_string("_val");
+  Symbol filename = stringtable.add_string("<basic class>");
+
+  //
+  // Object has no parent.  Its methods are
+  //        abort() : Object        aborts the program
+  //        type_name() : Str       returns the name of the class
+  //        copy() : SELF_TYPE      returns a copy of the object
+  //
+  Class_ Object_class =
+    class_(Object, No_class,
+	   append_Features(
+	     append_Features(
+	       single_Features(method(idtable.add_string("abort"), nil_Formals(),
+				      Object, no_expr())),
+	       single_Features(method(idtable.add_string("type_name"), nil_Formals(),
+				      Str, no_expr()))),
+	     single_Features(method(idtable.add_string("copy"), nil_Formals(),
+				    SELF_TYPE, no_expr()))),
+	   filename);
+
+  //
+  // IO's methods are
+  //        out_string(Str) : SELF_TYPE   writes a string to the output
+  //        out_int(Int) : SELF_TYPE        "    an int    "  "     "
+  //        in_string() : Str             reads a string from the input
+  //        in_int() : Int                  "   an int     "  "     "
+  //
+  Class_ IO_class =
+    class_(IO, Object,
+	   append_Features(
+	     append_Features(
+	       append_Features(
+		 single_Features(method(idtable.add_string("out_string"),
+					single_Formals(formal(arg, Str)),
+					SELF_TYPE, no_expr())),
+		 single_Features(method(idtable.add_string("out_int"),
+					single_Formals(formal(arg, Int)),
+					SELF_TYPE, no_expr()))),
+	       single_Features(method(idtable.add_string("in_string"), nil_Formals(),
+				      Str, no_expr()))),
+	     single_Features(method(idtable.add_string("in_int"), nil_Formals(),
+				    Int, no_expr()))),
+	   filename);
+
+  //
+  // Int and Bool have no methods, and only the slot "val" for the value.
+  //
+  Class_ Int_class =
+    class_(Int, Object, single_Features(attr(val, prim_slot, no_expr())),
+	   filename);
+  Class_ Bool_class =
+    class_(Bool, Object, single_Features(attr(val, prim_slot, no_expr())),
+	   filename);
+
+  //
+  // String has the slots
+  //        val                           the length of the string
+  //        str_field                     the string itself
+  // and the methods
+  //        length() : Int                returns the length of the string
+  //        concat(arg: Str) : Str        concatenates two strings
+  //        substr(arg: Int, arg2: Int) : Str   selects a substring
+  //
+  Class_ Str_class =
+    class_(Str, Object,
+	   append_Features(
+	     append_Features(
+	       append_Features(
+		 append_Features(
+		   single_Features(attr(val, Int, no_expr())),
+		   single_Features(attr(idtable.add_string("_str_field"), prim_slot,
+					no_expr()))),
+		 single_Features(method(idtable.add_string("length"), nil_Formals(),
+					Int, no_expr()))),
+	       single_Features(method(idtable.add_string("concat"),
+				      single_Formals(formal(arg, Str)),
+				      Str, no_expr()))),
+	     single_Features(method(idtable.add_string("substr"),
+				    append_Formals(single_Formals(formal(arg, Int)),
+						   single_Formals(formal(arg2, Int))),
+				    Str, no_expr()))),
+	   filename);
+
+  basic = append_Classes(
+	    append_Classes(
+	      append_Classes(
+		append_Classes(single_Classes(Object_class), single_Classes(IO_class)),
+		single_Classes(Int_class)),
+	      single_Classes(Bool_class)),
+	    single_Classes(Str_class));
+  return basic;
+}
+
+//
+// add gives c the next number, under the class numbered parent (Object
+// is its own parent); number then finds the descendants and the
+// ancestors of each class, once all are added.
+//
+void Hierarchy::add(Class_ c, int parent)
+{
+  int i = classes_.size();
+  index_[c->getName()] = i;
+  classes_.push_back(c);
+  up_[0].push_back(parent);
+  depth_.push_back(i == 0 ? 0 : depth_[parent] + 1);
+  last_.push_back(i);
+}
+
+void Hierarchy::number()
+{
+  for (int i = size() - 1; i > 0; i--)
+    last_[parent(i)] = std::max(last_[parent(i)], last_[i]);
+
+  for (size_t k = 1; (1u << k) < classes_.size(); k++) {
+    std::vector<int> next(classes_.size());
+    for (size_t i = 0; i < classes_.size(); i++)
+      next[i] = up_[k - 1][up_[k - 1][i]];
+    up_.push_back(std::move(next));
+  }
+}
+
+// the number of a member name, numbering it if it is new
+int Hierarchy::memberNumber(Symbol s)
+{
+  auto it = memberName_.find(s);
+  if (it != memberName_.end())
+    return it->second;
+  methodSlots_.emplace_back();
+  attrSlots_.emplace_back();
+  methodDefs_.emplace_back();
+  return memberName_[s] = methodSlots_.size() - 1;
+}
+
+int Hierarchy::findSlot(const SlotLists& slots, int clazz, Symbol name) const
+{
+  auto n = memberName_.find(name);
+  if (n == memberName_.end())
+    return -1;
+
+  // the subtrees of the classes listed do not overlap, and they are in
+  // preorder, so only the last one starting at or before clazz can hold it
+  const std::vector<std::pair<int, int>>& list = slots[n->second];
+  auto it = std::upper_bound(list.begin(), list.end(), std::make_pair(clazz, INT_MAX));
+  if (it == list.begin())
+    return -1;
+  --it;
+  return inherits(it->first, clazz) ? it->second : -1;
+}
+
+Hierarchy::Hierarchy(Classes classes)
+{
+  Classes lists[2] = { basic_classes(), classes };
+  DenseSymbolMap<std::vector<Class_>> children;
+  for (Classes list : lists)
+    for (int i = list->first(); list->more(i); i = list->next(i))
+      children[list->nth(i)->getParent()].push_back(list->nth(i));
+
+  // Number the classes in preorder from Object: the stack holds each
+  // class still to be numbered, with the number of its parent.
+  up_.resize(1);
+  std::vector<std::pair<Class_, int>> stack;
+  stack.push_back(std::make_pair(lists[0]->nth(lists[0]->first()), 0));
+  while (!stack.empty()) {
+    std::pair<Class_, int> top = stack.back();
+    stack.pop_back();
+    int i = classes_.size();
+    add(top.first, top.second);
+
+    auto it = children.find(top.first->getName());
+    if (it != children.end())
+      for (auto c = it->second.rbegin(); c != it->second.rend(); ++c)
+	stack.push_back(std::make_pair(*c, i));
+  }
+  number();
+
+  // classes_ is in preorder, so every class comes after its parent
+  methods_.resize(size());
+  attrs_.resize(size());
+  for (int i = 0; i < size(); i++) {
+    if (i > 0) {
+      methods_[i] = methods_[parent(i)];
+      attrs_[i] = attrs_[parent(i)];
+    }
+
+    Features features = classes_[i]->get_features();
+    for (int j = features->first(), place = 0; features->more(j);
+	 j = features->next(j), place++) {
+      Feature f = features->nth(j);
+      if (f->is_method()) {
+	method_class *m = (method_class *) f;
+	int slot = methodSlot(i, m->getName());
+	if (slot < 0) {
+	  slot = methods_[i].size();
+	  methods_[i].emplace_back();
+	  methodSlots_[memberNumber(m->getName())].push_back(std::make_pair(i, slot));
+	}
+	if (methods_[i][slot].clazz != i || methods_[i][slot].method == NULL)
+	  methodDefs_[memberNumber(m->getName())].push_back(i);
+	methods_[i][slot] = Method{i, place, m};
+      } else {
+	attr_class *a = (attr_class *) f;
+	int slot = attrSlot(i, a->getName());
+	if (slot < 0) {
+	  slot = attrs_[i].size();
+	  attrs_[i].emplace_back();
+	  attrSlots_[memberNumber(a->getName())].push_back(std::make_pair(i, slot));
+	}
+	attrs_[i][slot] = Attr{i, place, a};
+      }
+    }
+  }
+}
+
+int Hierarchy::id(Symbol name) const
+{
+  auto it = index_.find(name);
+  return it == index_.end() ? -1 : it->second;
+}
+
+int Hierarchy::lca(int a, int b) const
+{
+  if (inherits(a, b)) return a;
+  if (inherits(b, a)) return b;
+
+  if (depth_[a] < depth_[b]) std::swap(a, b);
+  for (int k = up_.size() - 1; k >= 0; k--)
+    if (depth_[a] - (1 << k) >= depth_[b])
+      a = up_[k][a];
+  for (int k = up_.size() - 1; k >= 0; k--)
+    if (up_[k][a] != up_[k][b]) {
+      a = up_[k][a];
+      b = up_[k][b];
+    }
+  return parent(a);
+}
+
+method_class *Hierarchy::method(int clazz, Symbol name) const
+{
+  int slot = methodSlot(clazz, name);
+  return slot < 0 ? NULL : methods_[clazz][slot].method;
+}
+
+attr_class *Hierarchy::attr(int clazz, Symbol name) const
+{
+  int slot = attrSlot(clazz, name);
+  return slot < 0 ? NULL : attrs_[clazz][slot].attr;
+}
+
+std::vector<Hierarchy::Method> Hierarchy::targets(int clazz, Symbol name) const
+{
+  std::vector<Method> out;
+  int slot = methodSlot(clazz, name);
+  if (slot < 0)
+    return out;
+
+  // a class below that defines a method of the name overrides this one
+  out.push_back(methods_[clazz][slot]);
+  const std::vector<int>& defs = methodDefs_[memberName_.find(name)->second];
+  for (auto it = std::upper_bound(defs.begin(), defs.end(), clazz);
+       it != defs.end() && *it <= last_[clazz]; ++it)
+    out.push_back(methods_[*it][slot]);
+  return out;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  Class hierarchy analysis
+//
+//////////////////////////////////////////////////////////////////////////
+
+int dispatch_class::resolve(Class_ clazz, const Hierarchy& hierarchy)
+{
+  static Symbol SELF_TYPE = idtable.add_string("SELF_TYPE");
+  Symbol type = expr->get_type();
+  int receiver = hierarchy.id(type == SELF_TYPE ? clazz->getName() : type);
+  targets.clear();
+  if (receiver >= 0)
+    for (const Hierarchy::Method& m : hierarchy.targets(receiver, name))
+      targets.push_back(hierarchy.name(m.clazz));
+  return targets.size();
+}
+
+int resolve_dispatches(Classes classes, const Hierarchy& hierarchy, int *monomorphic)
+{
+  int sites = 0;
+  *monomorphic = 0;
+  std::vector<Expression *> work;
+  for (int i = classes->first(); classes->more(i); i = classes->next(i)) {
+    Class_ c = classes->nth(i);
+    Features features = c->get_features();
+    for (int j = features->first(); features->more(j); j = features->next(j))
+      features->nth(j)->children(work);
+
+    while (!work.empty()) {
+      Expression e = *work.back();
+      work.pop_back();
+      int targets = e->resolve(c, hierarchy);
+      if (targets > 0) {
+	sites++;
+	if (targets == 1)
+	  (*monomorphic)++;
+      }
+      e->children(work);
+    }
+  }
+  return sites;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  Writing and reading
+//
+//////////////////////////////////////////////////////////////////////////
+
+static void put_word(std::string& out, unsigned n)
+{
+  char b[4] = { (char) n, (char) (n >> 8), (char) (n >> 16), (char) (n >> 24) };
+  out.append(b, 4);
+}
+
+static void malformed(const char *msg)
+{
+  cerr << "Malformed class hierarchy: " << msg << endl;
+  exit(1);
+}
+
+static unsigned get_word(const char *&p, const char *lim)
+{
+  if (lim - p < 4)
+    malformed("unexpected end of input");
+  const unsigned char *b = (const unsigned char *) p;
+  p += 4;
+  return b[0] | (b[1] << 8) | (b[2] << 16) | ((unsigned) b[3] << 24);
+}
+
+void Hierarchy::write(std::string& out) const
+{
+  put_word(out, size());
+  for (int i = 0; i < size(); i++) {
+    Symbol s = name(i);
+    put_word(out, s->get_len());
+    out.append(s->get_string(), s->get_len());
+    put_word(out, parent(i));
+    put_word(out, methods_[i].size());
+    for (const Method& m : methods_[i]) {
+      put_word(out, m.clazz);
+      put_word(out, m.place);
+    }
+    put_word(out, attrs_[i].size());
+    for (const Attr& a : attrs_[i]) {
+      put_word(out, a.clazz);
+      put_word(out, a.place);
+    }
+  }
+}
+
+//
+// The feature at a place among the features of a class already numbered,
+// which must be a method (or, if method is false, an attribute).
+//
+static Feature feature(const std::vector<Class_>& classes, unsigned clazz,
+		       unsigned place, bool method)
+{
+  if (clazz >= classes.size())
+    malformed("class number out of range");
+  Features features = classes[clazz]->get_features();
+  if (place >= (unsigned) features->len())
+    malformed("feature out of range");
+  Feature f = features->nth(features->first() + place);
+  if (f->is_method() != method)
+    malformed(method ? "expected a method" : "expected an attribute");
+  return f;
+}
+
+Hierarchy *Hierarchy::read(const std::string& bytes, Classes classes)
+{
+  DenseSymbolMap<Class_> named;
+  Classes lists[2] = { basic_classes(), classes };
+  for (Classes list : lists)
+    for (int i = list->first(); list->more(i); i = list->next(i))
+      named[list->nth(i)->getName()] = list->nth(i);
+
+  Hierarchy *h = new Hierarchy();
+  h->up_.resize(1);
+  const char *p = bytes.data(), *lim = p + bytes.size();
+  unsigned n = get_word(p, lim);
+  if (n != named.size())
+    malformed("not the classes of the program");
+
+  for (unsigned i = 0; i < n; i++) {
+    unsigned len = get_word(p, lim);
+    if ((size_t) (lim - p) < len)
+      malformed("unexpected end of input");
+    auto c = named.find(idtable.add_string((char *) p, len));
+    p += len;
+    unsigned parent = get_word(p, lim);
+    if (c == named.end() || h->id(c->first) >= 0)
+      malformed("not the classes of the program");
+    if (i == 0 ? parent != 0 : parent >= i || c->second->getParent() != h->name(parent))
+      malformed("a class out of order");
+    h->add(c->second, parent);
+
+    h->methods_.emplace_back();
+    for (unsigned j = 0, count = get_word(p, lim); j < count; j++) {
+      unsigned clazz = get_word(p, lim), place = get_word(p, lim);
+      Feature f = feature(h->classes_, clazz, place, true);
+      h->methods_[i].push_back(Method{(int) clazz, (int) place, (method_class *) f});
+    }
+
+    h->attrs_.emplace_back();
+    for (unsigned j = 0, count = get_word(p, lim); j < count; j++) {
+      unsigned clazz = get_word(p, lim), place = get_word(p, lim);
+      Feature f = feature(h->classes_, clazz, place, false);
+      h->attrs_[i].push_back(Attr{(int) clazz, (int) place, (attr_class *) f});
+    }
+  }
+  if (p != lim)
+    malformed("trailing bytes");
+  h->number();
+
+  // a class introduces the slots past the end of its parent's tables
+  for (int i = 0; i < h->size(); i++) {
+    size_t from = i == 0 ? 0 : h->methods_[h->parent(i)].size();
+    for (size_t s = from; s < h->methods_[i].size(); s++)
+      h->methodSlots_[h->memberNumber(h->methods_[i][s].method->getName())]
+	.push_back(std::make_pair(i, (int) s));
+    for (const Method& m : h->methods_[i])
+      if (m.clazz == i)
+	h->methodDefs_[h->memberNumber(m.method->getName())].push_back(i);
+    from = i == 0 ? 0 : h->attrs_[h->parent(i)].size();
+    for (size_t s = from; s < h->attrs_[i].size(); s++)
+      h->attrSlots_[h->memberNumber(h->attrs_[i][s].attr->getName())]
+	.push_back(std::make_pair(i, (int) s));
+  }
+  return h;
+}
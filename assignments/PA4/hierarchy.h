@@ -0,0 +1,129 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+#ifndef _HIERARCHY_H_
+#define _HIERARCHY_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  hierarchy.h
+//
+//  The class hierarchy of a program, numbered and laid out once, by
+//  semant, for semant and cgen both.
+//
+//  Classes are numbered in preorder from Object, the children of a class
+//  in the order they are given (the basic classes first), so the
+//  descendants of class i are i..last(i): these numbers are the class
+//  tags cgen emits, and a case branch matches a range of them.  Each
+//  class has a dispatch table and an attribute layout, those of its
+//  parent followed by the members it introduces, in the order it
+//  declares them; a member it redefines keeps its parent's slot.
+//
+//  Since a class's descendants are numbered together, the methods a
+//  dispatch may reach are found without walking them: they are the
+//  method of the receiver's class and those defined in its range.
+//
+//  When the phases run separately, semant writes the hierarchy after the
+//  typed tree (see ast-binary.h), and cgen reads it instead of building
+//  its own.  The section is a sequence of 32-bit little-endian integers:
+//  the number of classes, and for each, in order, the length and
+//  characters of its name, the number of its parent, and the sizes of
+//  its dispatch table and attribute layout, each entry as the number of
+//  the class that declares the member and the member's place among that
+//  class's features.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "cool-tree.h"
+#include "symbolmap.h"
+
+// Object, IO, Int, Bool and String, built the first time they are asked for
+Classes basic_classes();
+
+class Hierarchy {
+public:
+  // a member, with the class that declares it and its place among the
+  // features of that class
+  struct Method {
+    int clazz, place;
+    method_class *method;
+  };
+  struct Attr {
+    int clazz, place;
+    attr_class *attr;
+  };
+
+private:
+  DenseSymbolMap<int> index_;
+  std::vector<Class_> classes_;
+  std::vector<int> last_, depth_;
+  std::vector<std::vector<int>> up_;     // up_[k][i]: the 2^k-th ancestor
+
+  // Member names are numbered densely by memberName_; for each number,
+  // methodSlots_ and attrSlots_ list the classes that introduce a member
+  // of that name, in preorder, with its slot.
+  typedef std::vector<std::vector<std::pair<int, int>>> SlotLists;
+  DenseSymbolMap<int> memberName_;
+  SlotLists methodSlots_, attrSlots_;
+  // for each member number, the classes that define a method of the name
+  std::vector<std::vector<int>> methodDefs_;
+  std::vector<std::vector<Method>> methods_;
+  std::vector<std::vector<Attr>> attrs_;
+
+  Hierarchy() { }
+  void add(Class_ c, int parent);
+  void number();
+  int memberNumber(Symbol s);
+  int findSlot(const SlotLists& slots, int clazz, Symbol name) const;
+
+public:
+  // classes must hold every class but the basic ones, and they must form
+  // a tree under Object
+  Hierarchy(Classes classes);
+
+  // the hierarchy write wrote, of the same classes; if it is not well
+  // formed, read says so and exits
+  static Hierarchy *read(const std::string& bytes, Classes classes);
+  void write(std::string& out) const;
+
+  int size() const                   { return classes_.size(); }
+  int id(Symbol name) const;         // -1 if there is no such class
+  Symbol name(int clazz) const       { return classes_[clazz]->getName(); }
+  Class_ get(int clazz) const        { return classes_[clazz]; }
+  int parent(int clazz) const        { return up_[0][clazz]; }
+  int last(int clazz) const          { return last_[clazz]; }
+  int depth(int clazz) const         { return depth_[clazz]; }
+
+  bool inherits(int ancestor, int clazz) const
+    { return ancestor <= clazz && clazz <= last_[ancestor]; }
+  int lca(int a, int b) const;
+
+  const std::vector<Method>& methods(int clazz) const { return methods_[clazz]; }
+  const std::vector<Attr>& attrs(int clazz) const   { return attrs_[clazz]; }
+
+  // the slot of a member of a class, or -1 if it has none of that name
+  int methodSlot(int clazz, Symbol name) const
+    { return findSlot(methodSlots_, clazz, name); }
+  int attrSlot(int clazz, Symbol name) const
+    { return findSlot(attrSlots_, clazz, name); }
+  method_class *method(int clazz, Symbol name) const;
+  attr_class *attr(int clazz, Symbol name) const;
+
+  // the methods a dispatch of a name to an object of a class may reach:
+  // that of the class, then each that overrides it below, in order; none
+  // if the class has no method of that name
+  std::vector<Method> targets(int clazz, Symbol name) const;
+};
+
+// Class hierarchy analysis: resolves each dispatch in the classes (see
+// dispatch_class::resolve), and returns how many there are, with how many
+// of them can reach only one method in *monomorphic.
+int resolve_dispatches(Classes classes, const Hierarchy& hierarchy, int *monomorphic);
+
+#endif
@@ -3,18 +3,83 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <sstream>
 #include <stack>
+#include <string_view>
+#include <thread>
 #include <vector>
 #include <utility>
 #include <unordered_map>
 #include <unordered_set>
 #include "semant.h"
 #include <cassert>
+#include "ast-binary.h"
 #include "utilities.h"
+#include "walk.h"
 
 
 extern int semant_debug;
-extern char *curr_filename;
+extern int jobs;
+extern char *semant_cache;
+extern thread_local char *curr_filename;
+
+// While a class is checked on a worker thread, the errors found in it are
+// kept here, to be printed in the order of the classes once all are done.
+static thread_local std::ostringstream *class_errors;
+
+// the number of errors found by this thread
+static thread_local int thread_errors;
+
+// While a class is checked for the semant cache, the names of the classes
+// looked up are added here.
+static thread_local std::unordered_set<Symbol> *class_deps;
+
+// With -s, what checking a class (or the rest of semant) took, for the
+// report semant prints as JSON on stderr.
+struct SemantProfile {
+  double ms = 0;                                  // wall time
+  std::vector<std::pair<Symbol, double>> methods; // wall time of each
+  std::unordered_map<const char*, long> typechecks;  // per node kind
+  long lookups = 0;          // in the symbol table
+  int maxDepth = 0;          // of its scopes, at a lookup
+  long inherits = 0, lcas = 0;
+  long walks = 0;            // hierarchy walks, and their steps
+  long walkSteps = 0;
+  long maxWalk = 0;
+};
+
+static thread_local SemantProfile *class_profile;
+
+typedef std::chrono::steady_clock::time_point Instant;
+
+static double ms_since(Instant start) {
+  return std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+static void profile_typecheck(const char* kind) {
+  if (class_profile) class_profile->typechecks[kind]++;
+}
+
+static void profile_lookup(const SymTab& symtab) {
+  if (!class_profile) return;
+  class_profile->lookups++;
+  class_profile->maxDepth = std::max(class_profile->maxDepth, symtab.depth());
+}
+
+static void profile_walk(long steps) {
+  if (!class_profile) return;
+  class_profile->walks++;
+  class_profile->walkSteps += steps;
+  class_profile->maxWalk = std::max(class_profile->maxWalk, steps);
+}
 
 //////////////////////////////////////////////////////////////////////
 //
@@ -94,7 +159,8 @@ ClassTable::ClassTable(Classes classes)
   error_stream(cerr),
   parents_{},
   methods_{},
-  attrs_{}
+  attrs_{},
+  hierarchy_(nullptr)
 {
   install_basic_classes();
 
@@ -127,109 +193,12 @@ ClassTable::ClassTable(Classes classes)
   }
 }
 
+// The basic classes are those cgen lays out (see hierarchy.h), so that the
+// members semant finds in them are the same trees.
 void ClassTable::install_basic_classes() {
-
-    // The tree package uses these globals to annotate the classes built below.
-   // curr_lineno  = 0;
-    Symbol filename = stringtable.add_string("<basic class>");
-    
-    // The following demonstrates how to create dummy parse trees to
-    // refer to basic Cool classes.  There's no need for method
-    // bodies -- these are already built into the runtime system.
-    
-    // IMPORTANT: The results of the following expressions are
-    // stored in local variables.  You will want to do something
-    // with those variables at the end of this method to make this
-    // code meaningful.
-
-    // 
-    // The Object class has no parent class. Its methods are
-    //        abort() : Object    aborts the program
-    //        type_name() : Str   returns a string representation of class name
-    //        copy() : SELF_TYPE  returns a copy of the object
-    //
-    // There is no need for method bodies in the basic classes---these
-    // are already built in to the runtime system.
-
-    Class_ Object_class =
-	class_(Object, 
-	       No_class,
-	       append_Features(
-			       append_Features(
-					       single_Features(method(cool_abort, nil_Formals(), Object, no_expr())),
-					       single_Features(method(type_name, nil_Formals(), Str, no_expr()))),
-			       single_Features(method(copy, nil_Formals(), SELF_TYPE, no_expr()))),
-	       filename);
-
-    // 
-    // The IO class inherits from Object. Its methods are
-    //        out_string(Str) : SELF_TYPE       writes a string to the output
-    //        out_int(Int) : SELF_TYPE            "    an int    "  "     "
-    //        in_string() : Str                 reads a string from the input
-    //        in_int() : Int                      "   an int     "  "     "
-    //
-    Class_ IO_class = 
-	class_(IO, 
-	       Object,
-	       append_Features(
-			       append_Features(
-					       append_Features(
-							       single_Features(method(out_string, single_Formals(formal(arg, Str)),
-										      SELF_TYPE, no_expr())),
-							       single_Features(method(out_int, single_Formals(formal(arg, Int)),
-										      SELF_TYPE, no_expr()))),
-					       single_Features(method(in_string, nil_Formals(), Str, no_expr()))),
-			       single_Features(method(in_int, nil_Formals(), Int, no_expr()))),
-	       filename);  
-
-    //
-    // The Int class has no methods and only a single attribute, the
-    // "val" for the integer. 
-    //
-    Class_ Int_class =
-	class_(Int, 
-	       Object,
-	       single_Features(attr(val, prim_slot, no_expr())),
-	       filename);
-
-    //
-    // Bool also has only the "val" slot.
-    //
-    Class_ Bool_class =
-	class_(Bool, Object, single_Features(attr(val, prim_slot, no_expr())),filename);
-
-    //
-    // The class Str has a number of slots and operations:
-    //       val                                  the length of the string
-    //       str_field                            the string itself
-    //       length() : Int                       returns length of the string
-    //       concat(arg: Str) : Str               performs string concatenation
-    //       substr(arg: Int, arg2: Int): Str     substring selection
-    //       
-    Class_ Str_class =
-	class_(Str, 
-	       Object,
-	       append_Features(
-			       append_Features(
-					       append_Features(
-							       append_Features(
-									       single_Features(attr(val, Int, no_expr())),
-									       single_Features(attr(str_field, prim_slot, no_expr()))),
-							       single_Features(method(length, nil_Formals(), Int, no_expr()))),
-					       single_Features(method(concat, 
-								      single_Formals(formal(arg, Str)),
-								      Str, 
-								      no_expr()))),
-			       single_Features(method(substr, 
-						      append_Formals(single_Formals(formal(arg, Int)), 
-								     single_Formals(formal(arg2, Int))),
-						      Str, 
-						      no_expr()))),
-	       filename);
-
-  auto classes = {Object_class, Int_class, IO_class, Bool_class, Str_class};
-  for (auto& val : classes) {
-    //addClass(val->getName(), val);
+  Classes basic = basic_classes();
+  for (int i = basic->first(); basic->more(i); i = basic->next(i)) {
+    auto val = basic->nth(i);
     addInheritance(val->getParent(), val->getName());
     val->declareFeatures(this);
   }
@@ -237,15 +206,28 @@ void ClassTable::install_basic_classes() {
 
 // TODO: finish it
 bool ClassTable::inherits(Class_ curr, Symbol parent, Symbol child) const {
+  if (class_profile) class_profile->inherits++;
   if (child == No_type) return true;
   if (child == parent) return true; // probably BUG
   if (parent == SELF_TYPE && child != SELF_TYPE) return false;
   if (parent != SELF_TYPE && child == SELF_TYPE) return inherits(curr, parent, curr->getName());
 
+  depend(parent);
+  depend(child);
+
+  int p = classId(parent), c = classId(child);
+  if (p >= 0 && c >= 0) return hierarchy_->inherits(p, c);
+
+  long steps = 0;
   for (auto it = parents_.find(child), end = parents_.end(); it != end; it = parents_.find(it->second)) {
-    if (it->second == parent) return true;
+    steps++;
+    if (it->second == parent) {
+      profile_walk(steps);
+      return true;
+    }
   }
 
+  profile_walk(steps);
   return false;
 }
 
@@ -255,29 +237,108 @@ void ClassTable::addInheritance(Symbol parent, Symbol child) {
   parents_[child] = parent;
 }
 
+// A 64-bit hash, taking eight bytes at a time, for the signatures of
+// classes and the semant cache.
+static uint64_t hash_bytes(const char* s, size_t len, uint64_t h = 14695981039346656037ULL) {
+  const uint64_t k = 0x9e3779b97f4a7c15ULL;
+  uint64_t word;
+  for (; len >= 8; s += 8, len -= 8) {
+    memcpy(&word, s, 8);
+    h = (h ^ word) * k;
+    h ^= h >> 29;
+  }
+  word = 0;
+  memcpy(&word, s, len);   // the rest, with its length in the top byte
+  word ^= (uint64_t) len << 56;
+  h = (h ^ word) * k;
+  return h ^ (h >> 32);
+}
+
+static uint64_t hash_symbol(Symbol s) {
+  return hash_bytes(s->get_string(), s->get_len());
+}
+
+static uint64_t mix(uint64_t h, uint64_t x) {
+  return hash_bytes((const char*) &x, sizeof x, h);
+}
+
+// Numbers and lays out the classes once the hierarchy is known to be a
+// tree rooted at Object, so that inherits, lca and the lookups of members
+// need not walk it, and checks the signatures of overriding methods.
+void ClassTable::buildHierarchy(Classes classes) {
+  hierarchy_ = new Hierarchy(classes);
+  signature_.resize(hierarchy_->size());
+
+  // classes are numbered in preorder, so every class comes after its parent
+  for (int i = 0; i < hierarchy_->size(); i++) {
+    // the signature does not depend on the order of the members
+    uint64_t members = 0;
+
+    // the members the class declares, as laid out; of two of the same
+    // name, the last declared is the one laid out, and checked
+    for (const auto& item : hierarchy_->methods(i)) {
+      if (item.clazz != i) continue;
+      auto method = item.method;
+      auto inherited = i == 0 ? nullptr : hierarchy_->method(hierarchy_->parent(i), method->getName());
+      if (!method->checkInheritanceTypes(inherited)) badOverrides_.insert(method);
+
+      auto formals = method->getFormals();
+      auto hash = mix(hash_symbol(method->getName()), 1);
+      for (int j = formals->first(); formals->more(j); j = formals->next(j)) {
+        hash = mix(hash, hash_symbol(formals->nth(j)->getType()));
+      }
+      members += mix(hash, hash_symbol(method->getRetType()));
+    }
+
+    for (const auto& item : hierarchy_->attrs(i)) {
+      if (item.clazz != i) continue;
+      members += mix(mix(hash_symbol(item.attr->getName()), 2), hash_symbol(item.attr->getType()));
+    }
+
+    auto parent = i == 0 ? 0 : signature_[hierarchy_->parent(i)];
+    signature_[i] = mix(mix(hash_symbol(hierarchy_->name(i)), parent), members);
+  }
+}
+
 bool ClassTable::hasClass(Symbol name) const {
+  depend(name);
   return parents_.find(name) != parents_.end();
 }
 
+void ClassTable::depend(Symbol name) const {
+  if (class_deps != NULL) class_deps->insert(name);
+}
+
+// the signature of a class, or 0 if there is no such class
+uint64_t ClassTable::signature(Symbol name) const {
+  int c = classId(name);
+  return c < 0 ? 0 : signature_[c];
+}
+
+static Symbol attrType(attr_class* attr) {
+  return attr == nullptr ? nullptr : attr->getType();
+}
+
 Symbol getObjectType(Symbol name, Class_ clazz, ClassTable* table, SymTab& attrs) {
+  profile_lookup(attrs);
   if (auto val = attrs.lookup(name)) return *val;
-  if (auto val = table->getAttr(clazz->getName(), name)) return val;
-  if (auto val = table->getInheritedAttr(clazz->getName(), name)) return val;
-  return nullptr;
+  return table->findAttr(clazz->getName(), name);
 }
 
 method_class* ClassTable::getMethod(Symbol className, Symbol methodName) {
   assert(hasClass(className));
+  depend(className);
 
-  auto& methods = methods_[className];
-  auto it = methods.find(methodName);
-  if (it == methods.end()) return nullptr;
-
-  return it->second;
+  auto method = methods_.find(className, methodName);
+  return method == nullptr ? nullptr : *method;
 }
 
 method_class* ClassTable::getInheritedMethod(Symbol className, Symbol methodName) {
   assert(hasClass(className));
+  depend(className);
+
+  int c = classId(className);
+  if (c >= 0) return c == 0 ? nullptr : hierarchy_->method(hierarchy_->parent(c), methodName);
 
   for (auto type = parents_[className]; hasClass(type); type = parents_[type]) {
     if (auto method = getMethod(type, methodName)) return method;
@@ -288,16 +349,18 @@ method_class* ClassTable::getInheritedMethod(Symbol className, Symbol methodName
 
 Symbol ClassTable::getAttr(Symbol className, Symbol name) {
   assert(hasClass(className));
+  depend(className);
 
-  auto& attrs = attrs_[className];
-  auto it = attrs.find(name);
-  if (it == attrs.end()) return nullptr;
-
-  return it->second;
+  auto attr = attrs_.find(className, name);
+  return attr == nullptr ? nullptr : *attr;
 }
 
 Symbol ClassTable::getInheritedAttr(Symbol className, Symbol name) {
   assert(hasClass(className));
+  depend(className);
+
+  int c = classId(className);
+  if (c >= 0) return c == 0 ? nullptr : attrType(hierarchy_->attr(hierarchy_->parent(c), name));
 
   for (auto type = parents_[className]; hasClass(type); type = parents_[type]) {
     if (auto attr = getAttr(type, name)) return attr;
@@ -306,14 +369,28 @@ Symbol ClassTable::getInheritedAttr(Symbol className, Symbol name) {
   return nullptr;
 }
 
+method_class* ClassTable::findMethod(Symbol className, Symbol methodName) {
+  depend(className);
+  int c = classId(className);
+  if (c >= 0) return hierarchy_->method(c, methodName);
+  return getMethod(className, methodName) ?: getInheritedMethod(className, methodName);
+}
+
+Symbol ClassTable::findAttr(Symbol className, Symbol name) {
+  depend(className);
+  int c = classId(className);
+  if (c >= 0) return attrType(hierarchy_->attr(c, name));
+  return getAttr(className, name) ?: getInheritedAttr(className, name);
+}
+
 void ClassTable::addMethod(Symbol clazz, method_class* m) {
   assert(hasClass(clazz));
-  methods_[clazz][m->getName()] = m;
+  methods_(clazz, m->getName()) = m;
 }
 
 void ClassTable::addAttr(Symbol clazz, attr_class* attr) {
   assert(hasClass(clazz));
-  attrs_[clazz][attr->getName()] = attr->getType();
+  attrs_(clazz, attr->getName()) = attr->getType();
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -338,17 +415,19 @@ ostream& ClassTable::semant_error(Class_ c)
 
 ostream& ClassTable::semant_error(Symbol filename, tree_node *t)
 {
-    error_stream << filename << ":" << t->get_line_number() << ": ";
-    return semant_error();
+    return semant_error() << filename << ":" << t->get_line_number() << ": ";
 }
 
 ostream& ClassTable::semant_error()                  
 {                                                 
     semant_errors++;                            
+    thread_errors++;
+    if (class_errors != NULL) return *class_errors;
     return error_stream;
 } 
 
 Symbol ClassTable::lca(Class_ curr, Symbol a, Symbol b) {
+  if (class_profile) class_profile->lcas++;
   if (a == No_type) return b;
   if (b == No_type) return a;
   if (a == b) return a;
@@ -357,19 +436,41 @@ Symbol ClassTable::lca(Class_ curr, Symbol a, Symbol b) {
 
   //assert(hasClass(a) && hasClass(b));
 
+  depend(a);
+  depend(b);
+
+  int u = classId(a), v = classId(b);
+  if (u >= 0 && v >= 0) {
+    // the steps are the classes passed on the way up to the ancestor
+    int ancestor = hierarchy_->lca(u, v);
+    if (ancestor != u && ancestor != v) {
+      profile_walk(hierarchy_->depth(u) + hierarchy_->depth(v) - 2 * hierarchy_->depth(ancestor));
+    }
+    return hierarchy_->name(ancestor);
+  }
+
   std::unordered_set<Symbol> check{a};
 
+  long steps = 0;
   auto it = parents_.find(a), end = parents_.end();
 
   for (; it != end; it = parents_.find(it->second)) {
     check.insert(it->second);
+    steps++;
   }
 
-  if (check.count(b) != 0) return b;
+  if (check.count(b) != 0) {
+    profile_walk(steps);
+    return b;
+  }
 
   it = parents_.find(b);
   for (; it != end; it = parents_.find(it->second)) {
-    if (check.count(it->second) != 0) return it->second;
+    steps++;
+    if (check.count(it->second) != 0) {
+      profile_walk(steps);
+      return it->second;
+    }
   }
 
   assert(false && "No lca type");
@@ -448,6 +549,7 @@ void formal_class::semant(Class_ clazz, ClassTable* table, SymTab& symtab) {
     table->semant_error(clazz) << "Parameter's name can't be 'self'\n";
   }
 
+  profile_lookup(symtab);
   if (symtab.probe(name) != nullptr) {
     table->semant_error(clazz) << "Duplicate parameter names are not allowed\n";
   }
@@ -460,7 +562,10 @@ void formal_class::semant(Class_ clazz, ClassTable* table, SymTab& symtab) {
 }
 
 void method_class::semant(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  if (!checkInheritanceTypes(table->getInheritedMethod(clazz->getName(), name))) {
+  Instant start;
+  if (class_profile) start = std::chrono::steady_clock::now();
+
+  if (table->badOverride(this)) {
     table->semant_error(clazz) << "Inherited method has wrong signature\n";
   }
 
@@ -480,250 +585,379 @@ void method_class::semant(Class_ clazz, ClassTable* table, SymTab& attrs) {
   }
 
   attrs.exitscope();
-}
 
-Symbol assign_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  auto rtype = expr->typecheck(clazz, table, attrs);
+  if (class_profile) class_profile->methods.push_back(std::make_pair(name, ms_since(start)));
+}
 
-  if (name == self) {
-    table->semant_error(clazz) << "Assignment to 'self' is not allowed" << std::endl;
-    return type = Object;
+//
+// Typecheck checks an expression on a stack of frames (see walk.h),
+// so that it needs no more native stack for a deep tree than for a
+// shallow one.  When a node's step finishes it, the node's type is
+// left in `type', for its parent to take.
+//
+struct TypecheckFrame {
+  Expression node;
+  int step;
+  int i;                  // the argument or branch it is at
+  Symbol a;               // a type it keeps from an earlier child
+  method_class* method;   // for a dispatch, the method called
+};
+
+class Typecheck {
+public:
+  Class_ clazz;
+  ClassTable* table;
+  SymTab& attrs;
+  Symbol type;            // of the node last finished
+  std::deque<TypecheckFrame> frames;
+
+  Typecheck(Class_ clazz, ClassTable* table, SymTab& attrs)
+  : clazz(clazz), table(table), attrs(attrs), type(nullptr) {}
+
+  bool visit(Expression e) {
+    frames.push_back(TypecheckFrame{e});
+    return true;
   }
 
-  auto ltype = getObjectType(name, clazz, table, attrs);
+  bool done(Symbol t) {
+    type = t;
+    return false;
+  }
 
-  if (ltype == nullptr) {
-    table->semant_error(clazz) << "Undeclared identifier " << name << std::endl;
-    return type = Object;
-  } else if (!table->inherits(clazz, ltype, rtype)) {
-    table->semant_error(clazz) << "Assignment expression type does not conform to the declared one: in " << name << std::endl;
-    return type = ltype;
+  ostream& error() { return table->semant_error(clazz); }
+  bool inherits(Symbol parent, Symbol child) { return table->inherits(clazz, parent, child); }
+  Symbol lca(Symbol a, Symbol b) { return table->lca(clazz, a, b); }
+
+  // Checks the arguments of a dispatch to f.method, one at each call:
+  // visits the next and returns true, until all are checked or one does
+  // not conform to its formal.  `conforms' then says whether all did.
+  bool arguments(TypecheckFrame& f, Expressions actual, bool& conforms) {
+    Formals formals = f.method->getFormals();
+    conforms = actual->len() == formals->len();
+    if (conforms && f.i > 0)
+      conforms = inherits(formals->nth(f.i - 1)->getType(), type);
+    if (conforms && f.i < actual->len())
+      return visit(actual->nth(f.i++));
+    return false;
   }
+};
 
-  return type = rtype;
+Symbol Expression_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
+  Typecheck t(clazz, table, attrs);
+  walk(t, t.frames, TypecheckFrame{this});
+  return t.type;
 }
 
-bool method_class::checkArgs(Class_ clazz, ClassTable* table, SymTab& attrs, Expressions actual) {
-  bool result = actual->len() == formals->len();
+bool assign_class::step(Typecheck& t, TypecheckFrame& f) {
+  if (f.step++ == 0) {
+    profile_typecheck("assign");
+    return t.visit(expr);
+  }
+  auto rtype = t.type;
 
-  for (int i = actual->first(); actual->more(i) && result; i = actual->next(i)) {
-    auto formal = formals->nth(i)->getType();
-    auto arg = actual->nth(i)->typecheck(clazz, table, attrs);
-    result = result && table->inherits(clazz, formal, arg);
+  if (name == self) {
+    t.error() << "Assignment to 'self' is not allowed" << std::endl;
+    return t.done(type = Object);
   }
 
-  return result;
-}
+  auto ltype = getObjectType(name, t.clazz, t.table, t.attrs);
 
-Symbol static_dispatch_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  if (type_name != SELF_TYPE && !table->hasClass(type_name)) {
-    table->semant_error(clazz) << "Undefined type: " << type_name << std::endl;
-    return type = Object;
+  if (ltype == nullptr) {
+    t.error() << "Undeclared identifier " << name << std::endl;
+    return t.done(type = Object);
+  } else if (!t.inherits(ltype, rtype)) {
+    t.error() << "Assignment expression type does not conform to the declared one: in " << name << std::endl;
+    return t.done(type = ltype);
   }
 
-  auto caller = expr->typecheck(clazz, table, attrs);
+  return t.done(type = rtype);
+}
+
+bool static_dispatch_class::step(Typecheck& t, TypecheckFrame& f) {
+  switch (f.step) {
+  case 0:
+    profile_typecheck("static_dispatch");
+    if (type_name != SELF_TYPE && !t.table->hasClass(type_name)) {
+      t.error() << "Undefined type: " << type_name << std::endl;
+      return t.done(type = Object);
+    }
 
-  assert(caller == SELF_TYPE || table->hasClass(caller));
+    f.step = 1;
+    return t.visit(expr);
+  case 1: {
+    auto caller = f.a = t.type;
 
-  if (!table->inherits(clazz, type_name, caller)) {
-    table->semant_error(clazz) << "In static dispatch expression caller object type doesn't conform to the declared dispatch type" << std::endl;
-    return type = Object; // probably a BUG;
-  }
+    assert(caller == SELF_TYPE || t.table->hasClass(caller));
 
-  auto method = table->getMethod(type_name, name) ?: table->getInheritedMethod(type_name, name);
-  if (method == nullptr) {
-    table->semant_error(clazz) << "Static dispatch to undefined method " << name << std::endl;
-    return type = Object;
+    if (!t.inherits(type_name, caller)) {
+      t.error() << "In static dispatch expression caller object type doesn't conform to the declared dispatch type" << std::endl;
+      return t.done(type = Object); // probably a BUG;
+    }
+
+    f.method = t.table->findMethod(type_name, name);
+    if (f.method == nullptr) {
+      t.error() << "Static dispatch to undefined method " << name << std::endl;
+      return t.done(type = Object);
+    }
+
+    f.step = 2;
+  }
   }
 
-  if (!method->checkArgs(clazz, table, attrs, actual)) {
-    table->semant_error(clazz) << "Wrong method signature during dispatch resolution\n";
-    return type = Object;
+  bool conforms;
+  if (t.arguments(f, actual, conforms)) return true;
+  if (!conforms) {
+    t.error() << "Wrong method signature during dispatch resolution\n";
+    return t.done(type = Object);
   }
 
-  auto ret = method->getRetType();
-  if (ret != SELF_TYPE && !table->hasClass(ret)) {
-    table->semant_error(clazz) << "Return type class does not exist\n";
-    return type = Object;
+  auto ret = f.method->getRetType();
+  if (ret != SELF_TYPE && !t.table->hasClass(ret)) {
+    t.error() << "Return type class does not exist\n";
+    return t.done(type = Object);
   }
 
-  return type = (ret == SELF_TYPE ? caller : ret);
+  return t.done(type = (ret == SELF_TYPE ? f.a : ret));
 }
 
-Symbol dispatch_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  auto caller = expr->typecheck(clazz, table, attrs);
-
-  assert(caller == SELF_TYPE || table->hasClass(caller));
+bool dispatch_class::step(Typecheck& t, TypecheckFrame& f) {
+  switch (f.step) {
+  case 0:
+    profile_typecheck("dispatch");
+    f.step = 1;
+    return t.visit(expr);
+  case 1: {
+    auto caller = f.a = t.type;
+
+    assert(caller == SELF_TYPE || t.table->hasClass(caller));
+
+    auto type_name = caller == SELF_TYPE ? t.clazz->getName() : caller;
+    f.method = t.table->findMethod(type_name, name);
+    if (f.method == nullptr) {
+      t.error() << "Dispatch to undefined method " << name << std::endl;
+      return t.done(type = Object);
+    }
 
-  auto type_name = caller == SELF_TYPE ? clazz->getName() : caller;
-  auto method = table->getMethod(type_name, name) ?: table->getInheritedMethod(type_name, name);
-  if (method == nullptr) {
-    table->semant_error(clazz) << "Dispatch to undefined method " << name << std::endl;
-    return type = Object;
+    f.step = 2;
+  }
   }
 
-  if (!method->checkArgs(clazz, table, attrs, actual)) {
-    table->semant_error(clazz) << "Wrong method signature during dispatch resolution\n";
-    return type = Object;
+  bool conforms;
+  if (t.arguments(f, actual, conforms)) return true;
+  if (!conforms) {
+    t.error() << "Wrong method signature during dispatch resolution\n";
+    return t.done(type = Object);
   }
 
-  auto ret = method->getRetType();
-  if (ret != SELF_TYPE && !table->hasClass(ret)) {
-    table->semant_error(clazz) << "Return type class does not exist\n";
-    return type = Object;
+  auto ret = f.method->getRetType();
+  if (ret != SELF_TYPE && !t.table->hasClass(ret)) {
+    t.error() << "Return type class does not exist\n";
+    return t.done(type = Object);
   }
 
-  return type = (ret == SELF_TYPE ? caller : ret);
+  return t.done(type = (ret == SELF_TYPE ? f.a : ret));
 }
 
-Symbol cond_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  if (pred->typecheck(clazz, table, attrs) != Bool) {
-    table->semant_error(clazz) << "'if' predicate type must be Bool\n";
+bool cond_class::step(Typecheck& t, TypecheckFrame& f) {
+  switch (f.step++) {
+  case 0:
+    profile_typecheck("cond");
+    return t.visit(pred);
+  case 1:
+    if (t.type != Bool) {
+      t.error() << "'if' predicate type must be Bool\n";
+    }
+    return t.visit(then_exp);
+  case 2:
+    f.a = t.type;
+    return t.visit(else_exp);
   }
 
-  auto then = then_exp->typecheck(clazz, table, attrs);
-  auto else_ = else_exp->typecheck(clazz, table, attrs);
-
-  return type = table->lca(clazz, then, else_);
+  return t.done(type = t.lca(f.a, t.type));
 }
 
-Symbol loop_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  if (pred->typecheck(clazz, table, attrs) != Bool) {
-    table->semant_error(clazz) << "Loop predicate type must be Bool\n";
+bool loop_class::step(Typecheck& t, TypecheckFrame& f) {
+  switch (f.step++) {
+  case 0:
+    profile_typecheck("loop");
+    return t.visit(pred);
+  case 1:
+    if (t.type != Bool) {
+      t.error() << "Loop predicate type must be Bool\n";
+    }
+    return t.visit(body);
   }
 
-  body->typecheck(clazz, table, attrs);
-  return type = Object;
+  return t.done(type = Object);
+}
+
+// Joins branch i of a case, of type `type', into `result', the type of
+// the branches before it.
+static Symbol joinBranch(Typecheck& t, Cases cases, int i, Symbol type, Symbol result) {
+  for (int j = 0; j < i; j++) {
+    if (cases->nth(j)->getType() == cases->nth(i)->getType()) {
+      t.error() << "Case branches have identical types\n";
+      break;
+    }
+  }
+  return t.lca(result, type); // NOTE: check for SELF_TYPE
 }
 
-Symbol typcase_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  expr->typecheck(clazz, table, attrs);
+bool typcase_class::step(Typecheck& t, TypecheckFrame& f) {
+  if (f.step == 0) {
+    profile_typecheck("typcase");
+    f.step = 1;
+    f.a = No_type;
+    return t.visit(expr);
+  }
 
-  std::unordered_set<Symbol> types;
+  // at step 2, the expression of branch f.i - 1 has just been checked
+  if (f.step == 2) {
+    t.attrs.exitscope();
+    f.a = joinBranch(t, cases, f.i - 1, t.type, f.a);
+  }
 
-  auto result = No_type;
-  for (int i = cases->first(); cases->more(i); i = cases->next(i)) {
-    auto branch = cases->nth(i);
-    auto type = branch->typecheck(clazz, table, attrs);
-    if (types.count(branch->getType()) != 0)
-      table->semant_error(clazz) << "Case branches have identical types\n";
-    types.insert(branch->getType());
-    result = table->lca(clazz, result, type); // NOTE: check for SELF_TYPE
+  while (f.i < cases->len()) {
+    auto branch = cases->nth(f.i++);
+    if (auto body = branch->typecheck(t.clazz, t.table, t.attrs)) {
+      f.step = 2;
+      return t.visit(body);
+    }
+    f.a = joinBranch(t, cases, f.i - 1, Object, f.a);
   }
 
-  return type = result;
+  return t.done(type = f.a);
 }
 
-Symbol branch_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
+Expression branch_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
+  profile_typecheck("branch");
   if (type_decl != SELF_TYPE && !table->hasClass(type_decl)) {
     table->semant_error(clazz) << "Undefined type in 'case' branch\n";
-    return Object;
+    return nullptr;
   }
 
   attrs.enterscope();
   attrs.addid(name, &type_decl);
-  auto type = expr->typecheck(clazz, table, attrs);
-  attrs.exitscope();
-  return type;
+  return expr;
 }
 
-Symbol block_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  Symbol result;
+bool block_class::step(Typecheck& t, TypecheckFrame& f) {
+  if (f.step++ == 0) profile_typecheck("block");
 
-  for (int i = body->first(); body->more(i); i = body->next(i)) {
-    result = body->nth(i)->typecheck(clazz, table, attrs);
-  }
+  if (f.i < body->len()) return t.visit(body->nth(f.i++));
 
-  return type = result;
+  return t.done(type = t.type);
 }
 
-Symbol let_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  if (type_decl != SELF_TYPE && !table->hasClass(type_decl))
-    table->semant_error(clazz) << "Undefined type in 'let' expression\n";
+bool let_class::step(Typecheck& t, TypecheckFrame& f) {
+  switch (f.step++) {
+  case 0:
+    profile_typecheck("let");
+    if (type_decl != SELF_TYPE && !t.table->hasClass(type_decl))
+      t.error() << "Undefined type in 'let' expression\n";
 
-  if (identifier == self)
-    table->semant_error(clazz) << "'self' cannot be used as an identifier name\n";
+    if (identifier == self)
+      t.error() << "'self' cannot be used as an identifier name\n";
+
+    return t.visit(init);
+  case 1:
+    if (!t.inherits(type_decl, t.type)) {
+      t.error() << "Init expression type doesn't conform to the declared type\n";
+    }
 
-  auto initType = init->typecheck(clazz, table, attrs);
-  if (!table->inherits(clazz, type_decl, initType)) {
-    table->semant_error(clazz) << "Init expression type doesn't conform to the declared type\n";
+    t.attrs.enterscope();
+    t.attrs.addid(identifier, &type_decl);
+    return t.visit(body);
   }
 
-  attrs.enterscope();
-  attrs.addid(identifier, &type_decl);
-  type = body->typecheck(clazz, table, attrs);
-  attrs.exitscope();
-  return type;
+  t.attrs.exitscope();
+  return t.done(type = t.type);
 }
 
-Symbol plus_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  auto a = e1->typecheck(clazz, table, attrs);
-  auto b = e2->typecheck(clazz, table, attrs);
+bool plus_class::step(Typecheck& t, TypecheckFrame& f) {
+  switch (f.step++) {
+  case 0: profile_typecheck("plus"); return t.visit(e1);
+  case 1: f.a = t.type; return t.visit(e2);
+  }
 
-  if (a == Int && b == Int)
-    return type = Int;
+  if (f.a == Int && t.type == Int)
+    return t.done(type = Int);
 
-  table->semant_error(clazz) << "Operand types are not Int for '+' operator\n";
-  return type = Object;
+  t.error() << "Operand types are not Int for '+' operator\n";
+  return t.done(type = Object);
 }
 
-Symbol sub_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  auto a = e1->typecheck(clazz, table, attrs);
-  auto b = e2->typecheck(clazz, table, attrs);
+bool sub_class::step(Typecheck& t, TypecheckFrame& f) {
+  switch (f.step++) {
+  case 0: profile_typecheck("sub"); return t.visit(e1);
+  case 1: f.a = t.type; return t.visit(e2);
+  }
 
-  if (a == Int && b == Int)
-    return type = Int;
+  if (f.a == Int && t.type == Int)
+    return t.done(type = Int);
 
-  table->semant_error(clazz) << "Operand types are not Int for '-' operator\n";
-  return type = Object;
+  t.error() << "Operand types are not Int for '-' operator\n";
+  return t.done(type = Object);
 }
 
-Symbol mul_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  auto a = e1->typecheck(clazz, table, attrs);
-  auto b = e2->typecheck(clazz, table, attrs);
+bool mul_class::step(Typecheck& t, TypecheckFrame& f) {
+  switch (f.step++) {
+  case 0: profile_typecheck("mul"); return t.visit(e1);
+  case 1: f.a = t.type; return t.visit(e2);
+  }
 
-  if (a == Int && b == Int)
-    return type = Int;
+  if (f.a == Int && t.type == Int)
+    return t.done(type = Int);
 
-  table->semant_error(clazz) << "Operand types are not Int for '*' operator\n";
-  return type = Object;
+  t.error() << "Operand types are not Int for '*' operator\n";
+  return t.done(type = Object);
 }
 
-Symbol divide_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  auto a = e1->typecheck(clazz, table, attrs);
-  auto b = e2->typecheck(clazz, table, attrs);
+bool divide_class::step(Typecheck& t, TypecheckFrame& f) {
+  switch (f.step++) {
+  case 0: profile_typecheck("divide"); return t.visit(e1);
+  case 1: f.a = t.type; return t.visit(e2);
+  }
 
-  if (a == Int && b == Int)
-    return type = Int;
+  if (f.a == Int && t.type == Int)
+    return t.done(type = Int);
 
-  table->semant_error(clazz) << "Operand types are not Int for '/' operator\n";
-  return type = Object;
+  t.error() << "Operand types are not Int for '/' operator\n";
+  return t.done(type = Object);
 }
 
-Symbol neg_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  auto a = e1->typecheck(clazz, table, attrs);
+bool neg_class::step(Typecheck& t, TypecheckFrame& f) {
+  if (f.step++ == 0) {
+    profile_typecheck("neg");
+    return t.visit(e1);
+  }
 
-  if (a == Int)
-    return type = Int;
+  if (t.type == Int)
+    return t.done(type = Int);
 
-  table->semant_error(clazz) << "Operand type is not Int for '-' unary operator\n";
-  return type = Object;
+  t.error() << "Operand type is not Int for '-' unary operator\n";
+  return t.done(type = Object);
 }
 
-Symbol lt_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  auto a = e1->typecheck(clazz, table, attrs);
-  auto b = e2->typecheck(clazz, table, attrs);
+bool lt_class::step(Typecheck& t, TypecheckFrame& f) {
+  switch (f.step++) {
+  case 0: profile_typecheck("lt"); return t.visit(e1);
+  case 1: f.a = t.type; return t.visit(e2);
+  }
 
-  if (a == Int && b == Int)
-    return type = Bool;
+  if (f.a == Int && t.type == Int)
+    return t.done(type = Bool);
 
-  table->semant_error(clazz) << "Operand types are not Int for '<' operator\n";
-  return type = Object;
+  t.error() << "Operand types are not Int for '<' operator\n";
+  return t.done(type = Object);
 }
 
-Symbol eq_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  auto a = e1->typecheck(clazz, table, attrs);
-  auto b = e2->typecheck(clazz, table, attrs);
+bool eq_class::step(Typecheck& t, TypecheckFrame& f) {
+  switch (f.step++) {
+  case 0: profile_typecheck("eq"); return t.visit(e1);
+  case 1: f.a = t.type; return t.visit(e2);
+  }
+  auto a = f.a, b = t.type;
 
   static std::unordered_set<Symbol> basics{Int, Str, Bool};
 
@@ -731,70 +965,84 @@ Symbol eq_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
       (a == Int && b == Int) ||
       (a == Bool && b == Bool) ||
       (basics.count(a) == 0 && basics.count(b) == 0))
-    return type = Bool;
+    return t.done(type = Bool);
 
-  table->semant_error(clazz) << "Wrong operand types for '=' operator\n";
-  return type = Object;
+  t.error() << "Wrong operand types for '=' operator\n";
+  return t.done(type = Object);
 }
 
-Symbol leq_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  auto a = e1->typecheck(clazz, table, attrs);
-  auto b = e2->typecheck(clazz, table, attrs);
+bool leq_class::step(Typecheck& t, TypecheckFrame& f) {
+  switch (f.step++) {
+  case 0: profile_typecheck("leq"); return t.visit(e1);
+  case 1: f.a = t.type; return t.visit(e2);
+  }
 
-  if (a == Int && b == Int)
-    return type = Bool;
+  if (f.a == Int && t.type == Int)
+    return t.done(type = Bool);
 
-  table->semant_error(clazz) << "Operand types are not Int for '<=' operator\n";
-  return type = Object;
+  t.error() << "Operand types are not Int for '<=' operator\n";
+  return t.done(type = Object);
 }
 
-Symbol comp_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  auto a = e1->typecheck(clazz, table, attrs);
+bool comp_class::step(Typecheck& t, TypecheckFrame& f) {
+  if (f.step++ == 0) {
+    profile_typecheck("comp");
+    return t.visit(e1);
+  }
 
-  if (a == Bool)
-    return type = Bool;
+  if (t.type == Bool)
+    return t.done(type = Bool);
 
-  table->semant_error(clazz) << "Operand type is not Bool for 'not' operator\n";
-  return type = Object;
+  t.error() << "Operand type is not Bool for 'not' operator\n";
+  return t.done(type = Object);
 }
 
-Symbol int_const_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  return type = Int;
+bool int_const_class::step(Typecheck& t, TypecheckFrame& f) {
+  profile_typecheck("int_const");
+  return t.done(type = Int);
 }
 
-Symbol bool_const_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  return type = Bool;
+bool bool_const_class::step(Typecheck& t, TypecheckFrame& f) {
+  profile_typecheck("bool_const");
+  return t.done(type = Bool);
 }
 
-Symbol string_const_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  return type = Str;
+bool string_const_class::step(Typecheck& t, TypecheckFrame& f) {
+  profile_typecheck("string_const");
+  return t.done(type = Str);
 }
 
-Symbol new__class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  if (type_name != SELF_TYPE && !table->hasClass(type_name)) {
-    table->semant_error(clazz) << "Undefined type name\n";
-    return type = Object;
+bool new__class::step(Typecheck& t, TypecheckFrame& f) {
+  profile_typecheck("new");
+  if (type_name != SELF_TYPE && !t.table->hasClass(type_name)) {
+    t.error() << "Undefined type name\n";
+    return t.done(type = Object);
   }
 
-  return type = type_name;
+  return t.done(type = type_name);
 }
 
-Symbol isvoid_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  e1->typecheck(clazz, table, attrs);
-  return type = Bool;
+bool isvoid_class::step(Typecheck& t, TypecheckFrame& f) {
+  if (f.step++ == 0) {
+    profile_typecheck("isvoid");
+    return t.visit(e1);
+  }
+  return t.done(type = Bool);
 }
 
-Symbol no_expr_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  return type = No_type;
+bool no_expr_class::step(Typecheck& t, TypecheckFrame& f) {
+  profile_typecheck("no_expr");
+  return t.done(type = No_type);
 }
 
-Symbol object_class::typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) {
-  if (name == self) return type = SELF_TYPE;
-  if (auto val = getObjectType(name, clazz, table, attrs))
-    return type = val;
+bool object_class::step(Typecheck& t, TypecheckFrame& f) {
+  profile_typecheck("object");
+  if (name == self) return t.done(type = SELF_TYPE);
+  if (auto val = getObjectType(name, t.clazz, t.table, t.attrs))
+    return t.done(type = val);
 
-  table->semant_error(clazz) << "Undefined identifier\n";
-  return type = Object;
+  t.error() << "Undefined identifier\n";
+  return t.done(type = Object);
 }
 
 /*void dfs(ClassTable* table, Symbol node) {
@@ -840,6 +1088,523 @@ Class_ program_class::findClass(Symbol name) const {
   assert(false);
 }
 
+// A class to be checked, and what the semant cache needs to know of it.
+struct ClassCheck {
+  Class_ clazz;
+  uint64_t key;                     // a hash of the class's tree
+  std::vector<tree_node*> exprs;    // its expressions, in the order written
+  std::unordered_set<Symbol> deps;  // the names looked up in checking it
+  int errors;                       // found in it
+  SemantProfile *profile = NULL;    // with -s
+};
+
+static void check_class(ClassCheck& check, ClassTable* table, SymTab& symtab, bool record) {
+  int errors = thread_errors;
+  if (record) {
+    class_deps = &check.deps;
+    check.deps.insert(check.clazz->getName());
+  }
+
+  SemantProfile *outer = class_profile;
+  Instant start;
+  if (check.profile) start = std::chrono::steady_clock::now();
+  class_profile = check.profile;
+
+  check.clazz->semant(table, symtab);
+
+  if (check.profile) check.profile->ms = ms_since(start);
+  class_profile = outer;
+  class_deps = NULL;
+  check.errors = thread_errors - errors;
+}
+
+// Runs work on up to `jobs' threads, or, if there is no use for more than
+// one, on this thread alone.  Each takes the number of the next item to do
+// from `next' until there are none left.
+template <class Work>
+static void run_jobs(size_t items, Work work) {
+  std::atomic<size_t> next(0);
+  if (jobs <= 1 || items <= 1) {
+    work(next);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < jobs && i < (int) items; i++) {
+    threads.emplace_back([&]() { work(next); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+// Checks the classes in turn, or on up to `jobs' threads.  Each thread has
+// a symbol table of its own, and everything else they share is only read,
+// now that the hierarchy and the feature tables have been built, with one
+// exception: an append node flattens its list the first time it is read
+// (see tree.h), and a thread reads the formals of the methods of other
+// classes.  Those are flattened here, before the threads start.  The
+// errors are printed in the order of the classes, as if they had been
+// checked in turn.
+static void semant_classes(std::vector<ClassCheck>& checks, ClassTable* table, bool record) {
+  if (jobs <= 1 || checks.size() <= 1) {
+    SymTab symtab;
+    for (auto& check : checks) {
+      check_class(check, table, symtab, record);
+    }
+    return;
+  }
+
+  auto hierarchy = table->hierarchy();
+  for (int i = 0; i < hierarchy->size(); i++) {
+    for (const auto& item : hierarchy->methods(i)) {
+      if (item.clazz == i) item.method->getFormals()->len();
+    }
+  }
+
+  std::vector<std::string> errors(checks.size());
+  run_jobs(checks.size(), [&](std::atomic<size_t>& next) {
+    SymTab symtab;
+    std::ostringstream buffer;
+    class_errors = &buffer;
+
+    for (size_t i; (i = next.fetch_add(1)) < checks.size(); ) {
+      buffer.str("");
+      check_class(checks[i], table, symtab, record);
+      errors[i] = buffer.str();
+    }
+
+    class_errors = NULL;
+  });
+
+  for (const auto& text : errors) {
+    cerr << text;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// The semant cache
+//
+// With -C file, semant keeps in the file what it learned of each class it
+// found no errors in: the type it gave each expression, and the signature
+// of each class it looked up, keyed by a hash of the class's tree (see
+// TreeKey).  On the next compile, a class whose tree hashes the same, and
+// whose looked-up classes have the same signatures, is not checked again:
+// its expressions get the types kept for them.
+// The signature of a class covers its members and its ancestors (see
+// buildHierarchy), so changing a class's members, or those of any class
+// it inherits from, makes every class that looked it up be checked again.
+//
+// Numbers in the file are unsigned LEB128 varints, except for hashes,
+// which are 8 bytes, least significant first.  It is laid out as
+//
+//    header     the 8 bytes SEMANT_CACHE_MAGIC, the version, and the
+//               hash of the rest of the file
+//    names      the number of names, and each as its length and characters
+//    entries    the number of entries, and for each, the hash of the tree
+//               and the length of the rest of the entry; the number of
+//               looked-up names, and each as the index of the name and its
+//               signature; and the number of expressions, and the type of
+//               each as the index of its name plus one, or zero for no type
+//
+// An entry is read only when a class hashes to its key, and one that is
+// kept is written out again as it was read, so the names keep their
+// indices from one file to the next: new ones are added at the end, and
+// none is left out until the file is started afresh.
+//
+// A file whose hash does not match is ignored, and an entry that cannot be
+// read, or that gives an expression a type other than a class of the
+// program, SELF_TYPE or No_type, is dropped, so a damaged cache only costs
+// checking again.
+//
+//////////////////////////////////////////////////////////////////////
+
+#define SEMANT_CACHE_MAGIC "\0COOLSEM"
+#define SEMANT_CACHE_MAGIC_LEN 8
+#define SEMANT_CACHE_VERSION 3     // to be raised whenever the checks change
+
+class SemantCache {
+private:
+  // the rest of an entry, as it is in file or in added
+  struct Entry {
+    uint64_t key;
+    bool added;
+    size_t start, len;
+  };
+
+  ClassTable* table;
+  std::string file;                          // as read
+  std::string added;                         // the entries of add
+  std::vector<std::string_view> names;       // in file, or of symbols
+  std::unordered_map<std::string_view, int> nameIndex;
+  std::vector<Symbol> nameTypes;             // the type of each, or null
+  std::vector<uint64_t> nameSignatures;      // of each, now, or zero
+  std::unordered_map<std::string_view, Symbol> types;         // of expressions
+  std::unordered_map<std::string_view, uint64_t> signatures;  // now
+  std::unordered_map<uint64_t, Entry> entries;                // as read
+  std::vector<Entry> kept;                   // to be written
+  bool changed = false;                      // kept is not what was read
+
+  int name(std::string_view s);
+  Symbol symbol(int name) const;
+  bool parse(const char*& p, const char* lim);
+  std::string_view stored(const Entry& entry) const;
+public:
+  SemantCache(ClassTable* t);
+  void read(const char* path);
+  void write(const char* path);
+
+  enum Restored { MISSED, RESTORED, DAMAGED };
+
+  // gives the expressions of the class the types kept for it, if it need
+  // not be checked again, and returns whether it did, or found its entry
+  // damaged.  It changes nothing else, so the classes may be restored on
+  // several threads at once.
+  Restored restore(ClassCheck& check) const;
+
+  // keeps the entry of a restored class, or drops a damaged one
+  void keep(const ClassCheck& check, Restored restored);
+
+  // keeps what was learned in checking the class
+  void add(ClassCheck& check);
+};
+
+//
+// TreeKey hashes the tree of a class for the cache.  The key method of
+// each node adds the node's own parts: its kind (as its tag in
+// ast-binary.h), its symbols and its constants.  tree_hash visits the
+// subexpressions itself, on a stack of its own, and adds how many each
+// node has, so the hash follows the shape of the tree.  Line numbers are
+// left out, since no type depends on them.
+//
+class TreeKey {
+private:
+  uint64_t h = 0;
+public:
+  // as mix does, but inline, since there is an add for every part of
+  // every node
+  void add(uint64_t x) { h = (h ^ x) * 0x9e3779b97f4a7c15ULL; h ^= h >> 29; }
+  void add(Symbol s) { h = hash_bytes(s->get_string(), s->get_len(), h); }
+  uint64_t hash() const { return h; }
+};
+
+void method_class::key(TreeKey& k) {
+  k.add(AST_METHOD);
+  k.add(name);
+  for (int i = formals->first(); formals->more(i); i = formals->next(i)) {
+    k.add(formals->nth(i)->getName());
+    k.add(formals->nth(i)->getType());
+  }
+  k.add(formals->len());
+  k.add(return_type);
+}
+
+void attr_class::key(TreeKey& k) {
+  k.add(AST_ATTR);
+  k.add(name);
+  k.add(type_decl);
+}
+
+void branch_class::key(TreeKey& k) {
+  k.add(AST_BRANCH);
+  k.add(name);
+  k.add(type_decl);
+}
+
+void assign_class::key(TreeKey& k) { k.add(AST_ASSIGN); k.add(name); }
+
+void static_dispatch_class::key(TreeKey& k) {
+  k.add(AST_STATIC_DISPATCH);
+  k.add(type_name);
+  k.add(name);
+}
+
+void dispatch_class::key(TreeKey& k) { k.add(AST_DISPATCH); k.add(name); }
+void cond_class::key(TreeKey& k) { k.add(AST_COND); }
+void loop_class::key(TreeKey& k) { k.add(AST_LOOP); }
+
+void typcase_class::key(TreeKey& k) {
+  k.add(AST_TYPCASE);
+  for (int i = cases->first(); cases->more(i); i = cases->next(i)) {
+    cases->nth(i)->key(k);
+  }
+}
+
+void block_class::key(TreeKey& k) { k.add(AST_BLOCK); }
+
+void let_class::key(TreeKey& k) {
+  k.add(AST_LET);
+  k.add(identifier);
+  k.add(type_decl);
+}
+
+void plus_class::key(TreeKey& k) { k.add(AST_PLUS); }
+void sub_class::key(TreeKey& k) { k.add(AST_SUB); }
+void mul_class::key(TreeKey& k) { k.add(AST_MUL); }
+void divide_class::key(TreeKey& k) { k.add(AST_DIVIDE); }
+void neg_class::key(TreeKey& k) { k.add(AST_NEG); }
+void lt_class::key(TreeKey& k) { k.add(AST_LT); }
+void eq_class::key(TreeKey& k) { k.add(AST_EQ); }
+void leq_class::key(TreeKey& k) { k.add(AST_LEQ); }
+void comp_class::key(TreeKey& k) { k.add(AST_COMP); }
+void int_const_class::key(TreeKey& k) { k.add(AST_INT_CONST); k.add(token); }
+void bool_const_class::key(TreeKey& k) { k.add(AST_BOOL_CONST); k.add(val); }
+void string_const_class::key(TreeKey& k) { k.add(AST_STRING_CONST); k.add(token); }
+void new__class::key(TreeKey& k) { k.add(AST_NEW); k.add(type_name); }
+void isvoid_class::key(TreeKey& k) { k.add(AST_ISVOID); }
+void no_expr_class::key(TreeKey& k) { k.add(AST_NO_EXPR); }
+void object_class::key(TreeKey& k) { k.add(AST_OBJECT); k.add(name); }
+
+// the hash of the class's tree; exprs gets its expressions, in preorder
+// (of the children of a node, the last first)
+static uint64_t tree_hash(Class_ clazz, std::vector<tree_node*>& exprs) {
+  TreeKey k;
+  k.add(AST_CLASS);
+  k.add(clazz->getName());
+  k.add(clazz->getParent());
+
+  // kept from class to class, so that they seldom grow
+  static thread_local std::vector<Expression *> work;
+  static thread_local std::vector<tree_node*> found;
+  found.clear();
+
+  Features features = clazz->get_features();
+  for (int i = features->first(); features->more(i); i = features->next(i)) {
+    features->nth(i)->key(k);
+    features->nth(i)->children(work);
+    while (!work.empty()) {
+      Expression e = *work.back();
+      work.pop_back();
+      found.push_back(e);
+      e->key(k);
+      size_t before = work.size();
+      e->children(work);
+      k.add(work.size() - before);
+    }
+  }
+  k.add(features->len());
+  exprs.assign(found.begin(), found.end());
+  return k.hash();
+}
+
+static std::string_view view(Symbol s) {
+  return std::string_view(s->get_string(), s->get_len());
+}
+
+static void put(std::string& out, uint64_t n) {
+  while (n >= 0x80) {
+    out += (char) (n | 0x80);
+    n >>= 7;
+  }
+  out += (char) n;
+}
+
+static void put_hash(std::string& out, uint64_t h) {
+  for (int i = 0; i < 8; i++) out += (char) (h >> (8 * i));
+}
+
+// Each returns false, and reads nothing, if the input ends too soon.
+static bool get(const char*& p, const char* lim, uint64_t& n) {
+  n = 0;
+  for (int shift = 0; p < lim && shift < 64; shift += 7) {
+    unsigned char b = *p++;
+    n |= (uint64_t) (b & 0x7f) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+static bool get_hash(const char*& p, const char* lim, uint64_t& h) {
+  if (lim - p < 8) return false;
+  h = 0;
+  for (int i = 0; i < 8; i++) h |= (uint64_t) (unsigned char) *p++ << (8 * i);
+  return true;
+}
+
+SemantCache::SemantCache(ClassTable* t) : table(t) {
+  auto hierarchy = table->hierarchy();
+  for (int i = 0; i < hierarchy->size(); i++) {
+    signatures[view(hierarchy->name(i))] = table->signature(hierarchy->name(i));
+    types[view(hierarchy->name(i))] = hierarchy->name(i);
+  }
+  types[view(SELF_TYPE)] = SELF_TYPE;
+  types[view(No_type)] = No_type;
+}
+
+int SemantCache::name(std::string_view s) {
+  auto it = nameIndex.find(s);
+  if (it != nameIndex.end()) return it->second;
+  nameIndex[s] = names.size();
+  names.push_back(s);
+  auto type = types.find(s);
+  nameTypes.push_back(type == types.end() ? nullptr : type->second);
+  auto signature = signatures.find(s);
+  nameSignatures.push_back(signature == signatures.end() ? 0 : signature->second);
+  return names.size() - 1;
+}
+
+// the type of the name, or null if no expression may have it
+Symbol SemantCache::symbol(int name) const {
+  return nameTypes[name];
+}
+
+bool SemantCache::parse(const char*& p, const char* lim) {
+  uint64_t n, len;
+  if (!get(p, lim, n) || n > (uint64_t) (lim - p)) return false;
+  names.reserve(n);
+  nameIndex.reserve(n);
+  for (uint64_t i = 0; i < n; i++) {
+    // a name given twice could not keep its index
+    if (!get(p, lim, len) || len > (uint64_t) (lim - p) ||
+        name(std::string_view(p, len)) != (int) i) {
+      return false;
+    }
+    p += len;
+  }
+
+  if (!get(p, lim, n) || n > (uint64_t) (lim - p)) return false;
+  entries.reserve(n);
+  for (uint64_t i = 0; i < n; i++) {
+    Entry entry;
+    entry.added = false;
+    if (!get_hash(p, lim, entry.key) || !get(p, lim, len) || len > (uint64_t) (lim - p)) {
+      return false;
+    }
+    entry.start = p - file.data();
+    entry.len = len;
+    entries[entry.key] = entry;
+    p += len;
+  }
+  return p == lim;
+}
+
+std::string_view SemantCache::stored(const Entry& entry) const {
+  return std::string_view((entry.added ? added : file).data() + entry.start, entry.len);
+}
+
+void SemantCache::read(const char* path) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) return;
+  file.resize(in.tellg());
+  in.seekg(0);
+  if (!in.read(&file[0], file.size())) return;
+
+  const char* p = file.data();
+  const char* lim = p + file.size();
+  uint64_t version, hash;
+  if (file.size() < SEMANT_CACHE_MAGIC_LEN ||
+      memcmp(p, SEMANT_CACHE_MAGIC, SEMANT_CACHE_MAGIC_LEN) != 0) {
+    return;
+  }
+  p += SEMANT_CACHE_MAGIC_LEN;
+  if (!get(p, lim, version) || version != SEMANT_CACHE_VERSION ||
+      !get_hash(p, lim, hash) || hash != hash_bytes(p, lim - p) || !parse(p, lim)) {
+    entries.clear();                   // start afresh
+    names.clear();
+    nameIndex.clear();
+    nameTypes.clear();
+    nameSignatures.clear();
+  }
+  kept.reserve(entries.size());
+}
+
+void SemantCache::write(const char* path) {
+  // if every class was restored, and the file has no other entries, it
+  // already holds what would be written
+  if (!changed && kept.size() == entries.size()) return;
+
+  std::string rest;                  // the names, then the entries
+  rest.reserve(file.size() + added.size());
+  put(rest, names.size());
+  for (auto name : names) {
+    put(rest, name.size());
+    rest.append(name.data(), name.size());
+  }
+  put(rest, kept.size());
+  for (const auto& entry : kept) {
+    put_hash(rest, entry.key);
+    put(rest, entry.len);
+    rest += stored(entry);
+  }
+
+  std::string head(SEMANT_CACHE_MAGIC, SEMANT_CACHE_MAGIC_LEN);
+  put(head, SEMANT_CACHE_VERSION);
+  put_hash(head, hash_bytes(rest.data(), rest.size()));
+
+  std::string temp = std::string(path) + ".tmp";
+  std::ofstream out(temp, std::ios::binary);
+  out.write(head.data(), head.size());
+  out.write(rest.data(), rest.size());
+  out.close();
+  if (!out || rename(temp.c_str(), path) != 0) {
+    cerr << "Could not write the semant cache " << path << endl;
+    remove(temp.c_str());
+  }
+}
+
+SemantCache::Restored SemantCache::restore(ClassCheck& check) const {
+  auto it = entries.find(check.key);
+  if (it == entries.end()) return MISSED;
+
+  std::string_view text = stored(it->second);
+  const char* p = text.data();
+  const char* lim = p + text.size();
+  uint64_t n, name, signature;
+
+  bool ok = get(p, lim, n);
+  for (uint64_t i = 0; ok && i < n; i++) {
+    ok = get(p, lim, name) && name < names.size() && get_hash(p, lim, signature);
+    // a class it looked up has changed: check it, but keep the entry,
+    // which is still good if the change is undone
+    if (ok && nameSignatures[name] != signature) return MISSED;
+  }
+
+  static thread_local std::vector<Symbol> found;
+  found.clear();
+  ok = ok && get(p, lim, n) && n == check.exprs.size();
+  for (uint64_t i = 0; ok && i < n; i++) {
+    ok = get(p, lim, name) && name <= names.size() &&
+      (name == 0 || symbol(name - 1) != nullptr);
+    if (ok) found.push_back(name == 0 ? nullptr : symbol(name - 1));
+  }
+  if (!ok || p != lim) return DAMAGED;
+
+  for (size_t i = 0; i < found.size(); i++) {
+    static_cast<Expression>(check.exprs[i])->set_type(found[i]);
+  }
+  return RESTORED;
+}
+
+void SemantCache::keep(const ClassCheck& check, Restored restored) {
+  if (restored == RESTORED) {
+    kept.push_back(entries[check.key]);
+  } else if (restored == DAMAGED) {
+    entries.erase(check.key);
+    changed = true;
+  }
+}
+
+void SemantCache::add(ClassCheck& check) {
+  changed = true;
+  Entry entry;
+  entry.key = check.key;
+  entry.added = true;
+  entry.start = added.size();
+  put(added, check.deps.size());
+  for (auto sym : check.deps) {
+    put(added, name(view(sym)));
+    put_hash(added, table->signature(sym));
+  }
+  put(added, check.exprs.size());
+  for (auto node : check.exprs) {
+    auto type = static_cast<Expression>(node)->get_type();
+    put(added, type == nullptr ? 0 : name(view(type)) + 1);
+  }
+  entry.len = added.size() - entry.start;
+  kept.push_back(entry);
+}
+
 /*   This is the entry point to the semantic checker.
 
      Your checker should do the following two things:
@@ -853,10 +1618,144 @@ Class_ program_class::findClass(Symbol name) const {
      errors. Part 2) can be done in a second stage, when you want
      to build mycoolc.
  */
+//////////////////////////////////////////////////////////////////////
+//
+// The profile
+//
+// With -s, semant prints on stderr, once it is done, one JSON object:
+//
+//    {"phases": {"classes": ms, "hierarchy": ms, "cache": ms, "check": ms,
+//                "cache_write": ms, "dispatch": ms, "total": ms},
+//     "cached": n,
+//     "dispatches": n, "monomorphic": n,
+//     "classes": [{"name": s, "file": s, "ms": ms,
+//                  "methods": [{"name": s, "ms": ms}, ...], COUNTS}, ...],
+//     "other": {COUNTS},
+//     "total": {COUNTS}}
+//
+// where COUNTS is
+//
+//    "typecheck": {kind: n, ...}, "lookups": n, "max_scope_depth": n,
+//    "inherits": n, "lca": n, "walks": n, "walk_steps": n, "max_walk": n
+//
+// The classes are those checked, in order; those the semant cache let be
+// are only counted in "cached".  "dispatches" is the number of dynamic
+// dispatches in the program, and "monomorphic" the number of them that can
+// reach only one method.  "other" counts the work of semant outside
+// the checks of classes, and "total" that of all of it.  A walk is a climb
+// up the hierarchy, by inherits or lca, and its steps the classes passed.
+//
+//////////////////////////////////////////////////////////////////////
+
+static void json_string(ostream& out, const char* s) {
+  out << '"';
+  for (; *s; s++) {
+    unsigned char c = *s;
+    if (c == '"' || c == '\\') out << '\\' << c;
+    else if (c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof buf, "\\u%04x", c);
+      out << buf;
+    } else out << c;
+  }
+  out << '"';
+}
+
+static void add_profile(SemantProfile& total, const SemantProfile& p) {
+  for (const auto& item : p.typechecks) total.typechecks[item.first] += item.second;
+  total.lookups += p.lookups;
+  total.maxDepth = std::max(total.maxDepth, p.maxDepth);
+  total.inherits += p.inherits;
+  total.lcas += p.lcas;
+  total.walks += p.walks;
+  total.walkSteps += p.walkSteps;
+  total.maxWalk = std::max(total.maxWalk, p.maxWalk);
+}
+
+static void print_counts(ostream& out, const SemantProfile& p) {
+  // by name, so that the report reads the same from run to run
+  std::map<std::string, long> typechecks;
+  for (const auto& item : p.typechecks) typechecks[item.first] += item.second;
+
+  out << "\"typecheck\": {";
+  const char* sep = "";
+  for (const auto& item : typechecks) {
+    out << sep << '"' << item.first << "\": " << item.second;
+    sep = ", ";
+  }
+  out << "}, \"lookups\": " << p.lookups
+      << ", \"max_scope_depth\": " << p.maxDepth
+      << ", \"inherits\": " << p.inherits
+      << ", \"lca\": " << p.lcas
+      << ", \"walks\": " << p.walks
+      << ", \"walk_steps\": " << p.walkSteps
+      << ", \"max_walk\": " << p.maxWalk;
+}
+
+static void print_profile(ostream& out, const std::vector<std::pair<const char*, double>>& phases,
+                          int cached, int dispatches, int monomorphic,
+                          const std::vector<ClassCheck>& checks, const SemantProfile& other) {
+  SemantProfile total;
+  add_profile(total, other);
+
+  out << "{\"phases\": {";
+  const char* sep = "";
+  for (const auto& phase : phases) {
+    out << sep << '"' << phase.first << "\": " << phase.second;
+    sep = ", ";
+  }
+  out << "},\n \"cached\": " << cached
+      << ",\n \"dispatches\": " << dispatches << ", \"monomorphic\": " << monomorphic
+      << ",\n \"classes\": [";
+
+  sep = "";
+  for (const auto& check : checks) {
+    const SemantProfile& p = *check.profile;
+    add_profile(total, p);
+
+    out << sep << "\n  {\"name\": ";
+    json_string(out, check.clazz->getName()->get_string());
+    out << ", \"file\": ";
+    json_string(out, check.clazz->get_filename()->get_string());
+    out << ", \"ms\": " << p.ms << ", \"methods\": [";
+    const char* msep = "";
+    for (const auto& method : p.methods) {
+      out << msep << "{\"name\": ";
+      json_string(out, method.first->get_string());
+      out << ", \"ms\": " << method.second << "}";
+      msep = ", ";
+    }
+    out << "], ";
+    print_counts(out, p);
+    out << "}";
+    sep = ",";
+  }
+
+  out << "],\n \"other\": {";
+  print_counts(out, other);
+  out << "},\n \"total\": {";
+  print_counts(out, total);
+  out << "}}" << endl;
+}
+
 void program_class::semant()
 {
     initialize_constants();
 
+    // with -s, the time each phase took, and the work outside classes
+    std::vector<std::pair<const char*, double>> phases;
+    std::vector<ClassCheck> checks;
+    std::vector<SemantProfile> profiles;
+    SemantProfile other;
+    int cached = 0, dispatches = 0, monomorphic = 0;
+    Instant start = std::chrono::steady_clock::now(), phase = start;
+    auto end_phase = [&](const char* name) {
+      Instant now = std::chrono::steady_clock::now();
+      phases.push_back(std::make_pair(name, std::chrono::duration<double, std::milli>(now - phase).count()));
+      phase = now;
+    };
+    if (semant_debug) class_profile = &other;
+
     /* ClassTable constructor may do some semantic analysis */
     ClassTable *classtable = new ClassTable(classes);
 
@@ -882,15 +1781,76 @@ void program_class::semant()
       }
     }
 
+    end_phase("classes");
+
     if (classtable->errors() == 0) {
-      SymTab symtab;
+      classtable->buildHierarchy(classes);
+      hierarchy = classtable->hierarchy();
+      end_phase("hierarchy");
+
+      SemantCache* cache = semant_cache ? new SemantCache(classtable) : nullptr;
+      if (cache) cache->read(semant_cache);
 
       for (int i = classes->first(); classes->more(i); i = classes->next(i)) {
-        classes->nth(i)->semant(classtable, symtab);
+        ClassCheck check;
+        check.clazz = classes->nth(i);
+        checks.push_back(std::move(check));
+      }
+
+      if (cache) {
+        // the classes are hashed and restored on the threads that would
+        // check them, each restored just after it is hashed, while its
+        // nodes are still in the cache
+        std::vector<SemantCache::Restored> restored(checks.size());
+        run_jobs(checks.size(), [&](std::atomic<size_t>& next) {
+          for (size_t i; (i = next.fetch_add(1)) < checks.size(); ) {
+            checks[i].key = tree_hash(checks[i].clazz, checks[i].exprs);
+            restored[i] = cache->restore(checks[i]);
+          }
+        });
+
+        std::vector<ClassCheck> left;
+        for (size_t i = 0; i < checks.size(); i++) {
+          cache->keep(checks[i], restored[i]);
+          if (restored[i] == SemantCache::RESTORED) {
+            cached++;
+          } else {
+            left.push_back(std::move(checks[i]));
+          }
+        }
+        checks = std::move(left);
+      }
+      end_phase("cache");
+
+      if (semant_debug) {
+        profiles.resize(checks.size());
+        for (size_t i = 0; i < checks.size(); i++) checks[i].profile = &profiles[i];
+      }
+
+      semant_classes(checks, classtable, cache != nullptr);
+      end_phase("check");
+
+      if (cache) {
+        for (auto& check : checks) {
+          if (check.errors == 0) cache->add(check);
+        }
+        cache->write(semant_cache);
+      }
+      end_phase("cache_write");
+
+      if (classtable->errors() == 0) {
+        dispatches = resolve_dispatches(classes, *hierarchy, &monomorphic);
+        end_phase("dispatch");
       }
     }
     /* some semantic analysis code may go here */
 
+    if (semant_debug) {
+      class_profile = NULL;
+      phases.push_back(std::make_pair("total", ms_since(start)));
+      print_profile(cerr, phases, cached, dispatches, monomorphic, checks, other);
+    }
+
     if (classtable->errors()) {
 	cerr << "Compilation halted due to static semantic errors." << endl;
 	exit(1);
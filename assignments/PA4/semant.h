@@ -2,10 +2,15 @@
 #define SEMANT_H_
 
 #include <assert.h>
+#include <atomic>
+#include <stdint.h>
 #include <iostream>
-#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include "cool-tree.h"
+#include "hierarchy.h"
 #include "stringtab.h"
+#include "symbolmap.h"
 #include "symtab.h"
 #include "list.h"
 
@@ -22,26 +27,45 @@ typedef ClassTable *ClassTableP;
 
 class ClassTable {
 private:
-  int semant_errors;
+  std::atomic<int> semant_errors;
   void install_basic_classes();
   ostream& error_stream;
-  std::unordered_map<Symbol, Symbol> parents_;
-  std::unordered_map<Symbol, std::unordered_map<Symbol, method_class*>> methods_;
-  std::unordered_map<Symbol, std::unordered_map<Symbol, Symbol>> attrs_;
+  DenseSymbolMap<Symbol> parents_;
+  DenseSymbolMap2<method_class*> methods_;   // by class and name
+  DenseSymbolMap2<Symbol> attrs_;            // by class and name
+
+  // The hierarchy, numbered and laid out by buildHierarchy once it is
+  // known to be a tree rooted at Object.  Until then, and for names that
+  // are not classes, inherits, lca and the lookups of members walk
+  // parents_.
+  Hierarchy* hierarchy_;
+  std::unordered_set<method_class*> badOverrides_;
+
+  // a hash of each class's name, members and ancestors, indexed like the
+  // classes of hierarchy_
+  std::vector<uint64_t> signature_;
+  int classId(Symbol name) const { return hierarchy_ ? hierarchy_->id(name) : -1; }
 
 public:
   ClassTable(Classes);
   void addInheritance(Symbol parent, Symbol child);
-  std::unordered_map<Symbol, Symbol>& parents() { return parents_; }
+  void buildHierarchy(Classes classes);
+  Hierarchy* hierarchy() const { return hierarchy_; }
+  DenseSymbolMap<Symbol>& parents() { return parents_; }
   bool inherits(Class_ curr, Symbol parent, Symbol child) const;
   method_class* getMethod(Symbol className, Symbol methodName);
   method_class* getInheritedMethod(Symbol className, Symbol methodName);
   Symbol getAttr(Symbol className, Symbol attrName);
   Symbol getInheritedAttr(Symbol className, Symbol attrName);
+  method_class* findMethod(Symbol className, Symbol methodName);
+  Symbol findAttr(Symbol className, Symbol attrName);
+  bool badOverride(method_class* m) const { return badOverrides_.count(m) != 0; }
   void addMethod(Symbol clazz, method_class* m);
   void addAttr(Symbol clazz, attr_class* attr);
   Symbol lca(Class_ curr, Symbol a, Symbol b);
   bool hasClass(Symbol name) const;
+  void depend(Symbol name) const;
+  uint64_t signature(Symbol name) const;
   int errors() { return semant_errors; }
   ostream& semant_error();
   ostream& semant_error(Class_ c);
@@ -0,0 +1,78 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  symtab_bench.cc
+//
+//  Compares SymbolTable and HashedSymbolTable on deeply nested scopes,
+//  the shape semant and cgen see for a chain of nested lets: each of
+//  `depth' scopes binds one new name, then the outermost name (the
+//  worst case for a search of the scope lists) is looked up repeatedly
+//  from the innermost scope, and finally every scope is exited.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <symtab.h>
+
+static const int LOOKUPS = 100000;
+
+static double seconds_since(clock_t start)
+{
+  return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+template <class Table>
+static void run(const char *name, int depth, char **names)
+{
+  Table map;
+  int value = 0;
+
+  clock_t start = clock();
+  for (int i = 0; i < depth; i++) {
+    map.enterscope();
+    map.addid(names[i], &value);
+  }
+  double enter = seconds_since(start);
+
+  start = clock();
+  for (int i = 0; i < LOOKUPS; i++)
+    if (map.lookup(names[0]) != &value || map.probe(names[0]) != NULL) {
+      cerr << name << ": wrong answer\n";
+      exit(1);
+    }
+  double lookup = seconds_since(start);
+
+  start = clock();
+  for (int i = 0; i < depth; i++)
+    map.exitscope();
+  double leave = seconds_since(start);
+
+  printf("%-18s depth %6d  enter+addid %8.1f ns  lookup %8.1f ns  exitscope %8.1f ns\n",
+	 name, depth, enter * 1e9 / depth, lookup * 1e9 / LOOKUPS,
+	 leave * 1e9 / depth);
+}
+
+int main(int argc, char *argv[])
+{
+  static const int depths[] = { 10, 100, 1000, 10000 };
+  int max_depth = depths[sizeof depths / sizeof depths[0] - 1];
+
+  char **names = new char *[max_depth];
+  for (int i = 0; i < max_depth; i++) {
+    names[i] = new char[16];
+    snprintf(names[i], 16, "v%d", i);
+  }
+
+  for (unsigned d = 0; d < sizeof depths / sizeof depths[0]; d++) {
+    run<SymbolTable<char *,int> >("SymbolTable", depths[d], names);
+    run<HashedSymbolTable<char *,int> >("HashedSymbolTable", depths[d], names);
+  }
+  return 0;
+}
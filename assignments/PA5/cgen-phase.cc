@@ -4,6 +4,8 @@
 #include "cool-io.h"  //includes iostream
 #include "cool-tree.h"
 #include "cgen_gc.h"
+#include "ast-binary.h"
+#include "hierarchy.h"
 
 extern int optind;            // for option processing
 extern char *out_filename;    // name of output assembly
@@ -12,7 +14,7 @@ FILE *ast_file = stdin;       // we read the AST from standard input
 extern int ast_yyparse(void); // entry point to the AST parser
 
 int cool_yydebug;     // not used, but needed to link with handle_flags
-char *curr_filename;
+thread_local char *curr_filename;
 
 void handle_flags(int argc, char *argv[]);
 
@@ -34,7 +36,11 @@ int main(int argc, char *argv[]) {
   // Don't touch the output file until we know that earlier phases of the
   // compiler have succeeded.
   //
-  ast_yyparse();
+  std::string hierarchy;
+  if ((ast_root = read_ast_binary(ast_file, &hierarchy)) == NULL)
+    ast_yyparse();
+  else if (!hierarchy.empty())
+    ast_root->hierarchy = Hierarchy::read(hierarchy, ast_root->get_classes());
 
   if (out_filename) {
       ofstream s(out_filename);
@@ -46,5 +52,6 @@ int main(int argc, char *argv[]) {
   } else {
       ast_root->cgen(cout);
   }
+  tree_node::release_all();
 }
 
@@ -21,23 +21,39 @@
 // fill in the rest.
 //
 //**************************************************************
-#include <unordered_map>
+#include <deque>
+#include <sstream>
+#include <string>
 #include <vector>
 #include <algorithm>
 #include <utility>
 
 #include "cgen.h"
+#include "walk.h"
 #include "cgen_gc.h"
+#include "optimize.h"
 
 extern void emit_string_constant(ostream& str, char *s);
 extern int cgen_debug;
+extern int cgen_optimize;
+extern bool disable_reg_alloc;
 
-static std::unordered_map<Symbol, std::unordered_map<Symbol, int>> methods{}, attrs{};
-static std::unordered_map<Symbol, std::unordered_map<Symbol, attr_class*>> nameToAttrs{};
-static std::unordered_map<Symbol, std::unordered_map<Symbol, Symbol>> methodToClass{};
-static std::unordered_map<Symbol, std::pair<int, int>> tags{};
-static SymbolTable<Symbol, const int> locals{};
-static CgenNodeP curr{};
+//
+// Where a formal, local or temporary is kept: in a register, if it was
+// given one (see CodeGen), and otherwise in its home, a stack slot (in
+// words from SP).
+//
+struct Location {
+  char *reg;
+  int home;
+  int id;           // its number in its method or initializer
+  bool raw;         // whether it holds an Int or Bool unboxed
+  int let;          // the let that binds it, if any, or -1
+};
+
+static Hierarchy *hierarchy{};
+static HashedSymbolTable<Symbol, Location> locals{};
+static Class_ curr{};   // the class being coded
 static int labelIndex{};
 
 //
@@ -149,7 +165,12 @@ void program_class::cgen(ostream &os)
   os << "# start of generated code\n";
 
   initialize_constants();
-  CgenClassTable *codegen_classtable = new CgenClassTable(classes,os);
+  // semant has laid out the classes, unless cgen runs by itself on a tree
+  // written without the layout
+  if (hierarchy == NULL) hierarchy = new Hierarchy(classes);
+  // before the constants are emitted, since folding makes new ones
+  if (cgen_optimize) optimize(classes, *hierarchy);
+  CgenClassTable *codegen_classtable = new CgenClassTable(classes,hierarchy,os);
 
   os << "\n# end of generated code\n";
 }
@@ -238,6 +259,18 @@ static void emit_sub(char *dest, char *src1, char *src2, ostream& s)
 static void emit_sll(char *dest, char *src1, int num, ostream& s)
 { s << SLL << dest << " " << src1 << " " << num << endl; }
 
+static void emit_slt(char *dest, char *src1, char *src2, ostream& s)
+{ s << SLT << dest << " " << src1 << " " << src2 << endl; }
+
+static void emit_sltiu(char *dest, char *src1, int imm, ostream& s)
+{ s << SLTIU << dest << " " << src1 << " " << imm << endl; }
+
+static void emit_xor(char *dest, char *src1, char *src2, ostream& s)
+{ s << XOR << dest << " " << src1 << " " << src2 << endl; }
+
+static void emit_xori(char *dest, char *src1, int imm, ostream& s)
+{ s << XORI << dest << " " << src1 << " " << imm << endl; }
+
 static void emit_jalr(char *dest, ostream& s)
 { s << JALR << "\t" << dest << endl; }
 
@@ -265,6 +298,9 @@ static void emit_protobj_ref(Symbol sym, ostream& s)
 static void emit_method_ref(Symbol classname, Symbol methodname, ostream& s)
 { s << classname << METHOD_SEP << methodname; }
 
+static void emit_jal_method(Symbol classname, Symbol methodname, ostream& s)
+{ s << JAL; emit_method_ref(classname, methodname, s); s << endl; }
+
 static void emit_label_def(int l, ostream &s)
 {
   emit_label_ref(l,s);
@@ -431,8 +467,8 @@ void StringEntry::code_def(ostream& s, int stringclasstag)
 //
 void StrTable::code_string_table(ostream& s, int stringclasstag)
 {  
-  for (List<StringEntry> *l = tbl; l; l = l->tl())
-    l->hd()->code_def(s,stringclasstag);
+  for (int i = index - 1; i >= 0; i--)
+    tbl[i]->code_def(s,stringclasstag);
 }
 
 //
@@ -472,8 +508,8 @@ void IntEntry::code_def(ostream &s, int intclasstag)
 //
 void IntTable::code_string_table(ostream &s, int intclasstag)
 {
-  for (List<IntEntry> *l = tbl; l; l = l->tl())
-    l->hd()->code_def(s,intclasstag);
+  for (int i = index - 1; i >= 0; i--)
+    tbl[i]->code_def(s,intclasstag);
 }
 
 
@@ -603,45 +639,14 @@ void CgenClassTable::code_select_gc()
   str << WORD << (cgen_Memmgr_Test == GC_TEST) << endl;
 }
 
-void attr_class::collect_info() {
-  auto clazz = curr->get_name();
-  int val = attrs[clazz].size();
-  attrs[clazz][name] = val;
-  nameToAttrs[clazz][name] = this;
+// the offset of an attribute of the class being coded in its objects
+static int attr_offset(Symbol name) {
+  return hierarchy->attrSlot(hierarchy->id(curr->get_name()), name) + 3;
 }
 
-void method_class::collect_info() {
-  auto clazz = curr->get_name();
-  auto& map = methods[clazz];
-  methodToClass[clazz][name] = clazz;
-  if (map.find(name) == map.end()) {
-    int val = map.size();
-    map[name] = val;
-  }
-}
-
-void class__class::collect_info() {
-  methods[name] = methods[parent];
-  attrs[name] = attrs[parent];
-  nameToAttrs[name] = nameToAttrs[parent];
-  methodToClass[name] = methodToClass[parent];
-
-  for (int i = features->first(); features->more(i); i = features->next(i)) {
-    features->nth(i)->collect_info();
-  }
-}
-
-int CgenClassTable::collect_info(CgenNodeP node, int id) {
-  curr = node;
-  node->collect_info();
-
-  int last = id;
-  for (auto it = node->get_children(); it; it = it->tl()) {
-    last = collect_info(it->hd(), last + 1);
-  }
-
-  tags[node->get_name()] = {id, last};
-  return last;
+// the slot of a method in the dispatch table of a class
+static int method_slot(Symbol clazz, Symbol name) {
+  return hierarchy->methodSlot(hierarchy->id(clazz), name);
 }
 
 //********************************************************
@@ -670,21 +675,19 @@ void CgenClassTable::code_constants()
   code_bools(boolclasstag);
 }
 
-CgenClassTable::CgenClassTable(Classes classes, ostream& s)
+CgenClassTable::CgenClassTable(Classes classes, Hierarchy *h, ostream& s)
 : nds(NULL),
   str(s)
 {
    enterscope();
    if (cgen_debug) cout << "Building CgenClassTable" << endl;
+   hierarchy = h;
    install_basic_classes();
    install_classes(classes);
-   build_inheritance_tree();
-
-  collect_info(root(), 0);
 
-  stringclasstag = tags[Str].first /* Change to your String class tag here */;
-  intclasstag =    tags[Int].first /* Change to your Int class tag here */;
-  boolclasstag =   tags[Bool].first /* Change to your Bool class tag here */;
+  stringclasstag = h->id(Str) /* Change to your String class tag here */;
+  intclasstag =    h->id(Int) /* Change to your Int class tag here */;
+  boolclasstag =   h->id(Bool) /* Change to your Bool class tag here */;
 
    code();
    exitscope();
@@ -715,101 +718,14 @@ void CgenClassTable::install_basic_classes()
 	new CgenNode(class_(prim_slot,No_class,nil_Features(),filename),
 			    Basic,this));
 
-// 
-// The Object class has no parent class. Its methods are
-//        cool_abort() : Object    aborts the program
-//        type_name() : Str        returns a string representation of class name
-//        copy() : SELF_TYPE       returns a copy of the object
-//
-// There is no need for method bodies in the basic classes---these
-// are already built in to the runtime system.
-//
-  install_class(
-   new CgenNode(
-    class_(Object, 
-	   No_class,
-	   append_Features(
-           append_Features(
-           single_Features(method(cool_abort, nil_Formals(), Object, no_expr())),
-           single_Features(method(type_name, nil_Formals(), Str, no_expr()))),
-           single_Features(method(copy, nil_Formals(), SELF_TYPE, no_expr()))),
-	   filename),
-    Basic,this));
-
-// 
-// The IO class inherits from Object. Its methods are
-//        out_string(Str) : SELF_TYPE          writes a string to the output
-//        out_int(Int) : SELF_TYPE               "    an int    "  "     "
-//        in_string() : Str                    reads a string from the input
-//        in_int() : Int                         "   an int     "  "     "
-//
-   install_class(
-    new CgenNode(
-     class_(IO, 
-            Object,
-            append_Features(
-            append_Features(
-            append_Features(
-            single_Features(method(out_string, single_Formals(formal(arg, Str)),
-                        SELF_TYPE, no_expr())),
-            single_Features(method(out_int, single_Formals(formal(arg, Int)),
-                        SELF_TYPE, no_expr()))),
-            single_Features(method(in_string, nil_Formals(), Str, no_expr()))),
-            single_Features(method(in_int, nil_Formals(), Int, no_expr()))),
-	   filename),	    
-    Basic,this));
-
-//
-// The Int class has no methods and only a single attribute, the
-// "val" for the integer. 
-//
-   install_class(
-    new CgenNode(
-     class_(Int, 
-	    Object,
-            single_Features(attr(val, prim_slot, no_expr())),
-	    filename),
-     Basic,this));
-
-//
-// Bool also has only the "val" slot.
-//
-    install_class(
-     new CgenNode(
-      class_(Bool, Object, single_Features(attr(val, prim_slot, no_expr())),filename),
-      Basic,this));
-
-//
-// The class Str has a number of slots and operations:
-//       val                                  ???
-//       str_field                            the string itself
-//       length() : Int                       length of the string
-//       concat(arg: Str) : Str               string concatenation
-//       substr(arg: Int, arg2: Int): Str     substring
-//       
-   install_class(
-    new CgenNode(
-      class_(Str, 
-	     Object,
-             append_Features(
-             append_Features(
-             append_Features(
-             append_Features(
-             single_Features(attr(val, Int, no_expr())),
-            single_Features(attr(str_field, prim_slot, no_expr()))),
-            single_Features(method(length, nil_Formals(), Int, no_expr()))),
-            single_Features(method(concat, 
-				   single_Formals(formal(arg, Str)),
-				   Str, 
-				   no_expr()))),
-	    single_Features(method(substr, 
-				   append_Formals(single_Formals(formal(arg, Int)), 
-						  single_Formals(formal(arg2, Int))),
-				   Str, 
-				   no_expr()))),
-	     filename),
-        Basic,this));
-
+//
+// The basic classes are those the hierarchy lays out (see hierarchy.h):
+// Object, IO, Int, Bool and String.  There is no need for method bodies
+// in them---these are already built in to the runtime system.
+//
+  Classes basic = basic_classes();
+  for (int i = basic->first(); basic->more(i); i = basic->next(i))
+    install_class(new CgenNode(basic->nth(i),Basic,this));
 }
 
 // CgenClassTable::install_class
@@ -838,40 +754,6 @@ void CgenClassTable::install_classes(Classes cs)
     install_class(new CgenNode(cs->nth(i),NotBasic,this));
 }
 
-//
-// CgenClassTable::build_inheritance_tree
-//
-void CgenClassTable::build_inheritance_tree()
-{
-  for(List<CgenNode> *l = nds; l; l = l->tl())
-      set_relations(l->hd());
-}
-
-//
-// CgenClassTable::set_relations
-//
-// Takes a CgenNode and locates its, and its parent's, inheritance nodes
-// via the class table.  Parent and child pointers are added as appropriate.
-//
-void CgenClassTable::set_relations(CgenNodeP nd)
-{
-  CgenNode *parent_node = probe(nd->get_parent());
-  nd->set_parentnd(parent_node);
-  parent_node->add_child(nd);
-}
-
-void CgenNode::add_child(CgenNodeP n)
-{
-  children = new List<CgenNode>(n,children);
-}
-
-void CgenNode::set_parentnd(CgenNodeP p)
-{
-  assert(parentnd == NULL);
-  assert(p != NULL);
-  parentnd = p;
-}
-
 void CgenClassTable::code_protoobjs() {
   for (auto node = nds; node; node = node->tl()) {
     auto clazz = node->hd()->get_name();
@@ -879,16 +761,13 @@ void CgenClassTable::code_protoobjs() {
 
     str << WORD << "-1" << endl;
     str << clazz << PROTOBJ_SUFFIX << ":" << endl;
-    str << WORD << tags[clazz].first << endl;
-    str << WORD << 3 + attrs[clazz].size() << endl;
+    int id = hierarchy->id(clazz);
+    str << WORD << id << endl;
+    str << WORD << 3 + hierarchy->attrs(id).size() << endl;
     str << WORD << clazz << DISPTAB_SUFFIX << endl;
 
-    std::vector<Symbol> types(attrs[clazz].size());
-    for (const auto& item : attrs[clazz]) {
-      types[item.second] = nameToAttrs[clazz][item.first]->type_decl;
-    }
-
-    for (auto type : types) {
+    for (const auto& attr : hierarchy->attrs(id)) {
+      auto type = attr.attr->getType();
       str << WORD;
 
       if (type == Int)
@@ -907,14 +786,9 @@ void CgenClassTable::code_protoobjs() {
 void CgenClassTable::code_nametab() {
   str << CLASSNAMETAB << ":" << endl;
 
-  std::vector<Symbol> classes(tags.size());
-  for (const auto& item : tags) {
-    classes[item.second.first] = item.first;
-  }
-
-  for (const auto& name : classes) {
+  for (int i = 0; i < hierarchy->size(); i++) {
     str << WORD;
-    stringtable.lookup_string(name->get_string())->code_ref(str);
+    stringtable.lookup_string(hierarchy->name(i)->get_string())->code_ref(str);
     str << endl;
   }
 }
@@ -922,29 +796,18 @@ void CgenClassTable::code_nametab() {
 void CgenClassTable::code_objtab() {
   str << CLASSOBJTAB << ":" << endl;
 
-  std::vector<Symbol> classes(tags.size());
-  for (const auto& item : tags) {
-    classes[item.second.first] = item.first;
-  }
-
-  for (const auto& name : classes) {
+  for (int i = 0; i < hierarchy->size(); i++) {
+    auto name = hierarchy->name(i);
     str << WORD << name << PROTOBJ_SUFFIX << endl;
     str << WORD << name << CLASSINIT_SUFFIX << endl;
   }
 }
 
 void CgenClassTable::code_disptables() {
-  for (const auto& item : methods) {
-    if (item.first == No_class) continue;
-    std::vector<Symbol> names(item.second.size());
-
-    for (const auto& method : item.second) {
-      names[method.second] = method.first;
-    }
-
-    str << item.first << DISPTAB_SUFFIX << ":" << endl;
-    for (const auto& name : names) {
-      str << WORD << methodToClass[item.first][name] << '.' << name << endl;
+  for (int i = 0; i < hierarchy->size(); i++) {
+    str << hierarchy->name(i) << DISPTAB_SUFFIX << ":" << endl;
+    for (const auto& method : hierarchy->methods(i)) {
+      str << WORD << hierarchy->name(method.clazz) << '.' << method.method->getName() << endl;
     }
   }
 }
@@ -975,7 +838,7 @@ void CgenClassTable::code()
 
   for (auto node = nds; node; node = node->tl()) {
     curr = node->hd();
-    curr->code(str);
+    node->hd()->code(str);
   }
 
 //                 Add your code to emit
@@ -986,12 +849,6 @@ void CgenClassTable::code()
 }
 
 
-CgenNodeP CgenClassTable::root()
-{
-   return probe(Object);
-}
-
-
 ///////////////////////////////////////////////////////////////////////
 //
 // CgenNode methods
@@ -1000,8 +857,6 @@ CgenNodeP CgenClassTable::root()
 
 CgenNode::CgenNode(Class_ nd, Basicness bstatus, CgenClassTableP ct) :
    class__class((const class__class &) *nd),
-   parentnd(NULL),
-   children(NULL),
    basic_status(bstatus)
 { 
    stringtable.add_string(name->get_string());          // Add class name to string table
@@ -1029,39 +884,514 @@ void emit_default_init(Symbol type, ostream& s) {
   }
 }
 
-void method_class::code_attr_init(ostream&) {}
+//
+// CodeGen codes an expression on a stack of frames (see walk.h), so
+// that it needs no more native stack for a deep tree than for a shallow
+// one.  The code goes to `s', except where an instruction branches to a
+// label that is only numbered once the code after it is done (an if
+// branches over its then arm to its else arm, whose label comes after
+// any in the then arm): there a hole is left in the code, to be filled
+// in when the label is known.  flush writes out the code, holes filled.
+//
+// A CodeGen codes a whole method (or initializer), and gives its slots,
+// the formals, locals and temporaries, registers.  The method is coded
+// twice.  The first time (plan) the code is thrown away: all that is
+// kept is where, in the order of the code, each slot is opened and used,
+// where the calls are and where loops begin and end.  allocate gives the
+// slots registers by linear scan over those intervals, and the second
+// time a slot with a register is kept in it rather than in its home.  A
+// slot live across the call of a method may only have one of $s1-$s6,
+// which the method saves and restores; one live across a call of the
+// runtime only (Object.copy, equality_test), which leaves $t5-$t8 alone
+// too, one of those; and any other may have $t0, $t4 or one of $t5-$t8.
+// With a garbage collector (-g), a call of the runtime may collect, and
+// the collector moves objects but updates only $s0-$s6 (MemMgr_REG_MASK),
+// so a slot live across one is kept as across the call of a method.
+// With -r nothing is planned, and every slot stays on the stack.
+//
+// An Int or Bool value may also be raw: the int itself, or 0 or 1,
+// rather than an object.  A node is coded for a raw value or for an
+// object as its parent asks (arithmetic, comparisons, not and the
+// predicates of if and while ask for raw ones; dispatch, attributes,
+// case, isvoid and the method's result, for objects), makes the value it
+// makes naturally, and converts it if the parent asked for the other:
+// boxing a raw Int copies Int_protObj.  The variable of a let of type
+// Int or Bool is kept raw if that looks cheaper.  That is decided in
+// the first pass (analyzing), which codes every such variable raw and
+// weighs its uses and assignments by the form they want (decide); if
+// some variable is to be boxed after all, the plan is made over again.
+//
+struct CodeGenFrame {
+  Expression node;
+  int step;
+  int top;          // the stack slot the node may use first
+  bool raw;         // whether a raw value is asked for
+  int i;            // the argument or branch it is at
+  int base;         // for a case, where its branches start in `cases'
+  int label;
+  int hole;
+  Location *slot;   // what it keeps while its second operand is coded
+};
+
+class CodeGen {
+  std::vector<std::string> code_;    // the code before each hole, and the holes
+
+  struct Interval {
+    int start, end;   // where the slot is opened and last used
+    int weight;       // its uses, each weighed by the loops it is in
+    int cost;         // what a register would cost it, in instructions
+    int loop;         // the outermost loop it is used in that began
+                      // after it was opened, or -1
+  };
+
+  bool planning_ = false;
+  int at_ = 0;                              // the events so far
+  int depth_ = 0;                           // the loops the code is in
+  std::vector<Interval> intervals_;         // by slot
+  std::vector<int> calls_;                  // of methods
+  std::vector<int> runtime_calls_;
+  std::vector<std::pair<int, int>> loops_;  // where each begins and ends
+  std::vector<int> open_loops_;             // those begun and not ended
+
+  std::deque<Location> slots_;
+  std::vector<char *> regs_;                // by slot, after allocate
+  std::vector<char *> saved_;               // the s registers used
+
+  // what the uses and assignments of the variable of a let would cost
+  // were it raw, and were it boxed
+  struct Var {
+    Symbol type;
+    int raw, boxed;
+  };
+
+  enum Form { EITHER, RAW, BOXED };
+
+  bool analyzing_ = false;
+  std::vector<Var> vars_;                   // by let, while analyzing
+  std::vector<bool> unboxed_;               // by let, after decide
+  int lets_ = 0;                            // those coded so far
+  Form made_ = EITHER;                      // the form the last value was made in
+
+  int weight();
+  void touch(Location *loc);
+  bool decide();
+  void allocate();
+  void restart();
+
+public:
+  std::ostringstream s;              // the code since the last hole
+  std::deque<CodeGenFrame> frames;
+  std::vector<Case> cases;           // the branches of each case being coded
+  std::vector<int> ends;             // the holes for their branches to the end
+  std::vector<Location *> args;      // the arguments of inlined calls being made
+
+  void code(Expression e, int top) {
+    walk(*this, frames, CodeGenFrame{e, 0, top, false});
+  }
+
+  bool visit(Expression e, int top, bool raw = false) {
+    frames.push_back(CodeGenFrame{e, 0, top, raw});
+    return true;
+  }
 
-void attr_class::code_attr_init(ostream& s) {
-  if (init->isNoExpr()) return;
-  init->code(s, 0);
-  emit_store(ACC, attrs[curr->get_name()][name] + 3, SELF, s);
+  // visits e for a value that is thrown away, raw if it may be
+  bool visit_for_effect(Expression e, int top) {
+    return visit(e, top, unboxable(e->get_type()));
+  }
+
+  int hole() {
+    code_.push_back(s.str());
+    code_.emplace_back();
+    s.str("");
+    return code_.size() - 1;
+  }
+
+  template <class Emit>
+  void fill(int hole, Emit emit) {
+    std::ostringstream code;
+    emit(code);
+    code_[hole] = code.str();
+  }
+
+  void flush(ostream& out) {
+    for (const auto& code : code_) out << code;
+    out << s.str();
+  }
+
+  // body codes the method; plan codes it to decide which variables are
+  // raw and to give its slots registers, and gives back the labels it
+  // numbered
+  template <class Body>
+  void plan(Body body) {
+    int label = labelIndex;
+    analyzing_ = true;
+    planning_ = !disable_reg_alloc;
+    body();
+    if (decide() && planning_) {
+      restart();
+      body();
+    }
+    if (planning_) allocate();
+    planning_ = false;
+    restart();
+    labelIndex = label;
+  }
+
+  // a new slot with its home at `home'; a register costs it `cost'
+  // instructions besides (a formal has to be loaded into its register)
+  Location *open(int home, int cost = 0);
+
+  void call() {
+    if (planning_) calls_.push_back(at_++);
+  }
+
+  void runtime_call() {
+    if (planning_) runtime_calls_.push_back(at_++);
+  }
+
+  void begin_loop() {
+    depth_++;
+    if (!planning_) return;
+    open_loops_.push_back(loops_.size());
+    loops_.emplace_back(at_++, 0);
+  }
+
+  void end_loop() {
+    depth_--;
+    if (!planning_) return;
+    loops_[open_loops_.back()].second = at_++;
+    open_loops_.pop_back();
+  }
+
+  // load copies a slot into reg, get gives the register a slot is in,
+  // loading it into `scratch' if it is on the stack, target the register
+  // a value for a slot is best made in, and put copies reg into a slot
+  void load(char *reg, Location *loc);
+  char *get(Location *loc, char *scratch);
+  char *target(Location *loc, char *scratch) { return loc->reg ? loc->reg : scratch; }
+  void put(Location *loc, char *reg);
+
+  // The register of e, if e is a local kept in one in the form asked
+  // for (never while planning, when every local is coded as if on the
+  // stack).  Such an operand is used where it is rather than coded:
+  // visit_operand skips it, and operand gives where an operand's value
+  // is once coded.
+  char *in_register(Expression e, bool raw) {
+    Symbol name = e->variable();
+    Location *loc = name && !planning_ ? locals.lookup(name) : NULL;
+    return loc && loc->raw == raw ? loc->reg : NULL;
+  }
+
+  bool visit_operand(Expression e, int top, bool raw = false) {
+    if (in_register(e, raw)) return true;
+    return visit(e, top, raw);
+  }
+
+  char *operand(Expression e, bool raw = false) {
+    char *reg = in_register(e, raw);
+    if (reg) return reg;
+    return ACC;
+  }
+
+  // The local e1 of a binary operator, if e2 has no subexpressions (and
+  // so cannot assign to it): then e1 need not be coded before e2 and kept
+  // in a slot meanwhile, and read_raw gives its int once e2 is done.
+  Location *local_operand(Expression e1, Expression e2) {
+    Symbol name = e1->variable();
+    Location *loc = name ? locals.lookup(name) : NULL;
+    if (!loc) return NULL;
+    std::vector<Expression *> children;
+    e2->children(children);
+    return children.empty() ? loc : NULL;
+  }
+
+  char *read_raw(Location *loc, char *scratch) {
+    use(loc, true);
+    char *reg = get(loc, scratch);
+    if (loc->raw) return reg;
+    emit_fetch_int(scratch, reg, s);
+    return scratch;
+  }
+
+  static bool unboxable(Symbol type) { return type == Int || type == Bool; }
+
+  // The let coded next binds a variable of type `type': let gives its
+  // number, or -1 if it may not be raw, and unboxed whether it is raw.
+  int let(Symbol type) {
+    if (!unboxable(type)) return -1;
+    if (analyzing_) vars_.push_back(Var{type, 0, 0});
+    return lets_++;
+  }
+
+  bool unboxed(int let) {
+    return let >= 0 && (analyzing_ || unboxed_[let]);
+  }
+
+  // a use of loc for a raw value or an object, and an assignment to it
+  // of the value just made
+  void use(Location *loc, bool raw);
+  void assign(Location *loc);
+
+  // ACC holds the value of f's node, raw if `raw': convert makes it the
+  // form f asks for, and made says that a constant was made in it
+  void convert(CodeGenFrame& f, bool raw);
+  void made() { made_ = EITHER; }
+  void box(Symbol type, int top);
+
+  int saved() { return saved_.size(); }
+
+  // The prologue and epilogue of a method or initializer: RA, SELF and
+  // the s registers it uses are saved below its arguments.
+  void enter() {
+    emit_store(RA, 0, SP, s);
+    emit_store(SELF, -1, SP, s);
+    for (int i = 0; i < saved(); i++) emit_store(saved_[i], -2 - i, SP, s);
+    emit_addiu(SP, SP, -(2 + saved()) * 4, s);
+    emit_move(SELF, ACC, s);
+  }
+
+  void leave(int formals) {
+    int k = saved();
+    for (int i = 0; i < k; i++) emit_load(saved_[i], k - i, SP, s);
+    emit_load(SELF, k + 1, SP, s);
+    emit_load(RA, k + 2, SP, s);
+    emit_addiu(SP, SP, (2 + k + formals) * 4, s);
+  }
+};
+
+Location *CodeGen::open(int home, int cost) {
+  int id = slots_.size();
+  char *reg = id < (int) regs_.size() ? regs_[id] : NULL;
+  slots_.push_back(Location{reg, home, id, false, -1});
+  if (planning_) intervals_.push_back(Interval{at_, at_, 0, cost, -1});
+  at_++;
+  return &slots_.back();
 }
 
-void attr_class::code_method_body(ostream&) {}
+// a use in a loop counts for ten outside it
+int CodeGen::weight() {
+  int weight = 1;
+  for (int i = 0; i < depth_ && weight < 10000; i++) weight *= 10;
+  return weight;
+}
 
-void method_class::code_method_body(ostream& s) {
-  s << curr->get_name() << '.' << name << ':' << endl;
-  emit_store(RA, 0, SP, s);
-  emit_store(SELF, -1, SP, s);
-  emit_addiu(SP, SP, -8, s);
-  emit_move(SELF, ACC, s);
-
-  std::unordered_map<Symbol, int> dummy;
-  for (int i = formals->first(), n = formals->len(), count = 0; formals->more(i); i = formals->next(i), count++) {
-    dummy[formals->nth(i)->getName()] = n - count + 2;
+void CodeGen::touch(Location *loc) {
+  if (!planning_) return;
+  Interval& iv = intervals_[loc->id];
+  iv.end = at_++;
+  iv.weight += weight();
+
+  // a slot used in a loop begun after it was opened is used again on
+  // the next time round, so it lives to the end of the loop
+  auto loop = std::upper_bound(open_loops_.begin(), open_loops_.end(), iv.start,
+                               [this](int start, int l) { return start < loops_[l].first; });
+  iv.loop = loop == open_loops_.end() ? -1 : *loop;
+}
+
+void CodeGen::load(char *reg, Location *loc) {
+  touch(loc);
+  if (loc->reg) {
+    emit_move(reg, loc->reg, s);
+  } else {
+    emit_load(reg, loc->home, SP, s);
   }
+}
 
-  locals.enterscope();
-  for (const auto& item : dummy) {
-    locals.addid(item.first, &item.second);
+char *CodeGen::get(Location *loc, char *scratch) {
+  if (!loc->reg) {
+    load(scratch, loc);
+    return scratch;
   }
+  touch(loc);
+  return loc->reg;
+}
 
-  expr->code(s, 0);
-  locals.exitscope();
-  emit_load(SELF, 1, SP, s);
-  emit_load(RA, 2, SP, s);
-  emit_addiu(SP, SP, (2 + formals->len()) * 4, s);
-  emit_return(s);
+void CodeGen::put(Location *loc, char *reg) {
+  touch(loc);
+  if (!loc->reg) {
+    emit_store(reg, loc->home, SP, s);
+  } else if (loc->reg != reg) {
+    emit_move(loc->reg, reg, s);
+  }
+}
+
+//
+// Boxing an Int allocates an object, which takes some 40 instructions;
+// unboxing one, or boxing a Bool, takes few.  A raw variable costs a box
+// for each use that wants an object, and an unboxing for each object
+// assigned to it; a boxed one, a box for each raw value assigned to it
+// and an unboxing for each use that wants a raw value.
+//
+void CodeGen::use(Location *loc, bool raw) {
+  if (!analyzing_ || loc->let < 0) return;
+  Var& var = vars_[loc->let];
+  int box = var.type == Int ? 40 : 4;
+  (raw ? var.boxed : var.raw) += (raw ? 1 : box) * weight();
+}
+
+void CodeGen::assign(Location *loc) {
+  if (!analyzing_ || loc->let < 0 || made_ == EITHER) return;
+  Var& var = vars_[loc->let];
+  int box = var.type == Int ? 40 : 4;
+  if (made_ == RAW) {
+    var.boxed += box * weight();
+  } else {
+    var.raw += weight();
+  }
+}
+
+// the variables cheaper raw are raw; returns whether any is not
+bool CodeGen::decide() {
+  analyzing_ = false;
+  unboxed_.clear();
+  bool boxed = false;
+  for (const Var& var : vars_) {
+    unboxed_.push_back(var.raw <= var.boxed);
+    boxed |= var.raw > var.boxed;
+  }
+  vars_.clear();
+  return boxed;
+}
+
+void CodeGen::convert(CodeGenFrame& f, bool raw) {
+  made_ = raw ? RAW : BOXED;
+  if (raw == f.raw) return;
+  if (raw) {
+    box(f.node->get_type(), f.top);
+  } else {
+    emit_fetch_int(ACC, ACC, s);
+  }
+}
+
+void CodeGen::box(Symbol type, int top) {
+  if (type == Bool) {
+    emit_move(T1, ACC, s);
+    emit_load_bool(ACC, falsebool, s);
+    emit_beqz(T1, labelIndex, s);
+    emit_load_bool(ACC, truebool, s);
+    emit_label_def(labelIndex++, s);
+    return;
+  }
+  Location *slot = open(top);
+  put(slot, ACC);
+  emit_load_address(ACC, "Int" PROTOBJ_SUFFIX, s);
+  emit_addiu(SP, SP, (top - 1) * 4, s);
+  emit_jal("Object.copy", s);
+  runtime_call();
+  emit_addiu(SP, SP, (-top + 1) * 4, s);
+  emit_store_int(get(slot, T1), ACC, s);
+}
+
+//
+// Linear scan: the slots are taken in the order they are opened, and
+// each gets a free register of those it may have, if it is used enough
+// to pay for it.  When none is free, it takes the one of the live slot
+// that lives longest, if that slot outlives it; a slot left without a
+// register stays in its home throughout.
+//
+void CodeGen::allocate() {
+  // a slot live across no call may have any of these, one live across a
+  // call of the runtime those from $t5, and one live across the call of
+  // a method, or of the runtime under a collector, those from $s1
+  static char *const regs[] = { T0, T4, T5, T6, T7, T8, S1, S2, S3, S4, S5, S6 };
+  const int REGS = sizeof regs / sizeof regs[0], KEPT = 2, SAVED = 6;
+  std::vector<int> holder(REGS, -1);     // the slot in each register
+  std::vector<int> reg(intervals_.size(), -1);
+
+  auto across = [](const std::vector<int>& calls, const Interval& iv) {
+    auto call = std::lower_bound(calls.begin(), calls.end(), iv.start);
+    return call != calls.end() && *call < iv.end;
+  };
+
+  for (int id = 0; id < (int) intervals_.size(); id++) {
+    Interval& iv = intervals_[id];
+    if (iv.loop >= 0) iv.end = std::max(iv.end, loops_[iv.loop].second);
+
+    int first = 0, cost = iv.cost;
+    bool collects = cgen_Memmgr != GC_NOGC;
+    if (across(calls_, iv) || (collects && across(runtime_calls_, iv))) {
+      first = SAVED;
+      cost += 2;                         // the register is saved and restored
+    } else if (across(runtime_calls_, iv)) {
+      first = KEPT;
+    }
+    if (iv.weight <= cost) continue;
+
+    int last = first < SAVED ? SAVED : REGS, pick = -1;
+    for (int r = first; r < last && pick < 0; r++) {
+      if (holder[r] >= 0 && intervals_[holder[r]].end < iv.start) holder[r] = -1;
+      if (holder[r] < 0) pick = r;
+    }
+    if (pick < 0) {
+      for (int r = first; r < last; r++) {
+        if (pick < 0 || intervals_[holder[r]].end > intervals_[holder[pick]].end) pick = r;
+      }
+      if (intervals_[holder[pick]].end <= iv.end) continue;
+      reg[holder[pick]] = -1;
+    }
+    holder[pick] = id;
+    reg[id] = pick;
+  }
+
+  regs_.assign(intervals_.size(), NULL);
+  std::vector<bool> used(REGS);
+  for (int id = 0; id < (int) reg.size(); id++) {
+    if (reg[id] < 0) continue;
+    regs_[id] = regs[reg[id]];
+    used[reg[id]] = true;
+  }
+  for (int r = SAVED; r < REGS; r++) {
+    if (used[r]) saved_.push_back(regs[r]);
+  }
+}
+
+// forgets the code of a pass and what it noted
+void CodeGen::restart() {
+  at_ = 0;
+  depth_ = 0;
+  lets_ = 0;
+  intervals_.clear();
+  calls_.clear();
+  runtime_calls_.clear();
+  loops_.clear();
+  open_loops_.clear();
+  slots_.clear();
+  code_.clear();
+  s.str("");
+}
+
+void method_class::code_attr_init(CodeGen&) {}
+
+void attr_class::code_attr_init(CodeGen& g) {
+  if (init->isNoExpr()) return;
+  g.code(init, 0);
+  emit_store(ACC, attr_offset(name), SELF, g.s);
+}
+
+void attr_class::code_method_body(ostream&) {}
+
+void method_class::code_method_body(ostream& s) {
+  CodeGen g;
+  int n = formals->len();
+  auto body = [&]() {
+    locals.enterscope();
+    int count = 0;
+    for (int i = formals->first(); formals->more(i); i = formals->next(i), count++) {
+      Location *loc = g.open(n - count + 2 + g.saved(), 1);
+      if (loc->reg) emit_load(loc->reg, loc->home, SP, g.s);
+      locals.addid(formals->nth(i)->getName(), loc);
+    }
+    g.code(expr, 0);
+    locals.exitscope();
+  };
+  g.plan(body);
+
+  s << curr->get_name() << '.' << name << ':' << endl;
+  g.enter();
+  body();
+  g.leave(n);
+  emit_return(g.s);
+  g.flush(s);
 }
 
 void CgenNode::code_initializer(ostream& s) {
@@ -1072,21 +1402,21 @@ void CgenNode::code_initializer(ostream& s) {
     return;
   }
 
-  emit_store(RA, 0, SP, s);
-  emit_store(SELF, -1, SP, s);
-  emit_addiu(SP, SP, -8, s);
-  emit_move(SELF, ACC, s);
-  s << JAL << parent << CLASSINIT_SUFFIX << endl;
-
-  for (int i = features->first(); features->more(i); i = features->next(i)) {
-    features->nth(i)->code_attr_init(s);
-  }
+  CodeGen g;
+  auto body = [&]() {
+    for (int i = features->first(); features->more(i); i = features->next(i)) {
+      features->nth(i)->code_attr_init(g);
+    }
+  };
+  g.plan(body);
 
-  emit_move(ACC, SELF, s);
-  emit_load(SELF, 1, SP, s);
-  emit_load(RA, 2, SP, s);
-  emit_addiu(SP, SP, 8, s);
-  emit_return(s);
+  g.enter();
+  g.s << JAL << parent << CLASSINIT_SUFFIX << endl;
+  body();
+  emit_move(ACC, SELF, g.s);
+  g.leave(0);
+  emit_return(g.s);
+  g.flush(s);
 }
 
 void CgenNode::code(ostream& s) {
@@ -1097,318 +1427,488 @@ void CgenNode::code(ostream& s) {
   }
 }
 
-void assign_class::code(ostream &s, int top) {
-  expr->code(s, top);
-  if (auto val = locals.lookup(name)) {
-    emit_store(ACC, *val, SP, s);
+bool assign_class::step(CodeGen& g, CodeGenFrame& f) {
+  Location *loc = locals.lookup(name);
+  bool raw = loc && loc->raw;
+  if (f.step++ == 0) return g.visit(expr, f.top, raw);
+
+  if (loc) {
+    g.assign(loc);
+    g.put(loc, ACC);
   } else {
-    emit_store(ACC, attrs[curr->get_name()][name] + 3, SELF, s);
+    emit_store(ACC, attr_offset(name), SELF, g.s);
   }
+  g.convert(f, raw);
+  return false;
 }
 
-void static_dispatch_class::code(ostream &s, int top) {
-  int count = 0;
-  for (int i = actual->first(); actual->more(i); i = actual->next(i), count++) {
-    actual->nth(i)->code(s, top - count);
-    emit_store(ACC, top - count, SP, s);
+//
+// A call the optimizer inlined (see optimize.h) keeps its arguments in
+// slots that become the method's formals, rather than in the slots the
+// method would find them in, and once the receiver is checked, codes the
+// method's body with the receiver in SELF.  The caller's self is kept
+// in a slot meanwhile (f.slot), and its class (f.label) is put back in
+// curr afterwards.
+//
+static void put_argument(CodeGen& g, CodeGenFrame& f, Expression arg, method_class *inlined) {
+  if (!inlined) {
+    emit_store(g.operand(arg), f.top - f.i, SP, g.s);
+    return;
   }
+  Location *loc = g.open(f.top - f.i);
+  g.put(loc, g.operand(arg));
+  g.args.push_back(loc);
+}
+
+static bool begin_inline(CodeGen& g, CodeGenFrame& f, method_class *method, int callee) {
+  int count = f.i;
+  f.slot = g.open(f.top - count);
+  g.put(f.slot, SELF);
+  emit_move(SELF, ACC, g.s);
+  f.label = hierarchy->id(curr->get_name());
+  curr = hierarchy->get(callee);
 
-  expr->code(s, top - count);
+  locals.enterscope();
+  for (const Hierarchy::Attr& a : hierarchy->attrs(callee))
+    locals.addid(a.attr->name, NULL);
+  Formals formals = method->formals;
+  for (int i = 0; i < count; i++)
+    locals.addid(formals->nth(i)->getName(), g.args[f.base + i]);
+  g.args.resize(f.base);
+  f.step = 3;
+  return g.visit(method->expr, f.top - count - 1, f.raw);
+}
+
+static void end_inline(CodeGen& g, CodeGenFrame& f) {
+  locals.exitscope();
+  curr = hierarchy->get(f.label);
+  g.load(SELF, f.slot);
+}
+
+bool static_dispatch_class::step(CodeGen& g, CodeGenFrame& f) {
+  ostream& s = g.s;
+  int top = f.top;
+  // at step 1, argument f.i is done
+  switch (f.step) {
+  case 3:
+    end_inline(g, f);
+    return false;
+  case 1:
+    put_argument(g, f, actual->nth(f.i), inlined);
+    f.i++;
+  case 0:
+    if (f.i == 0) f.base = g.args.size();
+    if (f.i < actual->len()) {
+      f.step = 1;
+      return g.visit_operand(actual->nth(f.i), top - f.i);
+    }
+    f.step = 2;
+    return g.visit(expr, top - f.i);
+  }
+
+  int count = f.i;
   emit_bne(ACC, ZERO, labelIndex, s);
   emit_load_string(ACC, stringtable.lookup_string(curr->get_filename()->get_string()), s);
   emit_load_imm(T1, get_line_number(), s);
   emit_jal("_dispatch_abort", s);
   emit_label_def(labelIndex++, s);
-  emit_partial_load_address(T1, s);
+  if (inlined) return begin_inline(g, f, inlined, callee);
+  // the method is the one in the class's dispatch table, called directly
   auto dispatchType = type_name == SELF_TYPE ? curr->get_name() : type_name;
-  s << dispatchType << DISPTAB_SUFFIX << endl;
-  emit_load(T1, methods[dispatchType][name], T1, s);
+  int clazz = hierarchy->id(dispatchType);
+  auto target = hierarchy->methods(clazz)[method_slot(dispatchType, name)];
   if (top != 0 || count != 0)
     emit_addiu(SP, SP, (top - count) * 4, s);
-  emit_jalr(T1, s);
+  emit_jal_method(hierarchy->name(target.clazz), name, s);
+  g.call();
   if (top != 0) emit_addiu(SP, SP, -top * 4, s);
-}
-
-void dispatch_class::code(ostream &s, int top) {
-  int count = 0;
-  for (int i = actual->first(); actual->more(i); i = actual->next(i), count++) {
-    actual->nth(i)->code(s, top - count);
-    emit_store(ACC, top - count, SP, s);
+  g.convert(f, false);
+  return false;
+}
+
+bool dispatch_class::step(CodeGen& g, CodeGenFrame& f) {
+  ostream& s = g.s;
+  int top = f.top;
+  // at step 1, argument f.i is done
+  switch (f.step) {
+  case 3:
+    end_inline(g, f);
+    return false;
+  case 1:
+    put_argument(g, f, actual->nth(f.i), inlined);
+    f.i++;
+  case 0:
+    if (f.i == 0) f.base = g.args.size();
+    if (f.i < actual->len()) {
+      f.step = 1;
+      return g.visit_operand(actual->nth(f.i), top - f.i);
+    }
+    f.step = 2;
+    return g.visit(expr, top - f.i);
   }
 
-  expr->code(s, top - count);
+  int count = f.i;
   emit_bne(ACC, ZERO, labelIndex, s);
   emit_load_string(ACC, stringtable.lookup_string(curr->get_filename()->get_string()), s);
   emit_load_imm(T1, get_line_number(), s);
   emit_jal("_dispatch_abort", s);
   emit_label_def(labelIndex++, s);
-  emit_load(T1, 2, ACC, s);
-  auto dispatchType = expr->get_type() == SELF_TYPE ? curr->get_name() : expr->get_type();
-  emit_load(T1, methods[dispatchType][name], T1, s);
+  if (inlined) return begin_inline(g, f, inlined, callee);
+  // a dispatch that can reach only one method calls it directly
+  bool direct = resolve(curr, *hierarchy) == 1;
+  if (!direct) {
+    emit_load(T1, 2, ACC, s);
+    auto dispatchType = expr->get_type() == SELF_TYPE ? curr->get_name() : expr->get_type();
+    emit_load(T1, method_slot(dispatchType, name), T1, s);
+  }
   if (top != 0 || count != 0)
     emit_addiu(SP, SP, (top - count) * 4, s);
-  emit_jalr(T1, s);
+  if (direct) {
+    emit_jal_method(targets[0], name, s);
+  } else {
+    emit_jalr(T1, s);
+  }
+  g.call();
   if (top != 0) emit_addiu(SP, SP, -top * 4, s);
-}
-
-void cond_class::code(ostream &s, int top) {
-  pred->code(s, top);
-  emit_fetch_int(ACC, ACC, s);
-
-  std::stringstream then, else_;
-  then_exp->code(then, top);
-  int elseLabel = labelIndex++;
-  else_exp->code(else_, top);
-
-  emit_beqz(ACC, elseLabel, s);
-  s << then.str();
-  emit_branch(labelIndex, s);
-  emit_label_def(elseLabel, s);
-  s << else_.str();
-  emit_label_def(labelIndex++, s);
-}
-
-void loop_class::code(ostream &s, int top) {
-  int start = labelIndex++;
-  emit_label_def(start, s);
-  pred->code(s, top);
-  emit_fetch_int(ACC, ACC, s);
+  g.convert(f, false);
+  return false;
+}
+
+bool cond_class::step(CodeGen& g, CodeGenFrame& f) {
+  ostream& s = g.s;
+  switch (f.step++) {
+  case 0:
+    return g.visit_operand(pred, f.top, true);
+  case 1:
+    f.hole = g.hole();                  // the branch to the else arm
+    return g.visit(then_exp, f.top, f.raw);
+  case 2: {
+    int elseLabel = labelIndex++;
+    char *p = g.operand(pred, true);
+    g.fill(f.hole, [=](ostream& s) { emit_beqz(p, elseLabel, s); });
+    f.hole = g.hole();                  // the branch to the end
+    emit_label_def(elseLabel, s);
+    return g.visit(else_exp, f.top, f.raw);
+  }
+  }
 
-  std::stringstream ss;
-  body->code(ss, top);
+  int end = labelIndex++;
+  g.fill(f.hole, [=](ostream& s) { emit_branch(end, s); });
+  emit_label_def(end, s);
+  return false;
+}
+
+bool loop_class::step(CodeGen& g, CodeGenFrame& f) {
+  ostream& s = g.s;
+  switch (f.step++) {
+  case 0:
+    g.begin_loop();
+    f.label = labelIndex++;
+    emit_label_def(f.label, s);
+    return g.visit_operand(pred, f.top, true);
+  case 1:
+    f.hole = g.hole();                  // the branch out of the loop
+    return g.visit_for_effect(body, f.top);
+  }
 
-  emit_beqz(ACC, labelIndex, s);
-  s << ss.str();
-  emit_branch(start, s);
-  emit_label_def(labelIndex++, s);
+  int end = labelIndex++;
+  char *p = g.operand(pred, true);
+  g.fill(f.hole, [=](ostream& s) { emit_beqz(p, end, s); });
+  emit_branch(f.label, s);
+  g.end_loop();
+  emit_label_def(end, s);
   emit_move(ACC, ZERO, s);
+  g.convert(f, false);
+  return false;
 }
 
-void typcase_class::code(ostream &s, int top) {
-  expr->code(s, top);
-  emit_bne(ACC, ZERO, labelIndex, s);
-  emit_load_string(ACC, stringtable.lookup_string(curr->get_filename()->get_string()), s);
-  emit_load_imm(T1, get_line_number(), s);
-  emit_jal("_case_abort2", s);
-  emit_label_def(labelIndex++, s);
-  emit_load(T1, 0, ACC, s);
+bool typcase_class::step(CodeGen& g, CodeGenFrame& f) {
+  ostream& s = g.s;
+  if (f.step == 0) {
+    f.step = 1;
+    return g.visit(expr, f.top);
+  }
 
-  std::vector<Case> branches;
-  for (int i = cases->first(); cases->more(i); i = cases->next(i)) {
-    branches.push_back(cases->nth(i));
+  if (f.step == 1) {
+    emit_bne(ACC, ZERO, labelIndex, s);
+    emit_load_string(ACC, stringtable.lookup_string(curr->get_filename()->get_string()), s);
+    emit_load_imm(T1, get_line_number(), s);
+    emit_jal("_case_abort2", s);
+    emit_label_def(labelIndex++, s);
+    emit_load(T1, 0, ACC, s);
+
+    f.base = f.i = g.cases.size();
+    for (int i = cases->first(); cases->more(i); i = cases->next(i)) {
+      g.cases.push_back(cases->nth(i));
+    }
+
+    std::sort(g.cases.begin() + f.base, g.cases.end(), [](const auto& a, const auto& b) {
+      return hierarchy->id(a->getType()) > hierarchy->id(b->getType()); // decreasing order
+    });
+  } else {
+    // the branch at f.i - 1 is done: it is entered only for the tags of
+    // its class and those below, and ends with a branch to the end
+    locals.exitscope();
+    int def = labelIndex++;
+    int tag = hierarchy->id(g.cases[f.i - 1]->getType());
+    g.fill(f.hole, [=](ostream& s) {
+      emit_blti(T1, tag, def, s);
+      emit_bgti(T1, hierarchy->last(tag), def, s);
+    });
+    g.ends.push_back(g.hole());
+    emit_label_def(def, s);
   }
 
-  std::sort(branches.begin(), branches.end(), [](const auto& a, const auto& b) {
-    const auto& x = tags[a->getType()];
-    const auto& y = tags[b->getType()];
-    return x.first > y.first; // decreasing order
-  });
+  // the branches of any case inside the last one are gone from g.cases
+  if (f.i < (int) g.cases.size()) {
+    auto branch = g.cases[f.i++];
+    f.step = 2;
+    f.hole = g.hole();
+    Location *loc = g.open(f.top);
+    g.put(loc, ACC);
+    locals.enterscope();
+    locals.addid(branch->getName(), loc);
+    return g.visit(branch->getExpr(), f.top - 1, f.raw);
+  }
 
-  // to ensure consistency of labelIndex
-  std::vector<std::stringstream> streams;
-  std::vector<int> defs;
-  for (auto branch : branches) {
-    std::stringstream ss;
-    streams.emplace_back();
+  int end = labelIndex++;
+  int branches = f.i - f.base;
+  for (size_t i = g.ends.size() - branches; i < g.ends.size(); i++) {
+    g.fill(g.ends[i], [=](ostream& s) { emit_branch(end, s); });
+  }
+  g.ends.resize(g.ends.size() - branches);
+  g.cases.resize(f.base);
 
+  emit_jal("_case_abort", s);
+  emit_label_def(end, s);
+  return false;
+}
+
+bool block_class::step(CodeGen& g, CodeGenFrame& f) {
+  if (f.i == body->len()) return false;
+  Expression e = body->nth(f.i++);
+  if (f.i < body->len()) return g.visit_for_effect(e, f.top);
+  return g.visit(e, f.top, f.raw);
+}
+
+bool let_class::step(CodeGen& g, CodeGenFrame& f) {
+  ostream& s = g.s;
+  switch (f.step++) {
+  case 0:
+    f.i = g.let(type_decl);
+    if (!init->isNoExpr()) return g.visit(init, f.top, g.unboxed(f.i));
+    if (g.unboxed(f.i)) {
+      emit_load_imm(ACC, 0, s);
+    } else {
+      emit_default_init(type_decl, s);
+    }
+    g.made();
+  case 1: {
+    Location *loc = g.open(f.top);
+    loc->raw = g.unboxed(f.i);
+    loc->let = f.i;
+    g.assign(loc);
+    g.put(loc, ACC);
     locals.enterscope();
-    locals.addid(branch->getName(), &top);
-    branch->getExpr()->code(ss, top - 1);
-    locals.exitscope();
+    locals.addid(identifier, loc);
+    f.step = 2;
+    return g.visit(body, f.top - 1, f.raw);
+  }
+  }
 
-    const auto& tag = tags[branch->getType()];
-    emit_blti(T1, tag.first, labelIndex, streams.back());
-    emit_bgti(T1, tag.second, labelIndex, streams.back());
-    emit_store(ACC, top, SP, streams.back());
-    streams.back() << ss.str();
-    defs.push_back(labelIndex++);
+  locals.exitscope();
+  return false;
+}
+
+//
+// The arithmetic operators keep the int of e1 in a slot at top while e2
+// is coded, unless e1 is a local that can be read afterwards.  A divisor
+// of zero aborts.
+//
+static bool arith_step(CodeGen& g, CodeGenFrame& f, Expression e1, Expression e2,
+                       void (*emit_op)(char *, char *, char *, ostream&),
+                       bool divide = false) {
+  ostream& s = g.s;
+  int top = f.top;
+  Location *local = g.local_operand(e1, e2);
+  switch (f.step++) {
+  case 0:
+    if (local) return true;
+    return g.visit_operand(e1, top, true);
+  case 1:
+    if (!local) {
+      f.slot = g.open(top);
+      g.put(f.slot, g.operand(e1, true));
+    }
+    return g.visit_operand(e2, top - 1, true);
   }
 
-  for (int i = 0, n = defs.size(); i < n; ++i) {
-    s << streams[i].str();
-    emit_branch(labelIndex, s);
-    emit_label_def(defs[i], s);
+  char *y = g.operand(e2, true);
+  if (divide) {
+    emit_bne(y, ZERO, labelIndex, s);
+    emit_load_address(ACC, "Int" PROTOBJ_SUFFIX, s);
+    emit_jal("Object.abort", s);
+    emit_label_def(labelIndex++, s);
   }
+  emit_op(ACC, local ? g.read_raw(local, T1) : g.get(f.slot, T1), y, s);
+  g.convert(f, true);
+  return false;
+}
 
-  emit_jal("_case_abort", s);
-  emit_label_def(labelIndex++, s);
+bool plus_class::step(CodeGen& g, CodeGenFrame& f) {
+  return arith_step(g, f, e1, e2, emit_add);
 }
 
-void block_class::code(ostream &s, int top) {
-  for (int i = body->first(); body->more(i); i = body->next(i)) {
-    body->nth(i)->code(s, top);
-  }
+bool sub_class::step(CodeGen& g, CodeGenFrame& f) {
+  return arith_step(g, f, e1, e2, emit_sub);
 }
 
-void let_class::code(ostream &s, int top) {
-  if (init->isNoExpr()) emit_default_init(type_decl, s);
-  else init->code(s, top);
-  emit_store(ACC, top, SP, s);
-  locals.enterscope();
-  locals.addid(identifier, &top);
-  body->code(s, top - 1);
-  locals.exitscope();
+bool mul_class::step(CodeGen& g, CodeGenFrame& f) {
+  return arith_step(g, f, e1, e2, emit_mul);
 }
 
-void plus_class::code(ostream &s, int top) {
-  e1->code(s, top);
-  emit_fetch_int(ACC, ACC, s);
-  emit_store(ACC, top, SP, s);
-  e2->code(s, top - 1);
-  emit_fetch_int(ACC, ACC, s);
-  emit_store(ACC, top - 1, SP, s);
-  emit_load_address(ACC, "Int" PROTOBJ_SUFFIX, s);
-  emit_addiu(SP, SP, (top - 2) * 4, s);
-  emit_jal("Object.copy", s);
-  emit_addiu(SP, SP, (-top + 2) * 4, s);
-  emit_load(T2, top - 1, SP, s);
-  emit_load(T1, top, SP, s);
-  emit_add(T1, T1, T2, s);
-  emit_store_int(T1, ACC, s);
-}
-
-void sub_class::code(ostream &s, int top) {
-  e1->code(s, top);
-  emit_fetch_int(ACC, ACC, s);
-  emit_store(ACC, top, SP, s);
-  e2->code(s, top - 1);
-  emit_fetch_int(ACC, ACC, s);
-  emit_store(ACC, top - 1, SP, s);
-  emit_load_address(ACC, "Int" PROTOBJ_SUFFIX, s);
-  emit_addiu(SP, SP, (top - 2) * 4, s);
-  emit_jal("Object.copy", s);
-  emit_addiu(SP, SP, (-top + 2) * 4, s);
-  emit_load(T2, top - 1, SP, s);
-  emit_load(T1, top, SP, s);
-  emit_sub(T1, T1, T2, s);
-  emit_store_int(T1, ACC, s);
-}
-
-void mul_class::code(ostream &s, int top) {
-  e1->code(s, top);
-  emit_fetch_int(ACC, ACC, s);
-  emit_store(ACC, top, SP, s);
-  e2->code(s, top - 1);
-  emit_fetch_int(ACC, ACC, s);
-  emit_store(ACC, top - 1, SP, s);
-  emit_load_address(ACC, "Int" PROTOBJ_SUFFIX, s);
-  emit_addiu(SP, SP, (top - 2) * 4, s);
-  emit_jal("Object.copy", s);
-  emit_addiu(SP, SP, (-top + 2) * 4, s);
-  emit_load(T2, top - 1, SP, s);
-  emit_load(T1, top, SP, s);
-  emit_mul(T1, T1, T2, s);
-  emit_store_int(T1, ACC, s);
-}
-
-void divide_class::code(ostream &s, int top) {
-  e1->code(s, top);
-  emit_fetch_int(ACC, ACC, s);
-  emit_store(ACC, top, SP, s);
-  e2->code(s, top - 1);
-  emit_fetch_int(T1, ACC, s);
-  emit_bne(T1, ZERO, labelIndex, s);
-  emit_jal("Object.abort", s);
-  emit_label_def(labelIndex++, s);
-  emit_store(T1, top - 1, SP, s);
-  emit_load_address(ACC, "Int" PROTOBJ_SUFFIX, s);
-  emit_addiu(SP, SP, (top - 2) * 4, s);
-  emit_jal("Object.copy", s);
-  emit_addiu(SP, SP, (-top + 2) * 4, s);
-  emit_load(T2, top - 1, SP, s);
-  emit_load(T1, top, SP, s);
-  emit_div(T1, T1, T2, s);
-  emit_store_int(T1, ACC, s);
-}
-
-void neg_class::code(ostream &s, int top) {
-  e1->code(s, top);
-  emit_fetch_int(ACC, ACC, s);
-  emit_neg(ACC, ACC, s);
-  emit_store(ACC, top, SP, s);
-  emit_load_address(ACC, "Int" PROTOBJ_SUFFIX, s);
-  emit_addiu(SP, SP, (top - 1) * 4, s);
-  emit_jal("Object.copy", s);
-  emit_addiu(SP, SP, (-top + 1) * 4, s);
-  emit_load(T1, top, SP, s);
-  emit_store_int(T1, ACC, s);
-}
-
-void lt_class::code(ostream &s, int top) {
-  e1->code(s, top);
-  emit_fetch_int(ACC, ACC, s);
-  emit_store(ACC, top, SP, s);
-  e2->code(s, top - 1);
-  emit_fetch_int(ACC, ACC, s);
-  emit_load(T1, top, SP, s);
-  emit_blt(T1, ACC, labelIndex, s);
-  emit_load_bool(ACC, falsebool, s);
-  emit_branch(labelIndex + 1, s);
-  emit_label_def(labelIndex++, s);
-  emit_load_bool(ACC, truebool, s);
-  emit_label_def(labelIndex++, s);
+bool divide_class::step(CodeGen& g, CodeGenFrame& f) {
+  return arith_step(g, f, e1, e2, emit_div, true);
 }
 
-void eq_class::code(ostream &s, int top) {
-  e1->code(s, top);
-  emit_store(ACC, top, SP, s);
-  e2->code(s, top - 1);
-  emit_load(T1, top, SP, s);
-  emit_move(T2, ACC, s);
+bool neg_class::step(CodeGen& g, CodeGenFrame& f) {
+  if (f.step++ == 0) return g.visit_operand(e1, f.top, true);
+
+  emit_neg(ACC, g.operand(e1, true), g.s);
+  g.convert(f, true);
+  return false;
+}
+
+//
+// < and <= keep the int of e1 as the arithmetic operators do, and make 1
+// or 0: x <= y is not y < x.
+//
+static bool compare_step(CodeGen& g, CodeGenFrame& f, Expression e1, Expression e2,
+                         bool or_equal) {
+  ostream& s = g.s;
+  int top = f.top;
+  Location *local = g.local_operand(e1, e2);
+  switch (f.step++) {
+  case 0:
+    if (local) return true;
+    return g.visit_operand(e1, top, true);
+  case 1:
+    if (!local) {
+      f.slot = g.open(top);
+      g.put(f.slot, g.operand(e1, true));
+    }
+    return g.visit_operand(e2, top - 1, true);
+  }
+
+  char *y = g.operand(e2, true);
+  char *x = local ? g.read_raw(local, T1) : g.get(f.slot, T1);
+  if (or_equal) {
+    emit_slt(ACC, y, x, s);
+    emit_xori(ACC, ACC, 1, s);
+  } else {
+    emit_slt(ACC, x, y, s);
+  }
+  g.convert(f, true);
+  return false;
+}
+
+bool lt_class::step(CodeGen& g, CodeGenFrame& f) {
+  return compare_step(g, f, e1, e2, false);
+}
+
+//
+// Ints and Bools are equal if their values are, which are compared raw;
+// other objects are compared by equality_test, unless they are the same.
+// Under -O an operand may have a narrower type than the other (see
+// optimize.h), so both must be known to be of the same kind to be raw.
+//
+bool eq_class::step(CodeGen& g, CodeGenFrame& f) {
+  ostream& s = g.s;
+  int top = f.top;
+  bool raw = CodeGen::unboxable(e1->get_type()) &&
+             e1->get_type() == e2->get_type();
+  Location *local = raw ? g.local_operand(e1, e2) : NULL;
+  switch (f.step++) {
+  case 0:
+    if (local) return true;
+    return g.visit_operand(e1, top, raw);
+  case 1:
+    if (!local) {
+      f.slot = g.open(top);
+      g.put(f.slot, g.operand(e1, raw));
+    }
+    return g.visit_operand(e2, top - 1, raw);
+  }
+
+  if (raw) {
+    char *y = g.operand(e2, true);
+    emit_xor(ACC, local ? g.read_raw(local, T1) : g.get(f.slot, T1), y, s);
+    emit_sltiu(ACC, ACC, 1, s);
+    g.convert(f, true);
+    return false;
+  }
+
+  g.load(T1, f.slot);
+  emit_move(T2, g.operand(e2), s);
   emit_load_bool(ACC, truebool, s);
   emit_beq(T1, T2, labelIndex, s);
   emit_load_bool(A1, falsebool, s);
   if (top != 0) emit_addiu(SP, SP, top * 4, s);
   emit_jal("equality_test", s);
+  g.runtime_call();
   if (top != 0) emit_addiu(SP, SP, -top * 4, s);
   emit_label_def(labelIndex++, s);
+  g.convert(f, false);
+  return false;
 }
 
-void leq_class::code(ostream &s, int top) {
-  e1->code(s, top);
-  emit_fetch_int(ACC, ACC, s);
-  emit_store(ACC, top, SP, s);
-  e2->code(s, top - 1);
-  emit_fetch_int(ACC, ACC, s);
-  emit_load(T1, top, SP, s);
-  emit_bleq(T1, ACC, labelIndex, s);
-  emit_load_bool(ACC, falsebool, s);
-  emit_branch(labelIndex + 1, s);
-  emit_label_def(labelIndex++, s);
-  emit_load_bool(ACC, truebool, s);
-  emit_label_def(labelIndex++, s);
+bool leq_class::step(CodeGen& g, CodeGenFrame& f) {
+  return compare_step(g, f, e1, e2, true);
 }
 
-void comp_class::code(ostream &s, int top) {
-  e1->code(s, top);
-  emit_fetch_int(ACC, ACC, s);
-  emit_beqz(ACC, labelIndex, s);
-  emit_load_bool(ACC, falsebool, s);
-  emit_branch(labelIndex + 1, s);
-  emit_label_def(labelIndex++, s);
-  emit_load_bool(ACC, truebool, s);
-  emit_label_def(labelIndex++, s);
+bool comp_class::step(CodeGen& g, CodeGenFrame& f) {
+  if (f.step++ == 0) return g.visit_operand(e1, f.top, true);
+
+  emit_xori(ACC, g.operand(e1, true), 1, g.s);
+  g.convert(f, true);
+  return false;
 }
 
-void int_const_class::code(ostream &s, int top)
+bool int_const_class::step(CodeGen& g, CodeGenFrame& f)
 {
-  //
-  // Need to be sure we have an IntEntry *, not an arbitrary Symbol
-  //
-  emit_load_int(ACC,inttable.lookup_string(token->get_string()),s);
+  if (f.raw) {
+    emit_load_imm(ACC, atoi(token->get_string()), g.s);
+  } else {
+    //
+    // Need to be sure we have an IntEntry *, not an arbitrary Symbol
+    //
+    emit_load_int(ACC,inttable.lookup_string(token->get_string()),g.s);
+  }
+  g.made();
+  return false;
 }
 
-void string_const_class::code(ostream &s, int top)
+bool string_const_class::step(CodeGen& g, CodeGenFrame& f)
 {
-  emit_load_string(ACC,stringtable.lookup_string(token->get_string()),s);
+  emit_load_string(ACC,stringtable.lookup_string(token->get_string()),g.s);
+  g.made();
+  return false;
 }
 
-void bool_const_class::code(ostream &s, int top)
+bool bool_const_class::step(CodeGen& g, CodeGenFrame& f)
 {
-  emit_load_bool(ACC, BoolConst(val), s);
+  if (f.raw) {
+    emit_load_imm(ACC, val, g.s);
+  } else {
+    emit_load_bool(ACC, BoolConst(val), g.s);
+  }
+  g.made();
+  return false;
 }
 
-void new__class::code(ostream &s, int top) {
+bool new__class::step(CodeGen& g, CodeGenFrame& f) {
+  ostream& s = g.s;
+  int top = f.top;
   if (type_name != SELF_TYPE) {
     s << LA << ACC << ' ' << type_name << PROTOBJ_SUFFIX << endl;
     if (top != 0) emit_addiu(SP, SP, top * 4, s);
@@ -1429,29 +1929,40 @@ void new__class::code(ostream &s, int top) {
     emit_load(S1, 1, SP, s);
     emit_addiu(SP, SP, (-top + 1) * 4, s);
   }
+  g.call();
+  g.convert(f, false);
+  return false;
 }
 
-void isvoid_class::code(ostream &s, int top) {
-  e1->code(s, top);
-  emit_beqz(ACC, labelIndex, s);
-  emit_load_bool(ACC, falsebool, s);
-  emit_branch(labelIndex + 1, s);
-  emit_label_def(labelIndex++, s);
-  emit_load_bool(ACC, truebool, s);
-  emit_label_def(labelIndex++, s);
+bool isvoid_class::step(CodeGen& g, CodeGenFrame& f) {
+  if (f.step++ == 0) return g.visit_operand(e1, f.top);
+
+  emit_sltiu(ACC, g.operand(e1), 1, g.s);
+  g.convert(f, true);
+  return false;
 }
 
-void no_expr_class::code(ostream &s, int top) {
+bool no_expr_class::step(CodeGen& g, CodeGenFrame& f) {
+  return false;
 }
 
-void object_class::code(ostream &s, int top) {
+bool object_class::step(CodeGen& g, CodeGenFrame& f) {
+  ostream& s = g.s;
   if (name == self) {
     emit_move(ACC, SELF, s);
-  } else if (auto val = locals.lookup(name)) {
-    emit_load(ACC, *val, SP, s);
+    g.convert(f, false);
+  } else if (auto loc = locals.lookup(name)) {
+    g.use(loc, f.raw);
+    if (f.raw && !loc->raw) {
+      emit_fetch_int(ACC, g.get(loc, ACC), s);
+      g.convert(f, true);
+    } else {
+      g.load(ACC, loc);
+      g.convert(f, loc->raw);
+    }
   } else {
-    emit_load(ACC, attrs[curr->get_name()][name] + 3, SELF, s);
+    emit_load(ACC, attr_offset(name), SELF, s);
+    g.convert(f, false);
   }
+  return false;
 }
-
-
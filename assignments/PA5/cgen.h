@@ -6,6 +6,7 @@
 #include <iostream>
 #include "emit.h"
 #include "cool-tree.h"
+#include "hierarchy.h"
 #include "symtab.h"
 
 enum Basicness     {Basic, NotBasic};
@@ -40,28 +41,21 @@ private:
    void code_objtab();
    void code_disptables();
 
-// The following creates an inheritance graph from
-// a list of classes.  The graph is implemented as
-// a tree of `CgenNode', and class names are placed
-// in the base class symbol table.
+// The following places the classes in the base class
+// symbol table; the inheritance graph, with the tags
+// and the layouts, is the hierarchy it is given.
 
    void install_basic_classes();
    void install_class(CgenNodeP nd);
    void install_classes(Classes cs);
-   void build_inheritance_tree();
-   void set_relations(CgenNodeP nd);
-   int collect_info(CgenNodeP, int);
 public:
-   CgenClassTable(Classes, ostream& str);
+   CgenClassTable(Classes, Hierarchy *, ostream& str);
    void code();
-   CgenNodeP root();
 };
 
 
 class CgenNode : public class__class {
 private: 
-   CgenNodeP parentnd;                        // Parent of class
-   List<CgenNode> *children;                  // Children of class
    Basicness basic_status;                    // `Basic' if class is basic
                                               // `NotBasic' otherwise
 
@@ -70,10 +64,6 @@ public:
             Basicness bstatus,
             CgenClassTableP class_table);
 
-   void add_child(CgenNodeP child);
-   List<CgenNode> *get_children() { return children; }
-   void set_parentnd(CgenNodeP p);
-   CgenNodeP get_parentnd() { return parentnd; }
    int basic() { return (basic_status == Basic); }
    void code(ostream&);
    void code_initializer(ostream&);
@@ -10,14 +10,23 @@
 
 //#include "cgen.h"
 #include "tree.h"
+#include "symtab.h"
+//#include "semant.h"
 #include "cool-tree.handcode.h"
 
+using SymTab = HashedSymbolTable<Symbol, Symbol>;
+class ClassTable;
+class Typecheck;
+struct TypecheckFrame;
+class TreeKey;
 
 // define the class for phylum
 // define simple phylum - Program
 typedef class Program_class *Program;
 
 class Program_class : public tree_node {
+protected:
+  virtual Class_ findClass(Symbol name) const = 0;
 public:
    tree_node *copy()		 { return copy_Program(); }
    virtual Program copy_Program() = 0;
@@ -33,8 +42,12 @@ typedef class Class__class *Class_;
 
 class Class__class : public tree_node {
 public:
-   tree_node *copy()		 { return copy_Class_(); }
-   virtual Class_ copy_Class_() = 0;
+  tree_node *copy()		 { return copy_Class_(); }
+  virtual Class_ copy_Class_() = 0;
+  virtual Symbol getName() const = 0;
+  virtual Symbol getParent() const = 0;
+  virtual void semant(ClassTable*, SymTab&) = 0;
+  virtual void declareFeatures(ClassTable*) = 0;
 
 #ifdef Class__EXTRAS
    Class__EXTRAS
@@ -49,6 +62,9 @@ class Feature_class : public tree_node {
 public:
    tree_node *copy()		 { return copy_Feature(); }
    virtual Feature copy_Feature() = 0;
+   virtual void declare(Class_, ClassTable*) = 0;
+   virtual void semant(Class_, ClassTable*, SymTab&) = 0;
+   virtual void key(TreeKey&) = 0;
 
 #ifdef Feature_EXTRAS
    Feature_EXTRAS
@@ -63,6 +79,9 @@ class Formal_class : public tree_node {
 public:
    tree_node *copy()		 { return copy_Formal(); }
    virtual Formal copy_Formal() = 0;
+   virtual Symbol getType() const = 0;
+   virtual Symbol getName() const = 0;
+   virtual void semant(Class_ clazz, ClassTable*, SymTab&) = 0;
 
 #ifdef Formal_EXTRAS
    Formal_EXTRAS
@@ -77,6 +96,9 @@ class Expression_class : public tree_node {
 public:
    tree_node *copy()		 { return copy_Expression(); }
    virtual Expression copy_Expression() = 0;
+   Symbol typecheck(Class_, ClassTable*, SymTab&);
+   virtual bool step(Typecheck&, TypecheckFrame&) = 0;
+   virtual void key(TreeKey&) = 0;
 
 #ifdef Expression_EXTRAS
    Expression_EXTRAS
@@ -91,6 +113,11 @@ class Case_class : public tree_node {
 public:
    tree_node *copy()		 { return copy_Case(); }
    virtual Case copy_Case() = 0;
+   virtual Symbol getType() const = 0;
+   // checks the type of the branch, and if it is a class, enters a scope
+   // with the branch's variable in it and returns the expression to check
+   virtual Expression typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) = 0;
+   virtual void key(TreeKey&) = 0;
 
 #ifdef Case_EXTRAS
    Case_EXTRAS
@@ -129,6 +156,7 @@ typedef Cases_class *Cases;
 class program_class : public Program_class {
 public:
    Classes classes;
+   Class_ findClass(Symbol name) const override;
 public:
    program_class(Classes a1) {
       classes = a1;
@@ -153,14 +181,26 @@ public:
    Features features;
    Symbol filename;
 public:
-   class__class(Symbol a1, Symbol a2, Features a3, Symbol a4) {
-      name = a1;
-      parent = a2;
-      features = a3;
-      filename = a4;
-   }
-   Class_ copy_Class_();
-   void dump(ostream& stream, int n);
+  class__class(Symbol a1, Symbol a2, Features a3, Symbol a4) {
+    name = a1;
+    parent = a2;
+    features = a3;
+    filename = a4;
+  }
+  Class_ copy_Class_();
+  void dump(ostream& stream, int n);
+
+  Symbol getName() const override {
+    return name;
+  }
+
+  Symbol getParent() const override {
+    return parent;
+  }
+
+  void semant(ClassTable*, SymTab&) override;
+
+  void declareFeatures(ClassTable*) override;
 
 #ifdef Class__SHARED_EXTRAS
    Class__SHARED_EXTRAS
@@ -187,6 +227,18 @@ public:
    }
    Feature copy_Feature();
    void dump(ostream& stream, int n);
+   void semant(
+     Class_ clazz,
+     ClassTable*,
+     SymTab&
+  ) override;
+
+  void declare(Class_, ClassTable*) override;
+  void key(TreeKey&) override;
+  bool checkInheritanceTypes(method_class* b);
+  Formals getFormals() { return formals; }
+  Symbol getRetType() { return return_type; }
+  Symbol getName() { return name; }
 
 #ifdef Feature_SHARED_EXTRAS
    Feature_SHARED_EXTRAS
@@ -211,6 +263,17 @@ public:
    }
    Feature copy_Feature();
    void dump(ostream& stream, int n);
+   void semant(
+     Class_,
+     ClassTable*,
+     SymTab&
+  ) override;
+
+  void declare(Class_, ClassTable*) override;
+  void key(TreeKey&) override;
+
+  Symbol getName() { return name; }
+  Symbol getType() { return type_decl; }
 
 #ifdef Feature_SHARED_EXTRAS
    Feature_SHARED_EXTRAS
@@ -234,6 +297,10 @@ public:
    Formal copy_Formal();
    void dump(ostream& stream, int n);
 
+   Symbol getType() const override { return type_decl; }
+   Symbol getName() const override { return name; }
+   void semant(Class_ clazz, ClassTable*, SymTab&) override;
+
 #ifdef Formal_SHARED_EXTRAS
    Formal_SHARED_EXTRAS
 #endif
@@ -257,6 +324,9 @@ public:
    }
    Case copy_Case();
    void dump(ostream& stream, int n);
+   Expression typecheck(Class_ clazz, ClassTable* table, SymTab& attrs) override;
+   void key(TreeKey&) override;
+   Symbol getType() const override { return type_decl; }
 
 #ifdef Case_SHARED_EXTRAS
    Case_SHARED_EXTRAS
@@ -279,6 +349,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -305,6 +377,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -326,9 +400,12 @@ public:
       expr = a1;
       name = a2;
       actual = a3;
+      owns_memory();
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -353,6 +430,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -375,6 +454,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -397,6 +478,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -417,6 +500,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -443,6 +528,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -465,6 +552,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -487,6 +576,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -509,6 +600,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -531,6 +624,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -551,6 +646,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -573,6 +670,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -595,6 +694,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -617,6 +718,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -637,6 +740,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -657,6 +762,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -677,6 +784,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -697,6 +806,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -717,6 +828,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -737,6 +850,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -755,6 +870,8 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
    bool isNoExpr() final { return true; }
 
 #ifdef Expression_SHARED_EXTRAS
@@ -776,6 +893,9 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
+   bool step(Typecheck&, TypecheckFrame&) override;
+   void key(TreeKey&) override;
+   Symbol variable() final { return name; }
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
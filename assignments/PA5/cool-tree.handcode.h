@@ -10,7 +10,7 @@
 #include "cool.h"
 #include "stringtab.h"
 #define yylineno curr_lineno;
-extern int yylineno;
+extern thread_local int yylineno;
 
 class CgenClassTable;
 
@@ -23,6 +23,14 @@ void dump_Symbol(ostream& stream, int padding, Symbol b);
 void assert_Symbol(Symbol b);
 Symbol copy_Symbol(Symbol b);
 
+class AstWriter;
+class TypedDump;
+struct TypedDumpFrame;
+class CodeGen;
+struct CodeGenFrame;
+class Optimizer;
+class Hierarchy;
+class method_class;
 class Program_class;
 typedef Program_class *Program;
 class Class__class;
@@ -48,82 +56,242 @@ typedef list_node<Case> Cases_class;
 typedef Cases_class *Cases;
 
 #define Program_EXTRAS                          \
+virtual void semant() = 0;			\
 virtual void cgen(ostream&) = 0;		\
-virtual void dump_with_types(ostream&, int) = 0; 
+virtual void dump_with_types(ostream&, int) = 0; \
+virtual void dump_binary(AstWriter&) = 0; \
+virtual Classes get_classes() = 0; \
+Hierarchy *hierarchy = NULL;   /* of the classes, once semant has built it */
 
 
 
 #define program_EXTRAS                          \
+void semant();     				\
 void cgen(ostream&);     			\
-void dump_with_types(ostream&, int);            
+void dump_with_types(ostream&, int); \
+void dump_binary(AstWriter&); \
+Classes get_classes() { return classes; }
 
 #define Class__EXTRAS                   \
+virtual Features get_features() = 0; \
 virtual Symbol get_name() = 0;  	\
 virtual Symbol get_parent() = 0;    	\
 virtual Symbol get_filename() = 0;      \
-virtual void collect_info() = 0; \
-virtual void dump_with_types(ostream&,int) = 0;
+virtual void dump_with_types(ostream&,int) = 0; \
+virtual void dump_binary(AstWriter&) = 0;
 
 
 #define class__EXTRAS                                  \
+Features get_features() { return features; } \
 Symbol get_name()   { return name; }		       \
 Symbol get_parent() { return parent; }     	       \
 Symbol get_filename() { return filename; }             \
-virtual void collect_info() override; \
-void dump_with_types(ostream&,int);
+void dump_with_types(ostream&,int); \
+void dump_binary(AstWriter&);
 
 
 #define Feature_EXTRAS                                        \
+virtual bool is_method() = 0; \
+virtual void children(std::vector<Expression *>&) = 0; \
 virtual void dump_with_types(ostream&,int) = 0; \
-virtual void collect_info() = 0; \
-virtual void code_attr_init(ostream&) = 0; \
+virtual void dump_binary(AstWriter&) = 0; \
+virtual void code_attr_init(CodeGen&) = 0; \
 virtual void code_method_body(ostream&) = 0;
 
 
 #define Feature_SHARED_EXTRAS                                       \
 void dump_with_types(ostream&,int);    \
-void collect_info() override; \
-void code_attr_init(ostream&) override; \
+void dump_binary(AstWriter&); \
+void code_attr_init(CodeGen&) override; \
 void code_method_body(ostream&) override;
 
+#define method_EXTRAS                        \
+bool is_method() override { return true; } \
+void children(std::vector<Expression *>& out) override { out.push_back(&expr); }
+
+
+#define attr_EXTRAS                          \
+bool is_method() override { return false; } \
+void children(std::vector<Expression *>& out) override { out.push_back(&init); }
+
 
 #define Formal_EXTRAS                              \
 virtual void dump_with_types(ostream&,int) = 0; \
+virtual void dump_binary(AstWriter&) = 0; \
 virtual Symbol getName() = 0;
 
 
 #define formal_EXTRAS                           \
 void dump_with_types(ostream&,int); \
+void dump_binary(AstWriter&); \
 Symbol getName() override { return name; }
 
 
+//
+// code, dump_with_types and typecheck walk the expression on a stack of
+// their own (see walk.h), so that they can handle trees of any depth;
+// step is the part of each node in one of those walks.  A branch is
+// handled by the walk of its case: dump_branch prints the branch up to
+// its expression, which it returns.
+//
 #define Case_EXTRAS                             \
-virtual void dump_with_types(ostream& ,int) = 0; \
+virtual void children(std::vector<Expression *>&) = 0; \
+virtual Expression dump_branch(ostream&, int) = 0; \
+virtual void dump_binary(AstWriter&) = 0; \
 virtual Symbol getType() = 0; \
 virtual Symbol getName() = 0; \
 virtual Expression getExpr() = 0;
 
 
 #define branch_EXTRAS                                   \
-void dump_with_types(ostream& ,int); \
+void children(std::vector<Expression *>& out) override { out.push_back(&expr); } \
+Expression dump_branch(ostream&, int); \
+void dump_binary(AstWriter&); \
 Symbol getType() override { return type_decl; } \
 Symbol getName() override { return name; } \
 Expression getExpr() override { return expr; }
 
 
+//
+// variable is the name an object expression refers to, and NULL for any
+// other expression: code uses a local that is in a register in place.
+//
+// fold is the part of each node in the optimizer (see optimize.h): it
+// returns the tree to put in the place of the node, whose subexpressions
+// are folded already, and enter is called before the optimizer goes into
+// the child-th of them.  constant gives the value of an Int or Bool
+// constant, assigned the name an assignment is to, pure says that the
+// expression neither does anything nor fails, and dispatches that it is
+// a call of a method.
+//
 #define Expression_EXTRAS                    \
 Symbol type;                                 \
 Symbol get_type() { return type; }           \
 Expression set_type(Symbol s) { type = s; return this; } \
-virtual void code(ostream&, int) = 0; \
-virtual void dump_with_types(ostream&,int) = 0;  \
+virtual void children(std::vector<Expression *>&) { } \
+virtual int resolve(Class_, const Hierarchy&) { return 0; } \
+virtual bool step(CodeGen&, CodeGenFrame&) = 0; \
+void dump_with_types(ostream&,int);  \
+virtual bool step(TypedDump&, TypedDumpFrame&) = 0; \
+virtual void dump_binary(AstWriter&) = 0; \
 void dump_type(ostream&, int);               \
 Expression_class() { type = (Symbol) NULL; } \
-virtual bool isNoExpr() { return false; }
+virtual bool isNoExpr() { return false; } \
+virtual Symbol variable() { return NULL; } \
+virtual Expression fold(Optimizer&) { return this; } \
+virtual void enter(Optimizer&, int) { } \
+virtual bool constant(int&) { return false; } \
+virtual Symbol assigned() { return NULL; } \
+virtual bool pure() { return false; } \
+virtual bool dispatches() { return false; }
 
 #define Expression_SHARED_EXTRAS           \
-void code(ostream&, int) override; 			   \
-void dump_with_types(ostream&,int);
+bool step(CodeGen&, CodeGenFrame&) override; \
+bool step(TypedDump&, TypedDumpFrame&) override; \
+void dump_binary(AstWriter&);
+
+//
+// children gives a pass the places of the subexpressions of a node, in
+// the order they are written, so that it can walk the tree without a
+// method of its own in every node, or put another tree in their place.
+//
+#define EXPRESSIONS_CHILDREN(list, out) \
+{ int n; Expression *e = list->elements(n); for (int i = 0; i < n; i++) out.push_back(e + i); }
+
+#define assign_EXTRAS \
+Symbol assigned() override { return name; } \
+void children(std::vector<Expression *>& out) override { out.push_back(&expr); }
+
+//
+// inlined is the method the optimizer chose to code in place of a call
+// (see optimize.h), and callee the number of its class.
+//
+#define CALL_EXTRAS \
+method_class *inlined = NULL; \
+int callee = -1; \
+Expression fold(Optimizer&) override; \
+bool dispatches() override { return true; }
+
+#define static_dispatch_EXTRAS \
+CALL_EXTRAS \
+void children(std::vector<Expression *>& out) override \
+  { out.push_back(&expr); EXPRESSIONS_CHILDREN(actual, out) }
+
+//
+// resolve gives a dispatch the classes whose methods it may reach, as
+// the class hierarchy analysis finds them (see hierarchy.h), and returns
+// how many there are: with one, the dispatch is monomorphic.  Since
+// targets holds memory of its own, a dispatch owns_memory (see tree.h).
+//
+#define dispatch_EXTRAS \
+std::vector<Symbol> targets; \
+int resolve(Class_, const Hierarchy&) override; \
+CALL_EXTRAS \
+void children(std::vector<Expression *>& out) override \
+  { out.push_back(&expr); EXPRESSIONS_CHILDREN(actual, out) }
+
+#define cond_EXTRAS \
+Expression fold(Optimizer&) override; \
+void children(std::vector<Expression *>& out) override \
+  { out.push_back(&pred); out.push_back(&then_exp); out.push_back(&else_exp); }
+
+#define loop_EXTRAS \
+Expression fold(Optimizer&) override; \
+bool pure() override; \
+void children(std::vector<Expression *>& out) override \
+  { out.push_back(&pred); out.push_back(&body); }
+
+#define typcase_EXTRAS \
+void enter(Optimizer&, int) override; \
+void children(std::vector<Expression *>& out) override \
+  { out.push_back(&expr); \
+    for (int i = cases->first(); cases->more(i); i = cases->next(i)) \
+      cases->nth(i)->children(out); }
+
+#define block_EXTRAS \
+Expression fold(Optimizer&) override; \
+void children(std::vector<Expression *>& out) override \
+  EXPRESSIONS_CHILDREN(body, out)
+
+#define let_EXTRAS \
+Expression fold(Optimizer&) override; \
+void enter(Optimizer&, int) override; \
+void children(std::vector<Expression *>& out) override \
+  { out.push_back(&init); out.push_back(&body); }
+
+#define BINARY_CHILDREN \
+void children(std::vector<Expression *>& out) override \
+  { out.push_back(&e1); out.push_back(&e2); }
+#define UNARY_CHILDREN \
+void children(std::vector<Expression *>& out) override { out.push_back(&e1); }
+
+#define FOLD Expression fold(Optimizer&) override;
+
+#define plus_EXTRAS BINARY_CHILDREN FOLD
+#define sub_EXTRAS BINARY_CHILDREN FOLD
+#define mul_EXTRAS BINARY_CHILDREN FOLD
+#define divide_EXTRAS BINARY_CHILDREN FOLD
+#define lt_EXTRAS BINARY_CHILDREN FOLD
+#define eq_EXTRAS BINARY_CHILDREN FOLD
+#define leq_EXTRAS BINARY_CHILDREN FOLD
+#define neg_EXTRAS UNARY_CHILDREN FOLD
+#define comp_EXTRAS UNARY_CHILDREN FOLD
+#define isvoid_EXTRAS UNARY_CHILDREN
+
+#define int_const_EXTRAS \
+bool constant(int&) override; \
+bool pure() override { return true; }
+
+#define bool_const_EXTRAS \
+bool constant(int& v) override { v = val; return true; } \
+bool pure() override { return true; }
+
+#define string_const_EXTRAS \
+bool pure() override { return true; }
+
+#define object_EXTRAS \
+Expression fold(Optimizer&) override; \
+bool pure() override { return true; }
 
 
 #endif
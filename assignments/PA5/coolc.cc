@@ -0,0 +1,302 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  coolc.cc
+//
+//  Runs every phase of the compiler in one process.  The lexer and
+//  parser (cool.flex and cool.y) build the tree, which is handed as it
+//  is to the semantic analyzer and then to the code generator, so the
+//  tree and the string tables are never printed and parsed again.
+//
+//  The flags are those of the phases, plus -time-phases, which reports
+//  on standard error the wall time and the number of allocations with
+//  operator new taken by each phase.  With -j, several files are lexed
+//  and parsed at once (see parse_parallel).
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>     // for getopt
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cool-io.h"    //includes iostream
+#include "cool-tree.h"
+#include "cool-parse.h"
+#include "utilities.h"
+#include "cool-scan.h"
+
+//
+// These globals keep everything working.
+//
+thread_local char *curr_filename = "<stdin>";
+thread_local FILE *fin;          // the lexer reads from this file
+thread_local int curr_lineno;    // of the last token read
+thread_local YYSTYPE cool_yylval; // the value of the last token read
+extern thread_local int node_lineno; // for the tree nodes being built
+
+extern int optind;               // for option processing
+extern char *out_filename;       // name of output assembly
+extern int jobs;                 // threads to use
+extern thread_local Classes parse_results; // the classes of the last file parsed
+extern thread_local Program ast_root;      // the AST produced by the parse
+extern thread_local int omerrs;  // a count of lex and parse errors
+extern thread_local std::vector<std::string> *parse_errors;
+
+extern int cool_yyparse();
+void handle_flags(int argc, char *argv[]);
+
+//
+// Every allocation with operator new is counted, so that -time-phases
+// can say how many each phase made.  Tree nodes come from a region, and
+// count once per chunk rather than once per node.
+//
+static std::atomic<unsigned long> allocations;
+
+void *operator new(size_t size)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void *p = malloc(size ? size : 1);
+  if (p == NULL)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+//
+// A PhaseTimer notes the time and the allocation count when it is
+// started, and reports the difference when it is stopped.
+//
+class PhaseTimer {
+private:
+  typedef std::chrono::steady_clock clock;
+  const char *name;
+  clock::time_point start;
+  unsigned long start_allocations;
+public:
+  static int enabled;
+  PhaseTimer(const char *n) : name(n), start(clock::now()),
+                              start_allocations(allocations) { }
+  void stop();
+};
+
+int PhaseTimer::enabled = 0;
+
+void PhaseTimer::stop()
+{
+  if (!enabled)
+    return;
+  double ms = std::chrono::duration<double, std::milli>(
+                clock::now() - start).count();
+  char buf[100];
+  snprintf(buf, sizeof buf, "%-8s %10.2f ms %10lu allocations\n",
+           name, ms, allocations - start_allocations);
+  cerr << buf;
+}
+
+//
+// parse runs the lexer and parser over each file in turn, and returns
+// all of their classes as one list.
+//
+static Classes parse_serial(int argc, char *argv[])
+{
+  Classes classes = nil_Classes();
+
+  for (int i = optind; i < argc; i++) {
+    fin = fopen(argv[i], "r");
+    if (fin == NULL) {
+      cerr << "Could not open input file " << argv[i] << endl;
+      exit(1);
+    }
+    curr_filename = argv[i];
+    curr_lineno = 1;
+    cool_yyrestart();
+    cool_yyparse();
+    fclose(fin);
+    if (parse_results != NULL)
+      classes = append_Classes(classes, parse_results);
+  }
+  return classes;
+}
+
+//
+// parse_parallel lexes and parses the files on jobs threads, each taking
+// the next file not yet started until there are none left.  The threads
+// share the string tables, and each has its own scanner, parser and
+// region of tree nodes; the hand-written scanner is used, as the flex one
+// cannot be shared.  Parse errors are kept until all the files are done.
+//
+// The results are then put together in the order of the files, so that
+// everything comes out as it would from parse_serial: the classes are
+// appended in turn, the errors are printed in turn, and the new string
+// table entries are numbered in the order in which parse_serial would
+// have added them.
+//
+struct ParsedFile {
+  char *name;
+  bool opened;
+  Classes classes;
+  int last_lineno;                     // node_lineno when done
+  std::vector<std::string> errors;     // as yyerror would print them
+  IdTable::View ids;                   // the symbols of the file
+  StrTable::View strings;
+  IntTable::View ints;
+};
+
+static void parse_files(std::vector<ParsedFile> *files,
+                        std::atomic<size_t> *next)
+{
+  size_t i;
+  while ((i = (*next)++) < files->size()) {
+    ParsedFile &f = (*files)[i];
+    if ((fin = fopen(f.name, "r")) == NULL)
+      continue;
+    f.opened = true;
+    idtable.use_view(&f.ids);
+    stringtable.use_view(&f.strings);
+    inttable.use_view(&f.ints);
+    parse_errors = &f.errors;
+    curr_filename = f.name;
+    curr_lineno = 1;
+    parse_results = NULL;
+    scan_yyrestart();
+    cool_yyparse();
+    fclose(fin);
+    f.classes = parse_results;
+    f.last_lineno = node_lineno;
+  }
+  idtable.use_view(NULL);
+  stringtable.use_view(NULL);
+  inttable.use_view(NULL);
+  parse_errors = NULL;
+  tree_node::keep_thread_nodes();
+}
+
+static Classes parse_parallel(int argc, char *argv[])
+{
+  std::vector<ParsedFile> files(argc - optind);
+  for (size_t i = 0; i < files.size(); i++) {
+    files[i].name = argv[optind + i];
+    files[i].opened = false;
+    files[i].classes = NULL;
+  }
+
+  fast_lex = 1;
+  idtable.share();
+  stringtable.share();
+  inttable.share();
+
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < jobs && i < (int) files.size(); i++)
+    threads.push_back(std::thread(parse_files, &files, &next));
+  for (std::thread &t : threads)
+    t.join();
+
+  std::vector<IdTable::View *> ids;
+  std::vector<StrTable::View *> strings;
+  std::vector<IntTable::View *> ints;
+  for (ParsedFile &f : files) {
+    ids.push_back(&f.ids);
+    strings.push_back(&f.strings);
+    ints.push_back(&f.ints);
+  }
+  idtable.unshare(ids);
+  stringtable.unshare(strings);
+  inttable.unshare(ints);
+
+  Classes classes = nil_Classes();
+  for (ParsedFile &f : files) {
+    if (!f.opened) {
+      cerr << "Could not open input file " << f.name << endl;
+      exit(1);
+    }
+    for (const std::string &error : f.errors) {
+      cerr << error;
+      if (++omerrs > 50) {
+        fprintf(stdout, "More than 50 errors\n");
+        exit(1);
+      }
+    }
+    if (f.classes != NULL)
+      classes = append_Classes(classes, f.classes);
+    node_lineno = f.last_lineno;
+  }
+  return classes;
+}
+
+int main(int argc, char *argv[]) {
+  //
+  // -time-phases is not a single letter flag, so take it out before
+  // getopt sees it.
+  //
+  int n = 1;
+  for (int i = 1; i < argc; i++)
+    if (strcmp(argv[i], "-time-phases") == 0)
+      PhaseTimer::enabled = 1;
+    else
+      argv[n++] = argv[i];
+  argc = n;
+  argv[argc] = NULL;
+
+  handle_flags(argc,argv);
+  if (optind >= argc) {
+    cerr << "usage: " << argv[0] << " [-time-phases] [flags] file.cl ...\n";
+    exit(1);
+  }
+
+  if (!out_filename) {   // no -o option
+    char *dot = strrchr(argv[optind], '.');
+    int len = dot ? dot - argv[optind] : strlen(argv[optind]);
+    out_filename = new char[len+3];
+    strncpy(out_filename, argv[optind], len);
+    strcpy(out_filename + len, ".s");
+  }
+
+  PhaseTimer total("total");
+
+  PhaseTimer parsing("parse");
+  Classes classes = jobs > 1 && argc - optind > 1 ? parse_parallel(argc, argv)
+                                                  : parse_serial(argc, argv);
+  if (omerrs != 0) {
+    cerr << "Compilation halted due to lex and parse errors\n";
+    exit(1);
+  }
+  if (argc - optind > 1)
+    ast_root = program(classes);
+  parsing.stop();
+
+  PhaseTimer checking("semant");
+  ast_root->semant();
+  checking.stop();
+
+  //
+  // Don't touch the output file until we know that earlier phases of the
+  // compiler have succeeded.
+  //
+  PhaseTimer generating("cgen");
+  ofstream s(out_filename);
+  if (!s) {
+    cerr << "Cannot open output file " << out_filename << endl;
+    exit(1);
+  }
+  ast_root->cgen(s);
+  s.close();
+  generating.stop();
+
+  tree_node::release_all();
+  total.stop();
+  return 0;
+}
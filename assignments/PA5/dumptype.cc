@@ -8,6 +8,7 @@
 #include "tree.h"
 #include "cool-tree.h"
 #include "utilities.h"
+#include "walk.h"
 
 // defined in stringtab.cc
 void dump_Symbol(ostream& stream, int padding, Symbol b); 
@@ -19,10 +20,9 @@ void dump_Boolean(ostream& stream, int padding, Boolean b);
 //
 //  dumptype.cc
 //
-//  dumptype defines a simple recursive traversal of the abstract
-//  syntax tree (AST) that prints each node and any associated
-//  type information.  Use dump_with_types to inspect the results of
-//  type inference.
+//  dumptype defines a simple traversal of the abstract syntax tree
+//  (AST) that prints each node and any associated type information.
+//  Use dump_with_types to inspect the results of type inference.
 //
 //  dump_with_types takes two argumenmts:
 //     an output stream
@@ -205,109 +205,173 @@ void formal_class::dump_with_types(ostream& stream, int n)
 }
 
 //
-// branch_class::dump_with_types dumps the name, type declaration,
-// and body of any case branch.
+// branch_class::dump_branch dumps the name and type declaration of a
+// case branch, and leaves its body to the caller.
 //
-void branch_class::dump_with_types(ostream& stream, int n)
+Expression branch_class::dump_branch(ostream& stream, int n)
 {
    dump_line(stream,n,this);
    stream << pad(n) << "_branch\n";
    dump_Symbol(stream, n+2, name);
    dump_Symbol(stream, n+2, type_decl);
-   expr->dump_with_types(stream, n+2);
+   return expr;
 }
 
 //
-// assign_class::dump_with_types prints "assign" and then (indented)
-// the variable being assigned, the expression, and finally the type
-// of the result.  Note the call to dump_type (see above) at the
-// end of the method.
+//  Expressions nest as deeply as the program says, so they are dumped
+//  on a stack of frames (see walk.h) rather than by recursion: the step
+//  of each node prints the node up to its next component expression and
+//  visits that, and once it has no more, finishes the node.
 //
-void assign_class::dump_with_types(ostream& stream, int n)
+struct TypedDumpFrame {
+   Expression node;
+   int step;
+   int n;          // the indentation
+   int i;          // the argument, expression or branch it is at
+};
+
+class TypedDump {
+public:
+   ostream& stream;
+   std::deque<TypedDumpFrame> frames;
+
+   TypedDump(ostream& stream) : stream(stream) { }
+   bool visit(Expression e, int n)
+     { frames.push_back(TypedDumpFrame{e, 0, n}); return true; }
+};
+
+void Expression_class::dump_with_types(ostream& stream, int n)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_assign\n";
-   dump_Symbol(stream, n+2, name);
-   expr->dump_with_types(stream, n+2);
+   TypedDump d(stream);
+   walk(d, d.frames, TypedDumpFrame{this, 0, n});
+}
+
+//
+// assign_class prints "assign" and then (indented) the variable being
+// assigned, the expression, and finally the type of the result.  Note
+// the call to dump_type (see above) at the end.
+//
+bool assign_class::step(TypedDump& d, TypedDumpFrame& f)
+{
+   ostream& stream = d.stream;
+   int n = f.n;
+   if (f.step++ == 0) {
+     dump_line(stream,n,this);
+     stream << pad(n) << "_assign\n";
+     dump_Symbol(stream, n+2, name);
+     return d.visit(expr, n+2);
+   }
    dump_type(stream,n);
+   return false;
 }
 
 //
-// static_dispatch_class::dump_with_types prints the expression,
-// static dispatch class, function name, and actual arguments
-// of any static dispatch.  
+// static_dispatch_class prints the expression, static dispatch class,
+// function name, and actual arguments of any static dispatch.
 //
-void static_dispatch_class::dump_with_types(ostream& stream, int n)
+bool static_dispatch_class::step(TypedDump& d, TypedDumpFrame& f)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_static_dispatch\n";
-   expr->dump_with_types(stream, n+2);
-   dump_Symbol(stream, n+2, type_name);
-   dump_Symbol(stream, n+2, name);
-   stream << pad(n+2) << "(\n";
-   for(int i = actual->first(); actual->more(i); i = actual->next(i))
-     actual->nth(i)->dump_with_types(stream, n+2);
+   ostream& stream = d.stream;
+   int n = f.n;
+   switch (f.step++) {
+   case 0:
+     dump_line(stream,n,this);
+     stream << pad(n) << "_static_dispatch\n";
+     return d.visit(expr, n+2);
+   case 1:
+     dump_Symbol(stream, n+2, type_name);
+     dump_Symbol(stream, n+2, name);
+     stream << pad(n+2) << "(\n";
+   }
+   if (f.i < actual->len())
+     return d.visit(actual->nth(f.i++), n+2);
    stream << pad(n+2) << ")\n";
    dump_type(stream,n);
+   return false;
 }
 
 //
-//   dispatch_class::dump_with_types is similar to 
-//   static_dispatch_class::dump_with_types 
+//   dispatch_class is similar to static_dispatch_class
 //
-void dispatch_class::dump_with_types(ostream& stream, int n)
+bool dispatch_class::step(TypedDump& d, TypedDumpFrame& f)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_dispatch\n";
-   expr->dump_with_types(stream, n+2);
-   dump_Symbol(stream, n+2, name);
-   stream << pad(n+2) << "(\n";
-   for(int i = actual->first(); actual->more(i); i = actual->next(i))
-     actual->nth(i)->dump_with_types(stream, n+2);
+   ostream& stream = d.stream;
+   int n = f.n;
+   switch (f.step++) {
+   case 0:
+     dump_line(stream,n,this);
+     stream << pad(n) << "_dispatch\n";
+     return d.visit(expr, n+2);
+   case 1:
+     dump_Symbol(stream, n+2, name);
+     stream << pad(n+2) << "(\n";
+   }
+   if (f.i < actual->len())
+     return d.visit(actual->nth(f.i++), n+2);
    stream << pad(n+2) << ")\n";
    dump_type(stream,n);
+   return false;
 }
 
 //
-// cond_class::dump_with_types dumps each of the three expressions
-// in the conditional and then the type of the entire expression.
+// cond_class dumps each of the three expressions in the conditional
+// and then the type of the entire expression.
 //
-void cond_class::dump_with_types(ostream& stream, int n)
+bool cond_class::step(TypedDump& d, TypedDumpFrame& f)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_cond\n";
-   pred->dump_with_types(stream, n+2);
-   then_exp->dump_with_types(stream, n+2);
-   else_exp->dump_with_types(stream, n+2);
+   ostream& stream = d.stream;
+   int n = f.n;
+   switch (f.step++) {
+   case 0:
+     dump_line(stream,n,this);
+     stream << pad(n) << "_cond\n";
+     return d.visit(pred, n+2);
+   case 1:
+     return d.visit(then_exp, n+2);
+   case 2:
+     return d.visit(else_exp, n+2);
+   }
    dump_type(stream,n);
+   return false;
 }
 
 //
-// loop_class::dump_with_types dumps the predicate and then the
-// body of the loop, and finally the type of the entire expression.
+// loop_class dumps the predicate and then the body of the loop, and
+// finally the type of the entire expression.
 //
-void loop_class::dump_with_types(ostream& stream, int n)
+bool loop_class::step(TypedDump& d, TypedDumpFrame& f)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_loop\n";
-   pred->dump_with_types(stream, n+2);
-   body->dump_with_types(stream, n+2);
+   ostream& stream = d.stream;
+   int n = f.n;
+   switch (f.step++) {
+   case 0:
+     dump_line(stream,n,this);
+     stream << pad(n) << "_loop\n";
+     return d.visit(pred, n+2);
+   case 1:
+     return d.visit(body, n+2);
+   }
    dump_type(stream,n);
+   return false;
 }
 
 //
-//  typcase_class::dump_with_types dumps each branch of the
-//  the Case_ one at a time.  The type of the entire expression
-//  is dumped at the end.
+//  typcase_class dumps each branch of the the Case_ one at a time.  The
+//  type of the entire expression is dumped at the end.
 //
-void typcase_class::dump_with_types(ostream& stream, int n)
+bool typcase_class::step(TypedDump& d, TypedDumpFrame& f)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_typcase\n";
-   expr->dump_with_types(stream, n+2);
-   for(int i = cases->first(); cases->more(i); i = cases->next(i))
-     cases->nth(i)->dump_with_types(stream, n+2);
+   ostream& stream = d.stream;
+   int n = f.n;
+   if (f.step++ == 0) {
+     dump_line(stream,n,this);
+     stream << pad(n) << "_typcase\n";
+     return d.visit(expr, n+2);
+   }
+   if (f.i < cases->len())
+     return d.visit(cases->nth(f.i++)->dump_branch(stream, n+2), n+4);
    dump_type(stream,n);
+   return false;
 }
 
 //
@@ -315,160 +379,143 @@ void typcase_class::dump_with_types(ostream& stream, int n)
 //  and introduce nothing that isn't already in the code discussed
 //  above.
 //
-void block_class::dump_with_types(ostream& stream, int n)
+bool block_class::step(TypedDump& d, TypedDumpFrame& f)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_block\n";
-   for(int i = body->first(); body->more(i); i = body->next(i))
-     body->nth(i)->dump_with_types(stream, n+2);
+   ostream& stream = d.stream;
+   int n = f.n;
+   if (f.step++ == 0) {
+     dump_line(stream,n,this);
+     stream << pad(n) << "_block\n";
+   }
+   if (f.i < body->len())
+     return d.visit(body->nth(f.i++), n+2);
    dump_type(stream,n);
-}
-
-void let_class::dump_with_types(ostream& stream, int n)
-{
-   dump_line(stream,n,this);
-   stream << pad(n) << "_let\n";
-   dump_Symbol(stream, n+2, identifier);
-   dump_Symbol(stream, n+2, type_decl);
-   init->dump_with_types(stream, n+2);
-   body->dump_with_types(stream, n+2);
+   return false;
+}
+
+bool let_class::step(TypedDump& d, TypedDumpFrame& f)
+{
+   ostream& stream = d.stream;
+   int n = f.n;
+   switch (f.step++) {
+   case 0:
+     dump_line(stream,n,this);
+     stream << pad(n) << "_let\n";
+     dump_Symbol(stream, n+2, identifier);
+     dump_Symbol(stream, n+2, type_decl);
+     return d.visit(init, n+2);
+   case 1:
+     return d.visit(body, n+2);
+   }
    dump_type(stream,n);
-}
-
-void plus_class::dump_with_types(ostream& stream, int n)
-{
-   dump_line(stream,n,this);
-   stream << pad(n) << "_plus\n";
-   e1->dump_with_types(stream, n+2);
-   e2->dump_with_types(stream, n+2);
-   dump_type(stream,n);
-}
-
-void sub_class::dump_with_types(ostream& stream, int n)
-{
-   dump_line(stream,n,this);
-   stream << pad(n) << "_sub\n";
-   e1->dump_with_types(stream, n+2);
-   e2->dump_with_types(stream, n+2);
-   dump_type(stream,n);
-}
-
-void mul_class::dump_with_types(ostream& stream, int n)
-{
-   dump_line(stream,n,this);
-   stream << pad(n) << "_mul\n";
-   e1->dump_with_types(stream, n+2);
-   e2->dump_with_types(stream, n+2);
-   dump_type(stream,n);
-}
-
-void divide_class::dump_with_types(ostream& stream, int n)
-{
-   dump_line(stream,n,this);
-   stream << pad(n) << "_divide\n";
-   e1->dump_with_types(stream, n+2);
-   e2->dump_with_types(stream, n+2);
-   dump_type(stream,n);
-}
-
-void neg_class::dump_with_types(ostream& stream, int n)
-{
-   dump_line(stream,n,this);
-   stream << pad(n) << "_neg\n";
-   e1->dump_with_types(stream, n+2);
-   dump_type(stream,n);
-}
-
-void lt_class::dump_with_types(ostream& stream, int n)
-{
-   dump_line(stream,n,this);
-   stream << pad(n) << "_lt\n";
-   e1->dump_with_types(stream, n+2);
-   e2->dump_with_types(stream, n+2);
-   dump_type(stream,n);
-}
-
-
-void eq_class::dump_with_types(ostream& stream, int n)
-{
-   dump_line(stream,n,this);
-   stream << pad(n) << "_eq\n";
-   e1->dump_with_types(stream, n+2);
-   e2->dump_with_types(stream, n+2);
-   dump_type(stream,n);
-}
-
-void leq_class::dump_with_types(ostream& stream, int n)
-{
-   dump_line(stream,n,this);
-   stream << pad(n) << "_leq\n";
-   e1->dump_with_types(stream, n+2);
-   e2->dump_with_types(stream, n+2);
-   dump_type(stream,n);
-}
-
-void comp_class::dump_with_types(ostream& stream, int n)
-{
-   dump_line(stream,n,this);
-   stream << pad(n) << "_comp\n";
-   e1->dump_with_types(stream, n+2);
-   dump_type(stream,n);
-}
-
-void int_const_class::dump_with_types(ostream& stream, int n)
-{
+   return false;
+}
+
+//
+// The binary and unary operators print their name, then their operands.
+//
+static bool dump_operator(TypedDump& d, TypedDumpFrame& f, const char *name,
+                          Expression e1, Expression e2)
+{
+   ostream& stream = d.stream;
+   int n = f.n;
+   switch (f.step++) {
+   case 0:
+     dump_line(stream,n,f.node);
+     stream << pad(n) << name << "\n";
+     return d.visit(e1, n+2);
+   case 1:
+     if (e2 != NULL)
+       return d.visit(e2, n+2);
+   }
+   f.node->dump_type(stream,n);
+   return false;
+}
+
+bool plus_class::step(TypedDump& d, TypedDumpFrame& f)
+  { return dump_operator(d, f, "_plus", e1, e2); }
+bool sub_class::step(TypedDump& d, TypedDumpFrame& f)
+  { return dump_operator(d, f, "_sub", e1, e2); }
+bool mul_class::step(TypedDump& d, TypedDumpFrame& f)
+  { return dump_operator(d, f, "_mul", e1, e2); }
+bool divide_class::step(TypedDump& d, TypedDumpFrame& f)
+  { return dump_operator(d, f, "_divide", e1, e2); }
+bool neg_class::step(TypedDump& d, TypedDumpFrame& f)
+  { return dump_operator(d, f, "_neg", e1, NULL); }
+bool lt_class::step(TypedDump& d, TypedDumpFrame& f)
+  { return dump_operator(d, f, "_lt", e1, e2); }
+bool eq_class::step(TypedDump& d, TypedDumpFrame& f)
+  { return dump_operator(d, f, "_eq", e1, e2); }
+bool leq_class::step(TypedDump& d, TypedDumpFrame& f)
+  { return dump_operator(d, f, "_leq", e1, e2); }
+bool comp_class::step(TypedDump& d, TypedDumpFrame& f)
+  { return dump_operator(d, f, "_comp", e1, NULL); }
+bool isvoid_class::step(TypedDump& d, TypedDumpFrame& f)
+  { return dump_operator(d, f, "_isvoid", e1, NULL); }
+
+bool int_const_class::step(TypedDump& d, TypedDumpFrame& f)
+{
+   ostream& stream = d.stream;
+   int n = f.n;
    dump_line(stream,n,this);
    stream << pad(n) << "_int\n";
    dump_Symbol(stream, n+2, token);
    dump_type(stream,n);
+   return false;
 }
 
-void bool_const_class::dump_with_types(ostream& stream, int n)
+bool bool_const_class::step(TypedDump& d, TypedDumpFrame& f)
 {
+   ostream& stream = d.stream;
+   int n = f.n;
    dump_line(stream,n,this);
    stream << pad(n) << "_bool\n";
    dump_Boolean(stream, n+2, val);
    dump_type(stream,n);
+   return false;
 }
 
-void string_const_class::dump_with_types(ostream& stream, int n)
+bool string_const_class::step(TypedDump& d, TypedDumpFrame& f)
 {
+   ostream& stream = d.stream;
+   int n = f.n;
    dump_line(stream,n,this);
    stream << pad(n) << "_string\n";
    stream << pad(n+2) << "\"";
    print_escaped_string(stream,token->get_string());
    stream << "\"\n";
    dump_type(stream,n);
+   return false;
 }
 
-void new__class::dump_with_types(ostream& stream, int n)
+bool new__class::step(TypedDump& d, TypedDumpFrame& f)
 {
+   ostream& stream = d.stream;
+   int n = f.n;
    dump_line(stream,n,this);
    stream << pad(n) << "_new\n";
    dump_Symbol(stream, n+2, type_name);
    dump_type(stream,n);
+   return false;
 }
 
-void isvoid_class::dump_with_types(ostream& stream, int n)
-{
-   dump_line(stream,n,this);
-   stream << pad(n) << "_isvoid\n";
-   e1->dump_with_types(stream, n+2);
-   dump_type(stream,n);
-}
-
-void no_expr_class::dump_with_types(ostream& stream, int n)
+bool no_expr_class::step(TypedDump& d, TypedDumpFrame& f)
 {
+   ostream& stream = d.stream;
+   int n = f.n;
    dump_line(stream,n,this);
    stream << pad(n) << "_no_expr\n";
    dump_type(stream,n);
+   return false;
 }
 
-void object_class::dump_with_types(ostream& stream, int n)
+bool object_class::step(TypedDump& d, TypedDumpFrame& f)
 {
+   ostream& stream = d.stream;
+   int n = f.n;
    dump_line(stream,n,this);
    stream << pad(n) << "_object\n";
    dump_Symbol(stream, n+2, name);
    dump_type(stream,n);
+   return false;
 }
-
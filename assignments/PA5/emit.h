@@ -69,9 +69,20 @@
 #define A1   "$a1"		// For arguments to prim funcs 
 #define SELF "$s0"		// Ptr to self (callee saves) 
 #define S1   "$s1"
+#define S2   "$s2"		// S1-S6 and T0, T4-T8 hold
+#define S3   "$s3"		// locals and temporaries
+#define S4   "$s4"		// (see CodeGen::allocate)
+#define S5   "$s5"
+#define S6   "$s6"
+#define T0   "$t0"
 #define T1   "$t1"		// Temporary 1 
 #define T2   "$t2"		// Temporary 2 
 #define T3   "$t3"		// Temporary 3 
+#define T4   "$t4"
+#define T5   "$t5"
+#define T6   "$t6"
+#define T7   "$t7"
+#define T8   "$t8"
 #define SP   "$sp"		// Stack pointer 
 #define FP   "$fp"		// Frame pointer 
 #define RA   "$ra"		// Return address 
@@ -98,6 +109,10 @@
 #define MUL   "\tmul\t"
 #define SUB   "\tsub\t"
 #define SLL   "\tsll\t"
+#define SLT   "\tslt\t"
+#define SLTIU "\tsltiu\t"
+#define XOR   "\txor\t"
+#define XORI  "\txori\t"
 #define BEQZ  "\tbeqz\t"
 #define BRANCH   "\tb\t"
 #define BEQ      "\tbeq\t"
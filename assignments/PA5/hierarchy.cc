@@ -0,0 +1 @@
+../PA4/hierarchy.cc
\ No newline at end of file
@@ -0,0 +1 @@
+../PA4/hierarchy.h
\ No newline at end of file
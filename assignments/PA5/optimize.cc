@@ -0,0 +1,341 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  optimize.cc
+//
+//  Constant folding and propagation and the choice of the calls to
+//  inline, on the typed tree, which cgen runs under -O (see optimize.h).
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <limits.h>
+#include <stdlib.h>
+#include "optimize.h"
+
+extern Symbol Bool, Int, No_type, SELF_TYPE;
+
+void optimize(Classes classes, const Hierarchy& hierarchy)
+{
+  Optimizer optimizer(hierarchy);
+  for (int i = classes->first(); classes->more(i); i = classes->next(i)) {
+    Class_ c = classes->nth(i);
+    Features features = c->get_features();
+    for (int j = features->first(); features->more(j); j = features->next(j))
+      optimizer.optimize(c, features->nth(j));
+  }
+}
+
+void Optimizer::optimize(Class_ c, Feature feature)
+{
+  clazz = c;
+  // the names assigned to anywhere in the feature, which no let of the
+  // same name may propagate
+  assigned_.clear();
+  std::vector<Expression *> work;
+  feature->children(work);
+  while (!work.empty()) {
+    Expression e = *work.back();
+    work.pop_back();
+    if (Symbol name = e->assigned())
+      assigned_[name] = true;
+    e->children(work);
+  }
+
+  feature->children(work);
+  for (Expression *place : work)
+    fold(place);
+}
+
+void Optimizer::visit(Expression *place)
+{
+  size_t first = places_.size();
+  (*place)->children(places_);
+  frames_.push_back(Frame{place, first, first, places_.size(), scope_.size()});
+}
+
+// takes the variables that came into scope since there were `scope' out
+void Optimizer::leave(size_t scope)
+{
+  while (scope_.size() > scope) {
+    bound_[scope_.back()].pop_back();
+    scope_.pop_back();
+  }
+}
+
+void Optimizer::fold(Expression *root)
+{
+  visit(root);
+  while (!frames_.empty()) {
+    Frame& f = frames_.back();
+    leave(f.scope);
+    if (f.next < f.end) {
+      Expression *child = places_[f.next];
+      (*f.place)->enter(*this, f.next++ - f.first);
+      visit(child);
+    } else {
+      places_.resize(f.first);
+      *f.place = (*f.place)->fold(*this);
+      frames_.pop_back();
+    }
+  }
+}
+
+void Optimizer::bind(Symbol name, Expression value)
+{
+  bound_[name].push_back(value);
+  scope_.push_back(name);
+}
+
+Expression Optimizer::lookup(Symbol name)
+{
+  auto it = bound_.find(name);
+  if (it == bound_.end() || it->second.empty())
+    return NULL;
+  return it->second.back();
+}
+
+bool Optimizer::propagates(Symbol name, Symbol type, Expression init)
+{
+  int v;
+  return init->get_type() == type && init->constant(v) &&
+         !assigned_.count(name);
+}
+
+// a method of a basic class has no body in the tree: the runtime has
+// its code
+bool Optimizer::inlines(const Hierarchy::Method& m)
+{
+  if (m.method->expr->isNoExpr())
+    return false;
+  int size = 0;
+  std::vector<Expression *> work;
+  work.push_back(&m.method->expr);
+  while (!work.empty()) {
+    Expression e = *work.back();
+    work.pop_back();
+    if (++size > INLINE_SIZE || e->dispatches())
+      return false;
+    e->children(work);
+  }
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  Folding
+//
+//////////////////////////////////////////////////////////////////////////
+
+// a new constant of type `type' (Int or Bool), on the line of `at'
+static Expression make_constant(Symbol type, int v, tree_node *at)
+{
+  Expression e = type == Int ? int_const(inttable.add_int(v)) : bool_const(v);
+  e->set(at);
+  return e->set_type(type);
+}
+
+// whether e is a constant of type `type', and if so, its value
+static bool value(Expression e, Symbol type, int& v)
+{
+  return e->get_type() == type && e->constant(v);
+}
+
+// the constant of the Int v, or node if v overflows, which the
+// instruction node is coded with traps on
+static Expression int_result(Expression node, long long v)
+{
+  if (v < INT_MIN || v > INT_MAX)
+    return node;
+  return make_constant(Int, (int) v, node);
+}
+
+// literals too large for an int are left to the assembler
+bool int_const_class::constant(int& v)
+{
+  char *end;
+  long long n = strtoll(token->get_string(), &end, 10);
+  if (*end != '\0' || n > INT_MAX)
+    return false;
+  v = (int) n;
+  return true;
+}
+
+Expression object_class::fold(Optimizer& o)
+{
+  Expression c = o.lookup(name);
+  int v;
+  if (c == NULL || !c->constant(v))
+    return this;
+  return make_constant(c->get_type(), v, this);
+}
+
+Expression plus_class::fold(Optimizer&)
+{
+  int a, b;
+  if (!value(e1, Int, a) || !value(e2, Int, b))
+    return this;
+  return int_result(this, (long long) a + b);
+}
+
+Expression sub_class::fold(Optimizer&)
+{
+  int a, b;
+  if (!value(e1, Int, a) || !value(e2, Int, b))
+    return this;
+  return int_result(this, (long long) a - b);
+}
+
+// mul wraps around rather than trapping
+Expression mul_class::fold(Optimizer&)
+{
+  int a, b;
+  if (!value(e1, Int, a) || !value(e2, Int, b))
+    return this;
+  return make_constant(Int, (int) ((unsigned) a * (unsigned) b), this);
+}
+
+// a division by zero aborts, and one of the least Int by -1 is left to
+// the machine
+Expression divide_class::fold(Optimizer&)
+{
+  int a, b;
+  if (!value(e1, Int, a) || !value(e2, Int, b) || b == 0 ||
+      (a == INT_MIN && b == -1))
+    return this;
+  return make_constant(Int, a / b, this);
+}
+
+Expression neg_class::fold(Optimizer&)
+{
+  int a;
+  if (!value(e1, Int, a))
+    return this;
+  return int_result(this, -(long long) a);
+}
+
+Expression lt_class::fold(Optimizer&)
+{
+  int a, b;
+  if (!value(e1, Int, a) || !value(e2, Int, b))
+    return this;
+  return make_constant(Bool, a < b, this);
+}
+
+Expression leq_class::fold(Optimizer&)
+{
+  int a, b;
+  if (!value(e1, Int, a) || !value(e2, Int, b))
+    return this;
+  return make_constant(Bool, a <= b, this);
+}
+
+Expression eq_class::fold(Optimizer&)
+{
+  int a, b;
+  if ((value(e1, Int, a) && value(e2, Int, b)) ||
+      (value(e1, Bool, a) && value(e2, Bool, b)))
+    return make_constant(Bool, a == b, this);
+  return this;
+}
+
+Expression comp_class::fold(Optimizer&)
+{
+  int a;
+  if (!value(e1, Bool, a))
+    return this;
+  return make_constant(Bool, !a, this);
+}
+
+Expression cond_class::fold(Optimizer&)
+{
+  int p;
+  if (!value(pred, Bool, p))
+    return this;
+  return p ? then_exp : else_exp;
+}
+
+// a loop that is never entered is left to yield its void
+Expression loop_class::fold(Optimizer&)
+{
+  if (pure() && !body->isNoExpr())
+    body = no_expr()->set_type(No_type);
+  return this;
+}
+
+bool loop_class::pure()
+{
+  int p;
+  return value(pred, Bool, p) && !p;
+}
+
+Expression block_class::fold(Optimizer&)
+{
+  int n, kept = 0;
+  Expression *e = body->elements(n);
+  for (int i = 0; i < n; i++)
+    if (i == n - 1 || !e[i]->pure())
+      kept++;
+  if (kept == 1)
+    return e[n - 1];
+  if (kept < n) {
+    Expressions rest = nil_Expressions();
+    for (int i = 0; i < n; i++)
+      if (i == n - 1 || !e[i]->pure())
+        rest = append_Expressions(rest, single_Expressions(e[i]));
+    body = rest;
+  }
+  return this;
+}
+
+void let_class::enter(Optimizer& o, int child)
+{
+  if (child == 1)
+    o.bind(identifier, o.propagates(identifier, type_decl, init) ? init : NULL);
+}
+
+Expression let_class::fold(Optimizer& o)
+{
+  return o.propagates(identifier, type_decl, init) ? body : this;
+}
+
+void typcase_class::enter(Optimizer& o, int child)
+{
+  if (child > 0)
+    o.bind(cases->nth(child - 1)->getName(), NULL);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  Inlining
+//
+//////////////////////////////////////////////////////////////////////////
+
+Expression static_dispatch_class::fold(Optimizer& o)
+{
+  int c = o.hierarchy.id(type_name);
+  const Hierarchy::Method& m = o.hierarchy.methods(c)[o.hierarchy.methodSlot(c, name)];
+  if (o.inlines(m)) {
+    inlined = m.method;
+    callee = m.clazz;
+  }
+  return this;
+}
+
+Expression dispatch_class::fold(Optimizer& o)
+{
+  Symbol type = expr->get_type();
+  int receiver = o.hierarchy.id(type == SELF_TYPE ? o.clazz->get_name() : type);
+  if (receiver < 0)
+    return this;
+  std::vector<Hierarchy::Method> methods = o.hierarchy.targets(receiver, name);
+  if (methods.size() == 1 && o.inlines(methods[0])) {
+    inlined = methods[0].method;
+    callee = methods[0].clazz;
+  }
+  return this;
+}
@@ -0,0 +1,102 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+#ifndef _OPTIMIZE_H_
+#define _OPTIMIZE_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  optimize.h
+//
+//  What cgen does to the typed tree under -O before it codes it.
+//
+//  The optimizer folds each feature's expression bottom up, putting in
+//  the place of each node what the node's fold returns, once the node's
+//  subexpressions are folded:
+//
+//     - arithmetic, comparisons, `not' and `~' of Int and Bool constants
+//       become constants, except where the operation would fail at run
+//       time (division by zero, or a sum, difference or negation that
+//       overflows, which traps);
+//     - a let whose variable is given a constant of its own type and is
+//       never assigned becomes its body, with the constant in the place
+//       of each use of the variable;
+//     - an if with a constant predicate becomes the branch it takes;
+//     - a loop whose predicate is false loses its body, and a block
+//       drops the expressions before its last that do nothing (pure
+//       ones, and such loops);
+//     - a call that can reach only one method (see hierarchy.h) is
+//       marked to be inlined, if the method's body is small (no more
+//       than INLINE_SIZE nodes) and calls no method itself.
+//
+//  cgen codes an inlined call as it does any other up to the jump: the
+//  arguments are made, in order, then the receiver, which is checked for
+//  void.  The arguments are kept in slots of the caller that are the
+//  method's formals, and the body is coded in place, with self the
+//  receiver and the attributes of the method's class in scope over any
+//  variables of the caller of the same names.  Since the body calls no
+//  method, inlining goes no deeper than the one call.
+//
+//  A folded node may have a narrower type than the node it replaces (an
+//  if becomes one of its branches), which is still a type the node's
+//  parent can use.  The constants made are added to inttable, so that
+//  code_constants emits them.
+//
+//  Like the other passes, the optimizer keeps its place in the tree on
+//  a stack of its own, so it handles trees of any depth.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <utility>
+#include <vector>
+#include "cool-tree.h"
+#include "hierarchy.h"
+#include "symbolmap.h"
+
+// the most nodes the body of a method inlined may have
+const int INLINE_SIZE = 10;
+
+class Optimizer {
+  struct Frame {
+    Expression *place;      // where the node is in the tree
+    size_t first, next;     // its children in places_, and the next to fold
+    size_t end;
+    size_t scope;           // the size of scope_ when it was visited
+  };
+  std::vector<Frame> frames_;
+  std::vector<Expression *> places_;
+
+  // the variables in scope, innermost last, and for each name the
+  // constants that are put in the place of its uses, or NULL where the
+  // name is a variable of another kind
+  std::vector<Symbol> scope_;
+  DenseSymbolMap<std::vector<Expression>> bound_;
+  DenseSymbolMap<bool> assigned_;   // the names the feature assigns to
+
+  void visit(Expression *place);
+  void leave(size_t scope);
+  void fold(Expression *root);
+
+public:
+  const Hierarchy& hierarchy;
+  Class_ clazz;                     // the class being optimized
+
+  Optimizer(const Hierarchy& h) : hierarchy(h), clazz(NULL) { }
+  void optimize(Class_ c, Feature feature);
+
+  // name is in scope from here on, its uses to be given `value'
+  void bind(Symbol name, Expression value);
+  // the constant a use of name is given, or NULL
+  Expression lookup(Symbol name);
+  // whether a let of name, of type `type', given `init', is propagated
+  bool propagates(Symbol name, Symbol type, Expression init);
+  // whether a call that can reach only m is inlined
+  bool inlines(const Hierarchy::Method& m);
+};
+
+void optimize(Classes classes, const Hierarchy& hierarchy);
+
+#endif
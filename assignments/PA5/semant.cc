@@ -0,0 +1 @@
+../PA4/semant.cc
\ No newline at end of file
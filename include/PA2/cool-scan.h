@@ -0,0 +1,43 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+#ifndef _COOL_SCAN_H_
+#define _COOL_SCAN_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  cool-scan.h
+//
+//  The lexer has two scanners.  flex_yylex is the one flex generates from
+//  cool.flex; scan_yylex is written by hand in cool-scan.cc, and returns
+//  the same tokens, with the same cool_yylval and curr_lineno, using
+//  vector instructions to step over long runs of characters.
+//
+//  cool_yylex, which the rest of the compiler calls, uses the hand-written
+//  scanner if fast_lex is set (by the -f flag) and the flex scanner if not.
+//  Both read the file fin, and start on it afresh once they have returned
+//  end of file for the last one.  fin, curr_lineno and cool_yylval belong
+//  to the thread that uses them; the flex scanner can be used by only one
+//  thread, but the hand-written one by any number at once.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+int flex_yylex();
+int scan_yylex();
+int cool_yylex();
+
+// start both scanners afresh on fin, dropping the rest of their input
+void cool_yyrestart();
+
+// start the hand-written scanner of this thread afresh on fin
+void scan_yyrestart();
+
+extern int fast_lex;
+
+// the vector instructions scan_yylex was compiled to use
+extern const char *scan_vector_isa;
+
+#endif
@@ -5,16 +5,75 @@
 #include "copyright.h"
 
 #include "cool-io.h"
+#include "stringtab.h"
+#include <stdio.h>
+#include <new>
+
 #define MAXSIZE 1000000
 #define min(a,b) (a > b ? b : a)
 
-#include "stringtab.h"
-#include <stdio.h>
+//
+// A string table is implemented as a vector of Entrys indexed by their
+// unique index, plus an open-addressing hash table mapping strings to
+// those indices.  Each Entry in the table has a unique string.
+//
+
+#define MIN_BUCKETS 64
 
 //
-// A string table is implemented a linked list of Entrys.  Each Entry
-// in the list has a unique string.
+// hash_string is the 32-bit FNV-1a hash of the first len characters of s.
 //
+template <class Elem>
+unsigned StringTable<Elem>::hash_string(const char *s, int len)
+{
+  unsigned h = 2166136261u;
+  for (int i = 0; i < len; i++) {
+    h ^= (unsigned char) s[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+//
+// find_slot returns the bucket holding the string s of length len, or
+// the empty bucket at which it would be inserted.  The table is never
+// more than half full, so the probe sequence always ends.
+//
+template <class Elem>
+int StringTable<Elem>::find_slot(const std::vector<Slot> &buckets,
+                                 const std::vector<Elem *> &tbl,
+                                 const char *s, int len, unsigned h)
+{
+  unsigned mask = buckets.size() - 1;
+  for (unsigned i = h & mask; ; i = (i + 1) & mask) {
+    const Slot &slot = buckets[i];
+    if (slot.index < 0)
+      return i;
+    if (slot.hash == h && tbl[slot.index]->equal_string((char *) s, len))
+      return i;
+  }
+}
+
+//
+// grow doubles the number of buckets and reinserts every entry, using
+// the cached hashes.
+//
+template <class Elem>
+void StringTable<Elem>::grow(std::vector<Slot> &buckets)
+{
+  std::vector<Slot> old;
+  old.swap(buckets);
+  buckets.assign(old.empty() ? MIN_BUCKETS : 2 * old.size(), Slot{0, -1});
+
+  unsigned mask = buckets.size() - 1;
+  for (const Slot &slot : old) {
+    if (slot.index < 0) continue;
+    unsigned i = slot.hash & mask;
+    while (buckets[i].index >= 0)
+      i = (i + 1) & mask;
+    buckets[i] = slot;
+  }
+}
 
 template <class Elem>
 Elem *StringTable<Elem>::add_string(char *s)
@@ -23,26 +82,128 @@ Elem *StringTable<Elem>::add_string(char *s)
 }
 
 //
-// Add a string requires two steps.  First, the list is searched; if the
-// string is found, a pointer to the existing Entry for that string is 
+// Add a string requires two steps.  First, the hash table is probed; if
+// the string is found, a pointer to the existing Entry for that string is
 // returned.  If the string is not found, a new Entry is created and added
-// to the list.
+// to the table.
 //
 template <class Elem>
 Elem *StringTable<Elem>::add_string(char *s, int maxchars)
 {
-  int len = min((int) strlen(s),maxchars);
-  for(List<Elem> *l = tbl; l; l = l->tl())
-    if (l->hd()->equal_string(s,len))
-      return l->hd();
+  int len = strnlen(s,maxchars);
+  unsigned h = hash_string(s, len);
+  if (shards != NULL)
+    return add_shared(s, len, h);
+
+  if (2 * (index + 1) > (int) buckets.size())
+    grow(buckets);
+
+  Slot &slot = buckets[find_slot(buckets, tbl, s, len, h)];
+  if (slot.index >= 0)
+    return tbl[slot.index];
+
+  Elem *e = new (arena.allocate(sizeof(Elem), alignof(Elem)))
+                 Elem(s,len,index,arena);
+  slot.hash = h;
+  slot.index = index++;
+  tbl.push_back(e);
+  return e;
+}
+
+//
+// add_shared adds a string to a shared table for the current thread.  The
+// view, the table as it was shared and the string's shard are tried in
+// turn; only the shard needs a lock, as nothing else changes the first
+// two.  A new entry is not numbered until the table is unshared.
+//
+template <class Elem>
+Elem *StringTable<Elem>::add_shared(char *s, int len, unsigned h)
+{
+  View *v = view;
+  assert(v != NULL);
+  if (2 * (v->entries.size() + 1) > v->buckets.size())
+    grow(v->buckets);
+  Slot &slot = v->buckets[find_slot(v->buckets, v->entries, s, len, h)];
+  if (slot.index >= 0)
+    return v->entries[slot.index];
+
+  Elem *e = NULL;
+  if (!buckets.empty()) {
+    const Slot &old = buckets[find_slot(buckets, tbl, s, len, h)];
+    if (old.index >= 0)
+      e = tbl[old.index];
+  }
+  if (e == NULL) {
+    Shard &shard = shards[h >> (32 - SHARD_BITS)];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    if (2 * (shard.entries.size() + 1) > shard.buckets.size())
+      grow(shard.buckets);
+    Slot &ss = shard.buckets[find_slot(shard.buckets, shard.entries,
+                                       s, len, h)];
+    if (ss.index >= 0)
+      e = shard.entries[ss.index];
+    else {
+      e = new (shard.arena.allocate(sizeof(Elem), alignof(Elem)))
+               Elem(s,len,-1,shard.arena);
+      ss.hash = h;
+      ss.index = shard.entries.size();
+      shard.entries.push_back(e);
+    }
+  }
 
-  Elem *e = new Elem(s,len,index++);
-  tbl = new List<Elem>(e, tbl);
+  slot.hash = h;
+  slot.index = v->entries.size();
+  v->entries.push_back(e);
   return e;
 }
 
+template <class Elem>
+thread_local typename StringTable<Elem>::View *StringTable<Elem>::view;
+
+template <class Elem>
+void StringTable<Elem>::use_view(View *v)
+{
+  view = v;
+}
+
+template <class Elem>
+void StringTable<Elem>::share()
+{
+  assert(shards == NULL);
+  shards = new Shard[SHARDS];
+}
+
 //
-// To look up a string, the list is scanned until a matching Entry is located.
+// unshare numbers the new entries, which are those still without an
+// index, in the order of the views, and moves them and their strings into
+// the table proper.
+//
+template <class Elem>
+void StringTable<Elem>::unshare(const std::vector<View *> &views)
+{
+  assert(shards != NULL);
+  for (View *v : views)
+    for (Elem *e : v->entries) {
+      if (e->index >= 0)
+        continue;
+      if (2 * (index + 1) > (int) buckets.size())
+        grow(buckets);
+      unsigned h = hash_string(e->str, e->len);
+      Slot &slot = buckets[find_slot(buckets, tbl, e->str, e->len, h)];
+      e->index = index;
+      slot.hash = h;
+      slot.index = index++;
+      tbl.push_back(e);
+    }
+
+  for (int i = 0; i < SHARDS; i++)
+    arena.adopt(shards[i].arena);
+  delete [] shards;
+  shards = NULL;
+}
+
+//
+// To look up a string, the hash table is probed for a matching Entry.
 // If no such entry is found, an assertion failure occurs.  Thus, this function
 // is used only for strings that one expects to find in the table.
 //
@@ -50,9 +211,12 @@ template <class Elem>
 Elem *StringTable<Elem>::lookup_string(char *s)
 {
   int len = strlen(s);
-  for(List<Elem> *l = tbl; l; l = l->tl())
-    if (l->hd()->equal_string(s,len))
-      return l->hd();
+  if (!buckets.empty()) {
+    const Slot &slot = buckets[find_slot(buckets, tbl, s, len,
+                                         hash_string(s, len))];
+    if (slot.index >= 0)
+      return tbl[slot.index];
+  }
   assert(0);   // fail if string is not found
   return NULL; // to avoid compiler warning
 }
@@ -64,15 +228,12 @@ Elem *StringTable<Elem>::lookup_string(char *s)
 template <class Elem>
 Elem *StringTable<Elem>::lookup(int ind)
 {
-  for(List<Elem> *l = tbl; l; l = l->tl())
-    if (l->hd()->equal_index(ind))
-      return l->hd();
-  assert(0);   // fail if string is not found
-  return NULL; // to avoid compiler warning
+  assert(ind >= 0 && ind < index);   // fail if string is not found
+  return tbl[ind];
 }
 
 //
-// add_int adds the string representation of an integer to the list.
+// add_int adds the string representation of an integer to the table.
 //
 template <class Elem>
 Elem *StringTable<Elem>::add_int(int i)
@@ -100,8 +261,28 @@ int StringTable<Elem>::next(int i)
   return i+1;
 }
 
+//
+// print lists the entries most recently added first, as the linked list
+// representation of the table used to.
+//
 template <class Elem>
 void StringTable<Elem>::print()
 {
-  list_print(cerr,tbl);
+  cerr << "[\n";
+  for (int i = index - 1; i >= 0; i--)
+    cerr << *tbl[i] << " ";
+  cerr << "]\n";
+}
+
+//
+// release forgets every entry and hands the arena back to the allocator
+// in one step.  Entries have no destructors to run.
+//
+template <class Elem>
+void StringTable<Elem>::release()
+{
+  std::vector<Elem *>().swap(tbl);
+  std::vector<Slot>().swap(buckets);
+  index = 0;
+  arena.release();
 }
@@ -0,0 +1,81 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+#ifndef _TOKEN_BINARY_H_
+#define _TOKEN_BINARY_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  token-binary.h
+//
+//  A compact binary encoding of the token stream, written by the lexer
+//  in place of the text of dump_cool_token when run with -b.  The parser
+//  accepts either form.
+//
+//  Numbers are unsigned LEB128 varints.  A stream is laid out as
+//
+//     header     the 8 bytes TOKEN_MAGIC and the version
+//     symbols    for each of the id, string and int tables, the number of
+//                entries, and each entry as its length followed by its
+//                characters and a '\0'
+//     tokens     records, up to and including a TOK_END
+//
+//  A record starts with a byte.  TOK_FILE is followed by a file name, in
+//  the form of a symbol entry, and starts the tokens of that file.  Any
+//  other byte is a token: the character itself for the single character
+//  tokens, or TOK_NAMED plus the token's distance from CLASS.  It is
+//  followed by the change in line number from the last token, zigzag
+//  encoded, and then by the token's value: a symbol index for TYPEID,
+//  OBJECTID, STR_CONST and INT_CONST, 0 or 1 for BOOL_CONST, and the
+//  message, as a symbol entry, for ERROR.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string>
+#include "cool-io.h"
+#include "cool-parse.h"
+#include "stringtab.h"
+
+#define TOKEN_MAGIC "\0COOLTOK"
+#define TOKEN_MAGIC_LEN 8
+#define TOKEN_VERSION 1
+
+enum { TOK_END = 0, TOK_FILE = 1, TOK_NAMED = 128 };
+
+//
+// TokenWriter accumulates the records of the tokens it is given, and
+// writes them out after the symbols in the string tables.
+//
+class TokenWriter {
+private:
+  std::string tokens;                    // the token records
+  int line;                              // of the last token
+
+  static void put(std::string& out, unsigned n);
+  static void put_string(std::string& out, const char *s, int len);
+  template <class Elem>
+  static void put_table(std::string& out, StringTable<Elem>& table);
+public:
+  TokenWriter() : line(0) { }
+
+  void file(const char *name);
+  void token(int lineno, int token, YYSTYPE& yylval);
+
+  // write the header, the symbols and the tokens to s
+  void write(ostream& s);
+};
+
+//
+// If the stream starts with TOKEN_MAGIC, read_token_binary reads all of it
+// (by mapping the file if it can) and returns 1; binary_yylex then returns
+// its tokens one at a time, as cool_yylex would.  Otherwise the stream is
+// left untouched and 0 is returned.
+//
+int read_token_binary(FILE *in);
+int binary_yylex();
+
+#endif
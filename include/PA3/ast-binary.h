@@ -0,0 +1,109 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+#ifndef _AST_BINARY_H_
+#define _AST_BINARY_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  ast-binary.h
+//
+//  A compact binary encoding of the abstract syntax tree, used in place
+//  of the indented text written by dump_with_types when the phases are
+//  run with -b.  A phase reading its input accepts either form.
+//
+//  All integers are 32-bit little-endian.  A file is laid out as
+//
+//     header     the 8 bytes AST_MAGIC, the version, and a flags word
+//     symbols    its size in bytes, then for each of the id, string and
+//                int tables: the number of entries, and each entry as
+//                its length followed by its characters and a '\0'
+//     nodes      its size in bytes, then the program node
+//     hierarchy  if the flags have AST_HIERARCHY, its size in bytes, then
+//                the class hierarchy semant built (see hierarchy.h)
+//
+//  Each node is a one-byte tag, the size in bytes of the rest of the
+//  node, the line number, and then the node's components in the order
+//  dump_with_types prints them.  A symbol is an index into the symbol
+//  section for its table; a list is its length followed by its elements;
+//  every expression ends with its type, the id table index plus one, or
+//  zero for no type.
+//
+//  The symbols of each table appear in the order dump_with_types would
+//  first print them, so a phase reading the binary form interns them in
+//  the same order, and numbers them the same way, as one reading text.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "cool-io.h"
+#include "stringtab.h"
+#include "tree.h"
+
+#define AST_MAGIC "\0COOLAST"
+#define AST_MAGIC_LEN 8
+#define AST_VERSION 1
+
+#define AST_TYPED 0x1   // flags: expressions carry types (semant output)
+#define AST_HIERARCHY 0x2  // flags: the class hierarchy follows the nodes
+
+enum AstTable { AST_ID, AST_STR, AST_INT, AST_NTABLES };
+
+// the tags of the nodes; those from AST_ASSIGN on are expressions
+enum AstTag {
+  AST_PROGRAM = 1, AST_CLASS, AST_METHOD, AST_ATTR, AST_FORMAL, AST_BRANCH,
+  AST_ASSIGN, AST_STATIC_DISPATCH, AST_DISPATCH, AST_COND, AST_LOOP,
+  AST_TYPCASE, AST_BLOCK, AST_LET, AST_PLUS, AST_SUB, AST_MUL, AST_DIVIDE,
+  AST_NEG, AST_LT, AST_EQ, AST_LEQ, AST_COMP, AST_INT_CONST, AST_BOOL_CONST,
+  AST_STRING_CONST, AST_NEW, AST_ISVOID, AST_NO_EXPR, AST_OBJECT
+};
+
+//
+// AstWriter accumulates the encoding of a tree.  The dump_binary method
+// of each node calls begin, then adds its components, then calls end.
+//
+class AstWriter {
+private:
+  std::string nodes;                      // the node section
+  std::vector<size_t> open;               // size fields still to be filled
+  std::vector<std::string_view> syms[AST_NTABLES];
+  std::unordered_map<std::string_view, int> index[AST_NTABLES];
+  int flags;                              // AST_TYPED, if any types seen
+  std::string hier;                       // the hierarchy section, if any
+
+  static void put(std::string& out, unsigned n);
+  int intern(AstTable table, std::string_view s);
+public:
+  AstWriter() : flags(0) { }
+
+  void begin(AstTag tag, tree_node *node);
+  void end();
+  void symbol(AstTable table, Symbol sym);
+  void symbol(AstTable table, std::string_view s);
+  void length(int n)                      { put(nodes, n); }
+  void type(Symbol type);
+
+  // write bytes, the class hierarchy, after the nodes
+  void hierarchy(const std::string& bytes)  { hier = bytes; flags |= AST_HIERARCHY; }
+
+  // write the header, symbols and nodes to s
+  void write(ostream& s);
+};
+
+//
+// If the stream starts with AST_MAGIC, read_ast_binary decodes the tree
+// in it (by mapping the file if it can) and returns it, with the class
+// hierarchy, if there is one and hierarchy is not NULL, in *hierarchy.
+// Otherwise the stream is left untouched and NULL is returned.
+//
+class Program_class;
+Program_class *read_ast_binary(FILE *in, std::string *hierarchy = NULL);
+
+#endif
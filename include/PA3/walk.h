@@ -0,0 +1,58 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+#ifndef _WALK_H_
+#define _WALK_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  walk.h
+//
+//  Passes over expressions, which may nest as deeply as a program likes,
+//  keep their place in the tree on a stack of their own rather than on
+//  the native one, so that the native stack they need does not grow with
+//  the depth of the tree.
+//
+//  A pass has a stack of frames, one for each node it is in the middle
+//  of, innermost last.  A frame holds the node, `step', how far the node
+//  has got (0 when it is first visited), and what else the pass keeps
+//  for a node while its children are visited.  Each kind of node has a
+//  step method for the pass, which carries on from where the frame says
+//  and then either visits a child, by pushing a frame for it, and
+//  returns true, or finishes the node and returns false:
+//
+//      bool plus_class::step(Pass& pass, PassFrame& f)
+//      {
+//        switch (f.step++) {
+//        case 0:  return pass.visit(e1);
+//        case 1:  return pass.visit(e2);
+//        }
+//        ...                          // both operands are done
+//        return false;
+//      }
+//
+//  walk steps the frame on top of the stack until the one it was given
+//  is finished.  The frames are kept in a deque, so that the address of
+//  a frame (bound to a variable of the node's, say) stays good while the
+//  frames of its children come and go.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <deque>
+
+template <class Pass, class Frame>
+void walk(Pass& pass, std::deque<Frame>& frames, const Frame& root)
+{
+  size_t base = frames.size();
+  frames.push_back(root);
+  while (frames.size() > base) {
+    Frame& f = frames.back();
+    if (!f.node->step(pass, f))
+      frames.pop_back();
+  }
+}
+
+#endif
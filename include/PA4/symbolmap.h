@@ -0,0 +1,164 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+#ifndef _SYMBOLMAP_H_
+#define _SYMBOLMAP_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  symbolmap.h
+//
+//  Maps keyed by symbols, for the tables the phases look names up in.
+//  Every entry of a string table has a unique, dense index, so a map
+//  keyed by the symbols of one table can find a key's value by indexing
+//  a vector with the key's index, rather than by hashing the pointer and
+//  chasing a bucket list.  The keys of a map must all come from the same
+//  table (idtable, for names and types).
+//
+//  DenseSymbolMap<T> has the part of the interface of
+//  std::unordered_map<Symbol, T> the compiler uses; it keeps its entries
+//  in the order they were added, and an entry, once added, stays where
+//  it is, so pointers to values stay valid as the map grows.
+//
+//  DenseSymbolMap2<T> maps pairs of symbols, such as a class and the
+//  name of one of its members, to values.  The pair of indices is the
+//  key of a single open-addressing hash table (linear probing,
+//  power-of-two size), so a lookup is one probe into one flat array.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <deque>
+#include <utility>
+#include <vector>
+#include "stringtab.h"
+
+template <class T>
+class DenseSymbolMap {
+public:
+  typedef std::pair<Symbol, T> value_type;
+  typedef typename std::deque<value_type>::iterator iterator;
+  typedef typename std::deque<value_type>::const_iterator const_iterator;
+
+private:
+  std::vector<int> place_;            // by index: place in entries_, or -1
+  std::deque<value_type> entries_;    // in the order added
+
+  int place(Symbol s) const
+  {
+    size_t i = s->get_index();
+    return i < place_.size() ? place_[i] : -1;
+  }
+
+public:
+  iterator begin()                    { return entries_.begin(); }
+  iterator end()                      { return entries_.end(); }
+  const_iterator begin() const        { return entries_.begin(); }
+  const_iterator end() const          { return entries_.end(); }
+  size_t size() const                 { return entries_.size(); }
+  bool empty() const                  { return entries_.empty(); }
+  size_t count(Symbol s) const        { return place(s) < 0 ? 0 : 1; }
+
+  iterator find(Symbol s)
+  {
+    int p = place(s);
+    return p < 0 ? end() : entries_.begin() + p;
+  }
+  const_iterator find(Symbol s) const
+  {
+    int p = place(s);
+    return p < 0 ? end() : entries_.begin() + p;
+  }
+
+  // the value of s, added (value-initialized) if s has none
+  T& operator[](Symbol s)
+  {
+    size_t i = s->get_index();
+    if (i >= place_.size())
+      place_.resize(i + 1, -1);
+    if (place_[i] < 0) {
+      place_[i] = entries_.size();
+      entries_.emplace_back(s, T());
+    }
+    return entries_[place_[i]].second;
+  }
+
+  void clear()
+  {
+    place_.clear();
+    entries_.clear();
+  }
+};
+
+template <class T>
+class DenseSymbolMap2 {
+  struct Slot {
+    uint64_t key;      // the two indices, the first offset by one; 0 if empty
+    T value;
+  };
+  std::vector<Slot> slots_;
+  size_t size_;
+
+  static uint64_t key(Symbol a, Symbol b)
+  {
+    return ((uint64_t) (a->get_index() + 1) << 32) | (uint32_t) b->get_index();
+  }
+
+  // the slot for key k: the one that holds it, or the empty one it would go in
+  size_t slot(uint64_t k) const
+  {
+    size_t mask = slots_.size() - 1;
+    size_t i = (size_t) ((k * 0x9e3779b97f4a7c15ULL) >> 32) & mask;
+    while (slots_[i].key != 0 && slots_[i].key != k)
+      i = (i + 1) & mask;
+    return i;
+  }
+
+  void grow()
+  {
+    std::vector<Slot> old(slots_.size() ? 2 * slots_.size() : 16);
+    old.swap(slots_);
+    for (Slot& s : old)
+      if (s.key != 0)
+        slots_[slot(s.key)] = std::move(s);
+  }
+
+public:
+  DenseSymbolMap2() : size_(0) { }
+
+  size_t size() const                 { return size_; }
+
+  // the value of (a, b), or NULL if it has none
+  T *find(Symbol a, Symbol b)
+  {
+    if (size_ == 0)
+      return NULL;
+    Slot& s = slots_[slot(key(a, b))];
+    return s.key == 0 ? NULL : &s.value;
+  }
+  const T *find(Symbol a, Symbol b) const
+  {
+    return const_cast<DenseSymbolMap2 *>(this)->find(a, b);
+  }
+
+  // the value of (a, b), added (value-initialized) if it has none; the
+  // reference is good until the next pair is added
+  T& operator()(Symbol a, Symbol b)
+  {
+    if (2 * (size_ + 1) > slots_.size())
+      grow();
+    uint64_t k = key(a, b);
+    Slot& s = slots_[slot(k)];
+    if (s.key == 0) {
+      s.key = k;
+      s.value = T();
+      size_++;
+    }
+    return s.value;
+  }
+};
+
+#endif
@@ -14,7 +14,10 @@
 #ifndef _SYMTAB_H_
 #define _SYMTAB_H_
 
+#include <unordered_map>
+#include <vector>
 #include "list.h"
+#include "symbolmap.h"
 
 //
 // SymtabEnty<SYM,DAT> defines the entry for a symbol table that associates
@@ -166,5 +169,122 @@ public:
  
 };
 
+//
+// HashedSymbolTable<SYM,DAT> has the same interface as SymbolTable but
+//    is meant for tables that see many lookups in deeply nested scopes.
+//    Each symbol maps, through a hash table (a DenseSymbolMap, for
+//    Symbols), to a stack of its bindings, innermost last; every binding
+//    remembers the depth of the scope it was made in.  A log records, in order, each symbol added and the
+//    stack it was pushed onto, and `marks' records where in the log each
+//    open scope begins.
+//
+//    `lookup(s)' is a single probe: the top of the stack for `s'.
+//
+//    `probe(s)' is the same, but only answers if the top binding was
+//        made in the current scope.
+//
+//    `exitscope' pops the bindings logged since the matching
+//        enterscope, so it costs time proportional to the number of
+//        symbols added in that scope, not to the size of the table.
+//
+//    Unlike SymbolTable, exited scopes are gone for good, and
+//    assignment copies the whole table rather than sharing it.
+//
+
+// the map HashedSymbolTable keeps its stacks in: a DenseSymbolMap for
+// Symbols, and a hash table for other keys
+template <class SYM, class T>
+struct SymbolMapFor { typedef std::unordered_map<SYM, T> type; };
+template <class T>
+struct SymbolMapFor<Symbol, T> { typedef DenseSymbolMap<T> type; };
+
+template <class SYM, class DAT>
+class HashedSymbolTable
+{
+   struct Binding {
+      int depth;       // the scope depth at which the binding was made
+      DAT *info;
+   };
+   typedef std::vector<Binding> Bindings;
+private:
+   typedef typename SymbolMapFor<SYM, Bindings>::type Map;
+   // Stacks are never removed from the map, so pointers to them (in
+   // `log') stay valid as it grows.
+   Map tbl;
+   // one entry per addid, oldest first: the symbol and its stack
+   std::vector<std::pair<SYM, Bindings *> > log;
+   std::vector<size_t> marks;      // the log size when each scope began
+
+   void fatal_error(const char *msg)
+   {
+     cerr << msg << "\n";
+     exit(1);
+   }
+public:
+   HashedSymbolTable() { }
+
+   void enterscope()
+   {
+       marks.push_back(log.size());
+   }
+
+   // the number of scopes entered and not yet exited
+   int depth() const
+   {
+       return marks.size();
+   }
+
+   void exitscope()
+   {
+       if (marks.empty()) {
+	   fatal_error("exitscope: Can't remove scope from an empty symbol table.");
+       }
+       for (size_t i = log.size(); i > marks.back(); i--)
+	   log[i - 1].second->pop_back();
+       log.resize(marks.back());
+       marks.pop_back();
+   }
+
+   void addid(SYM s, DAT *i)
+   {
+       if (marks.empty()) fatal_error("addid: Can't add a symbol without a scope.");
+       Bindings &b = tbl[s];
+       b.push_back(Binding{(int) marks.size(), i});
+       log.push_back(std::make_pair(s, &b));
+   }
+
+   DAT *lookup(SYM s)
+   {
+       typename Map::iterator it = tbl.find(s);
+       if (it == tbl.end() || it->second.empty())
+	   return NULL;
+       return it->second.back().info;
+   }
+
+   DAT *probe(SYM s)
+   {
+       if (marks.empty()) {
+	   fatal_error("probe: No scope in symbol table.");
+       }
+       typename Map::iterator it = tbl.find(s);
+       if (it == tbl.end() || it->second.empty() ||
+	   it->second.back().depth != (int) marks.size())
+	   return NULL;
+       return it->second.back().info;
+   }
+
+   // Prints out the contents of the symbol table, innermost scope first.
+   void dump()
+   {
+      size_t end = log.size();
+      for (size_t m = marks.size(); m > 0; m--) {
+         cerr << "\nScope: \n";
+         for (size_t i = end; i > marks[m - 1]; i--)
+            cerr << "  " << log[i - 1].first << endl;
+         end = marks[m - 1];
+      }
+   }
+};
+
 #endif
 
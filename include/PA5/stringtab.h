@@ -11,6 +11,10 @@
 
 #include <assert.h>
 #include <string.h>
+#include <stddef.h>
+#include <mutex>
+#include <string_view>
+#include <vector>
 #include "list.h"    // list template
 #include "cool-io.h"
 
@@ -20,6 +24,47 @@ typedef Entry* Symbol;
 extern ostream& operator<<(ostream& s, const Entry& sym);
 extern ostream& operator<<(ostream& s, Symbol sym);
 
+/////////////////////////////////////////////////////////////////////////
+//
+//  String Arenas
+//
+/////////////////////////////////////////////////////////////////////////
+
+//
+// A StringArena hands out memory by bumping a pointer through large
+// chunks.  Individual allocations are never freed; release() returns
+// every chunk at once.  The string tables keep both their entries and
+// the characters of the strings in an arena, so that interned symbols
+// are packed together instead of scattered across the heap.  The
+// abstract syntax tree is allocated from one as well (see tree.cc).
+//
+class StringArena {
+private:
+  enum { CHUNK_SIZE = 64 * 1024 };
+
+  std::vector<char *> chunks;  // every chunk allocated so far
+  char *next;                  // first free byte in the current chunk
+  size_t left;                 // free bytes remaining in the current chunk
+
+  StringArena(const StringArena &);
+  StringArena &operator=(const StringArena &);
+public:
+  StringArena() : next(NULL), left(0) { }
+  ~StringArena() { release(); }
+
+  // allocate n bytes aligned to align (a power of two)
+  void *allocate(size_t n, size_t align);
+
+  // copy the first len characters of s into the arena and terminate them
+  char *copy_string(const char *s, int len);
+
+  // take over every chunk of other, which is left empty
+  void adopt(StringArena &other);
+
+  // free every chunk; all memory handed out becomes invalid
+  void release();
+};
+
 /////////////////////////////////////////////////////////////////////////
 //
 //  String Table Entries
@@ -27,24 +72,34 @@ extern ostream& operator<<(ostream& s, Symbol sym);
 /////////////////////////////////////////////////////////////////////////
 
 class Entry {
+  template <class Elem> friend class StringTable;  // numbers shared entries
 protected:
   char *str;     // the string
   int  len;      // the length of the string (without trailing \0)
   int index;     // a unique index for each string
 public:
   Entry(char *s, int l, int i);
+  // as above, but the string is copied into the arena a
+  Entry(char *s, int l, int i, StringArena &a);
 
   // is string argument equal to the str of this Entry?
   int equal_string(char *s, int len) const;  
                          
   // is the integer argument equal to the index of this Entry?
   bool equal_index(int ind) const           { return ind == index; }
+  int get_index() const                     { return index; }
 
   ostream& print(ostream& s) const;
 
   // Return the str and len components of the Entry.
   char *get_string() const;
   int get_len() const;
+
+  // The same string as a view, and as an iterator range over its
+  // characters.
+  std::string_view get_view() const { return std::string_view(str, len); }
+  const char *begin() const         { return str; }
+  const char *end() const           { return str + len; }
 };
 
 //
@@ -65,11 +120,13 @@ public:
   void code_def(ostream& str, int stringclasstag);
   void code_ref(ostream& str);
   StringEntry(char *s, int l, int i);
+  StringEntry(char *s, int l, int i, StringArena &a);
 };
 
 class IdEntry : public Entry {
 public:
   IdEntry(char *s, int l, int i);
+  IdEntry(char *s, int l, int i, StringArena &a);
 };
 
 class IntEntry: public Entry {
@@ -77,6 +134,7 @@ public:
   void code_def(ostream& str, int intclasstag);
   void code_ref(ostream& str);
   IntEntry(char *s, int l, int i);
+  IntEntry(char *s, int l, int i, StringArena &a);
 };
 
 typedef StringEntry *StringEntryP;
@@ -93,10 +151,59 @@ template <class Elem>
 class StringTable
 {
 protected:
-   List<Elem> *tbl;   // a string table is a list
-   int index;         // the current index
+   //
+   // A string table is a dense vector of entries, indexed by the unique
+   // index of each entry, together with an open-addressing hash table
+   // (linear probing, power-of-two size) that maps strings to indices.
+   // Each slot caches the full hash of its string so that probing and
+   // rehashing rarely have to touch the entries themselves.
+   //
+   struct Slot {
+      unsigned hash;   // hash of the entry's string
+      int index;       // index into tbl, or -1 for an empty slot
+   };
+
+   std::vector<Elem *> tbl;    // the entries, in index order
+   std::vector<Slot> buckets;  // the hash table
+   int index;                  // the current index
+   StringArena arena;          // storage for the entries and their strings
+
+   static unsigned hash_string(const char *s, int len);
+   static int find_slot(const std::vector<Slot> &buckets,
+                        const std::vector<Elem *> &tbl,
+                        const char *s, int len, unsigned h);
+   static void grow(std::vector<Slot> &buckets);
+
+public:
+   //
+   // A table can be shared by several threads, which may then add strings
+   // to it at once (see share).  Each thread adds them through a View,
+   // which remembers the entries it has handed out, in the order they were
+   // first asked for, so that most strings are found without a lock.  The
+   // rest are looked for in the table as it was when it was shared, and
+   // then in one of SHARDS small tables, chosen by hash, each with a lock
+   // of its own.
+   //
+   class View {
+      friend class StringTable<Elem>;
+      std::vector<Slot> buckets;   // a hash table of entries
+      std::vector<Elem *> entries; // in the order first asked for
+   };
+
+protected:
+   enum { SHARD_BITS = 6, SHARDS = 1 << SHARD_BITS };
+   struct Shard {
+      std::mutex lock;
+      std::vector<Slot> buckets;
+      std::vector<Elem *> entries; // not yet numbered
+      StringArena arena;
+   };
+   Shard *shards;                  // while shared, and NULL otherwise
+   static thread_local View *view; // the view of the current thread
+
+   Elem *add_shared(char *s, int len, unsigned h);
 public:
-   StringTable(): tbl((List<Elem> *) NULL), index(0) { }   // an empty table
+   StringTable(): index(0), shards(NULL) { }   // an empty table
    // The following methods each add a string to the string table.  
    // Only one copy of each string is maintained.  
    // Returns a pointer to the string table entry with the string.
@@ -121,6 +228,23 @@ public:
 
    void print();  // print the entire table; for debugging
 
+   // Empty the table and free all of its entries at once.  Every
+   // Symbol obtained from the table is invalid afterwards.
+   void release();
+
+   // Share the table.  Until unshare is called, add_string may be called
+   // by any thread that has a view, and nothing else may be done.
+   void share();
+
+   // Add strings for the current thread through v, or through no view if
+   // v is NULL.
+   void use_view(View *v);
+
+   // Stop sharing.  The entries added meanwhile are numbered as if the
+   // strings of each view had been added in turn, in the order given,
+   // and in the order each view first asked for them.
+   void unshare(const std::vector<View *> &views);
+
 };
 
 class IdTable : public StringTable<IdEntry> { };
@@ -15,6 +15,7 @@
 ///////////////////////////////////////////////////////////////////////////
  
 
+#include <vector>
 #include "stringtab.h"
 #include "cool-io.h"
 
@@ -47,11 +48,31 @@
 //           sets the line number and type of "this" to the values in
 //           the argument tree_node.  Returns "this".
 //
+//   Nodes are never freed one at a time.  They are allocated from a
+//   region by a class-level operator new, which places them one after
+//   another in the order they are built (for the parser, a bottom-up
+//   traversal of the tree); operator delete does nothing.  Each thread
+//   has a region of its own, which is freed when the thread ends.
+//   Freeing a region runs no destructors, except those of the nodes in
+//   it that have called
+//
+//       void owns_memory();
+//           which a node with members that hold memory of their own (an
+//           append node's flattened elements) calls when it is built.
+//
+//       static void release_all();
+//           frees every node at once.  No node may be used afterwards.
+//
+//       static void keep_thread_nodes();
+//           keeps the nodes made by this thread after it ends, until
+//           release_all.
+//
 //
 ////////////////////////////////////////////////////////////////////////////
 class tree_node {
 protected:
     int line_number;            // stash the line number when node is made
+    void owns_memory();
 public:
     tree_node();
     virtual tree_node *copy() = 0;
@@ -59,6 +80,11 @@ public:
     virtual void dump(ostream& stream, int n) = 0;
     virtual int get_line_number();
     tree_node *set(tree_node *);
+
+    static void *operator new(size_t size);
+    static void operator delete(void *) { }
+    static void release_all();
+    static void keep_thread_nodes();
 };
 
 ///////////////////////////////////////////////////////////////////
@@ -93,11 +119,26 @@ public:
 //     int len()
 //     returns the length of the list
 //
+//     Elem *begin();
+//     Elem *end();
+//       The elements of the list as a contiguous array, so that a list
+//     can also be traversed with a range-based for:
+//
+//     for (Elem e : *l)
+//         ... operate on e ...
+//
 //     nth_length(int n, int &len);
 //     Returns the nth element of the list or NULL if there are not n elements.
 //     "len" is set to the length of the list.  This method is used internally
 //     by the APS package to efficiently traverse the list representation.  
 //
+//     Elem *elements(int &len);
+//     Returns the elements of the list as an array and sets "len" to their
+//     number.  The parser builds lists as deep chains of append nodes;
+//     the first time an append node is asked for an element, it flattens
+//     its whole chain into a vector and keeps it, so nth, len and the
+//     iterators above all take constant time.
+//
 //     static list_node<Elem> *nil();
 //     static list_node<Elem> *single(Elem);
 //     static list_node<Elem> *append(list_node<Elem> *, list_node<Elem> *);
@@ -123,10 +164,19 @@ public:
     int next(int n)  { return n + 1; }
     int more(int n)  { return (n < len()); }
 
+    Elem *begin()    { int n; return elements(n); }
+    Elem *end()      { int n; Elem *e = elements(n); return e + n; }
+
     virtual list_node<Elem> *copy_list() = 0;
     virtual ~list_node() { }
     virtual int len() = 0;
     virtual Elem nth_length(int n, int &len) = 0;
+    virtual Elem *elements(int &len) = 0;
+
+    // Used when flattening: nodes that hold elements append them to out,
+    // append nodes push their two halves on the work stack instead.
+    virtual void flatten(std::vector<Elem> &out,
+			 std::vector<list_node<Elem> *> &work) = 0;
 
     static list_node<Elem> *nil();
     static list_node<Elem> *single(Elem);
@@ -142,6 +192,8 @@ public:
     list_node<Elem> *copy_list();
     int len();
     Elem nth_length(int n, int &len);
+    Elem *elements(int &len)     { len = 0; return NULL; }
+    void flatten(std::vector<Elem> &, std::vector<list_node<Elem> *> &) { }
     void dump(ostream& stream, int n);
 };
 
@@ -154,6 +206,9 @@ public:
     list_node<Elem> *copy_list();
     int len();
     Elem nth_length(int n, int &len);
+    Elem *elements(int &len)     { len = 1; return &elem; }
+    void flatten(std::vector<Elem> &out, std::vector<list_node<Elem> *> &)
+                                 { out.push_back(elem); }
     void dump(ostream& stream, int n);
 };
 
@@ -161,15 +216,23 @@ public:
 template <class Elem> class append_node : public list_node<Elem> {
 private:
     list_node<Elem> *some, *rest;
+    std::vector<Elem> *flat;     // all elements, once someone asks for them
+
+    std::vector<Elem> &flattened();
 public:
     append_node(list_node<Elem> *l1, list_node<Elem> *l2) {
 	some = l1;
 	rest = l2;
+	flat = NULL;
+	this->owns_memory();
     }
+    ~append_node()               { delete flat; }
     list_node<Elem> *copy_list();
     int len();
     Elem nth(int n);
     Elem nth_length(int n, int &len);
+    Elem *elements(int &len);
+    void flatten(std::vector<Elem> &out, std::vector<list_node<Elem> *> &work);
     void dump(ostream& stream, int n);
 };
 
@@ -197,10 +260,10 @@ template <class Elem> list_node<Elem> *list_node<Elem>::append(list_node<Elem> *
 template <class Elem> Elem list_node<Elem>::nth(int n)
 {
     int len;
-    Elem tmp = nth_length(n ,len);
+    Elem *elems = elements(len);
 
-    if (tmp)
-	return tmp;
+    if (n >= 0 && n < len && elems[n])
+	return elems[n];
     else {
 	cerr << "error: outside the range of the list\n";
 	exit(1);
@@ -210,15 +273,7 @@ template <class Elem> Elem list_node<Elem>::nth(int n)
 // added 10/30/06 cgs
 template <class Elem> Elem append_node<Elem>::nth(int n)
 {
-    int len;
-    Elem tmp = nth_length(n ,len);
-
-    if (tmp)
-	return tmp;
-    else {
-	cerr << "error: outside the range of the list\n";
-	exit(1);
-    }
+    return list_node<Elem>::nth(n);
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -353,7 +408,7 @@ template <class Elem> list_node<Elem> *append_node<Elem>::copy_list()
 ///////////////////////////////////////////////////////////////////////////
 template <class Elem> int append_node<Elem>::len()
 {
-    return some->len() + rest->len();
+    return flattened().size();
 }
 
 
@@ -366,14 +421,78 @@ template <class Elem> int append_node<Elem>::len()
 ///////////////////////////////////////////////////////////////////////////
 template <class Elem> Elem append_node<Elem>::nth_length(int n, int &len)
 {
-    int rlen;
-    Elem tmp = some->nth_length(n, len);
+    std::vector<Elem> &elems = flattened();
+
+    len = elems.size();
+    if (n < 0 || n >= len)
+	return NULL;
+    return elems[n];
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//
+// append_node::elements
+//
+// return the elements of the append_node as an array
+//
+///////////////////////////////////////////////////////////////////////////
+template <class Elem> Elem *append_node<Elem>::elements(int &len)
+{
+    std::vector<Elem> &elems = flattened();
+
+    len = elems.size();
+    return elems.data();
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//
+// append_node::flattened
+//
+// collect the elements of the list, in order, into the flat vector.
+// The walk uses an explicit stack rather than recursion, since the
+// parser's left-deep chains can be tens of thousands of nodes deep.
+// Sublists that have already been flattened are copied wholesale.
+//
+///////////////////////////////////////////////////////////////////////////
+template <class Elem> std::vector<Elem> &append_node<Elem>::flattened()
+{
+    if (flat)
+	return *flat;
+
+    std::vector<Elem> *elems = new std::vector<Elem>();
+    std::vector<list_node<Elem> *> work;
+
+    work.push_back(rest);
+    work.push_back(some);
+    while (!work.empty()) {
+	list_node<Elem> *l = work.back();
+	work.pop_back();
+	l->flatten(*elems, work);
+    }
+    flat = elems;
+    return *flat;
+}
+
 
-    if (!tmp) {
-	tmp = rest->nth_length(n-len, rlen);
-	len += rlen;
+///////////////////////////////////////////////////////////////////////////
+//
+// append_node::flatten
+//
+// add the elements of a sublist to out, or defer its halves to work
+//
+///////////////////////////////////////////////////////////////////////////
+template <class Elem>
+void append_node<Elem>::flatten(std::vector<Elem> &out,
+				std::vector<list_node<Elem> *> &work)
+{
+    if (flat)
+	out.insert(out.end(), flat->begin(), flat->end());
+    else {
+	work.push_back(rest);
+	work.push_back(some);
     }
-    return tmp;
 }
 
 
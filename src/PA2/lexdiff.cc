@@ -0,0 +1,88 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  lexdiff.cc
+//
+//  Checks that the hand-written scanner agrees with the flex scanner.
+//  Each file named on the command line is scanned by both, and their
+//  tokens, with line numbers and semantic values, are compared in the
+//  form the lexer prints them.  The first difference in each file is
+//  reported, and the exit status is 1 if there were any.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <sstream>
+#include "cool-parse.h"
+#include "cool-scan.h"
+#include "utilities.h"
+
+thread_local int curr_lineno = 1;
+thread_local char *curr_filename = "<stdin>";
+thread_local FILE *fin;                     // the file both scanners read
+thread_local YYSTYPE cool_yylval;           // Not compiled with parser, so must define this.
+int cool_yydebug;
+
+extern int optind;
+void handle_flags(int argc, char *argv[]);
+
+// defined in utilities.cc
+extern void dump_cool_token(ostream& out, int lineno,
+			    int token, YYSTYPE yylval);
+
+static std::vector<std::string> scan(const char *file, int (*lex)())
+{
+  std::vector<std::string> tokens;
+  int token;
+
+  fin = fopen(file, "r");
+  if (fin == NULL) {
+    cerr << "Could not open input file " << file << endl;
+    exit(1);
+  }
+  curr_lineno = 1;
+  while ((token = lex()) != 0) {
+    std::ostringstream s;
+    dump_cool_token(s, curr_lineno, token, cool_yylval);
+    tokens.push_back(s.str());
+  }
+  fclose(fin);
+  return tokens;
+}
+
+int main(int argc, char *argv[])
+{
+  int files = 0, tokens = 0, differ = 0;
+
+  handle_flags(argc, argv);
+  for (; optind < argc; optind++, files++) {
+    const char *file = argv[optind];
+    std::vector<std::string> expected = scan(file, flex_yylex);
+    std::vector<std::string> got = scan(file, scan_yylex);
+    tokens += expected.size();
+
+    size_t i = 0;
+    while (i < expected.size() && i < got.size() && expected[i] == got[i])
+      i++;
+    if (i == expected.size() && i == got.size())
+      continue;
+
+    differ++;
+    cout << file << ": token " << i + 1 << " differs\n"
+	 << "  flex:    "
+	 << (i < expected.size() ? expected[i] : "end of file\n")
+	 << "  scanner: "
+	 << (i < got.size() ? got[i] : "end of file\n");
+  }
+
+  cout << files << " files, " << tokens << " tokens, "
+       << differ << " with differences\n";
+  return differ ? 1 : 0;
+}
@@ -0,0 +1,81 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  stringtab_bench.cc
+//
+//  Times interning in the string table: adds n distinct identifiers
+//  (1,000,000 by default, or the first argument) to idtable, then adds
+//  each of them again and looks each one up by string and by index, the
+//  way the lexer and code generator do.  Finally the whole table is
+//  released at once.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "cool-parse.h"
+#include "stringtab.h"
+#include "utilities.h"
+
+thread_local YYSTYPE cool_yylval;           // Not compiled with a lexer, so must define this.
+
+static double seconds_since(clock_t start)
+{
+  return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void report(const char *what, int n, double secs)
+{
+  printf("%-20s %8d ops %10.3f s %10.1f ns/op\n",
+	 what, n, secs, secs * 1e9 / n);
+}
+
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 1000000;
+  char **names = new char *[n];
+
+  //
+  // Identifiers in the style of machine-generated sources: a few common
+  // prefixes followed by a counter.
+  //
+  static const char *prefixes[] = { "tmp_", "field", "Class", "method_", "x" };
+  for (int i = 0; i < n; i++) {
+    char buf[64];
+    snprintf(buf, sizeof buf, "%s%d", prefixes[i % 5], i);
+    names[i] = strdup(buf);
+  }
+
+  clock_t start = clock();
+  for (int i = 0; i < n; i++)
+    idtable.add_string(names[i]);
+  report("add_string (new)", n, seconds_since(start));
+
+  start = clock();
+  for (int i = 0; i < n; i++)
+    if (!idtable.add_string(names[i])->equal_index(i))
+      fatal_error("add_string returned the wrong entry\n");
+  report("add_string (hit)", n, seconds_since(start));
+
+  start = clock();
+  for (int i = 0; i < n; i++)
+    idtable.lookup_string(names[i]);
+  report("lookup_string", n, seconds_since(start));
+
+  start = clock();
+  for (int i = idtable.first(); idtable.more(i); i = idtable.next(i))
+    idtable.lookup(i);
+  report("lookup", n, seconds_since(start));
+
+  start = clock();
+  idtable.release();
+  report("release", n, seconds_since(start));
+
+  return 0;
+}
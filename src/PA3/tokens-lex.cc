@@ -699,7 +699,8 @@ char *yytext;
 
 /* The compiler assumes these identifiers. */
 #define yylval cool_yylval
-#define yylex  cool_yylex
+/* cool_yylex, in parser-phase.cc, calls this or binary_yylex */
+#define yylex  text_yylex
 
 /* Max size of string constants */
 #define MAX_STR_CONST 1025
@@ -722,8 +723,8 @@ char *string_buf_ptr;
 
 extern int verbose_flag;
 //changed
-extern int curr_lineno;
-extern char* curr_filename;
+extern thread_local int curr_lineno;
+extern thread_local char* curr_filename;
 
 static int prevstate;
 
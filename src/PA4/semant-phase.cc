@@ -1,19 +1,32 @@
 #include <stdio.h>
 #include "cool-tree.h"
+#include "ast-binary.h"
+#include "hierarchy.h"
 
 extern Program ast_root;      // root of the abstract syntax tree
 FILE *ast_file = stdin;       // we read the AST from standard input
 extern int ast_yyparse(void); // entry point to the AST parser
+extern int ast_binary;        // write the AST in binary form
 
 int cool_yydebug;     // not used, but needed to link with handle_flags
-char *curr_filename;
+thread_local char *curr_filename;
 
 void handle_flags(int argc, char *argv[]);
 
 int main(int argc, char *argv[]) {
   handle_flags(argc,argv);
-  ast_yyparse();
+  if ((ast_root = read_ast_binary(ast_file)) == NULL)
+    ast_yyparse();
   ast_root->semant();
-  ast_root->dump_with_types(cout,0);
+  if (ast_binary) {
+    AstWriter w;
+    ast_root->dump_binary(w);
+    std::string hierarchy;
+    ast_root->hierarchy->write(hierarchy);
+    w.hierarchy(hierarchy);
+    w.write(cout);
+  } else
+    ast_root->dump_with_types(cout,0);
+  tree_node::release_all();
 }
 
@@ -0,0 +1,152 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  semant_bench.cc
+//
+//  Measures what the semant cache (-C) saves in an edit-compile loop.  A
+//  program of `classes' classes (2000, or the number given with -n) is
+//  built, each class inheriting from the one at half its number, with an
+//  attribute and five methods that override those of the root class, and
+//  whose bodies dispatch to other classes.  It is checked
+//
+//     without the cache,
+//     with an empty cache, which is then filled,
+//     with the cache, unchanged, and
+//     with the cache, after an edit to the body of one method.
+//
+//  Each check is of a freshly built tree, as a compile would be.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "cool-tree.h"
+
+extern char *semant_cache;
+extern thread_local int node_lineno;
+
+FILE *ast_file;       // not used, but needed to link with the AST parser
+int cool_yydebug;     // not used, but needed to link with handle_flags
+thread_local char *curr_filename;
+
+static const int METHODS = 5;
+
+static double seconds_since(clock_t start)
+{
+  return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+static Symbol id(const char *prefix, int n)
+{
+  char buf[32];
+  snprintf(buf, sizeof buf, "%s%d", prefix, n);
+  return idtable.add_string(buf);
+}
+
+static Symbol integer(int n)
+{
+  return inttable.add_int(n);
+}
+
+//
+// The body of method k of class i: it calls a method of another class, or
+// adds the attribute of the class (and, below the root, that of its
+// parent) to x.  `edit' changes a constant in it.
+//
+static Expression body(int classes, int i, int k, int edit)
+{
+  Symbol x = idtable.add_string("x"), y = idtable.add_string("y");
+  int j = (i * 7 + k * 13 + 1) % classes;
+
+  Expression sum = plus(object(id("a", i)), object(x));
+  if (i > 0)
+    sum = plus(sum, object(id("a", i / 2)));
+
+  Expression call = dispatch(object(y), id("f", (k + 1) % METHODS),
+			     single_Expressions(plus(object(x),
+						     int_const(integer(1 + edit)))));
+  return let(y, id("C", j), new_(id("C", j)),
+	     cond(lt(object(x), int_const(integer(10))), call, sum));
+}
+
+//
+// Builds the program, with method `edit_method' of class `edit_class'
+// edited if edit is nonzero.
+//
+static Program build(int classes, int edit_class, int edit_method, int edit)
+{
+  Symbol Int = idtable.add_string("Int");
+  Symbol Object = idtable.add_string("Object");
+  Symbol filename = stringtable.add_string("semant_bench.cl");
+  Symbol x = idtable.add_string("x");
+
+  Classes all = nil_Classes();
+  for (int i = 0; i < classes; i++) {
+    node_lineno = i + 1;
+    Features features = single_Features(attr(id("a", i), Int, no_expr()));
+    for (int k = 0; k < METHODS; k++) {
+      int e = (i == edit_class && k == edit_method) ? edit : 0;
+      features = append_Features(features,
+	single_Features(method(id("f", k), single_Formals(formal(x, Int)), Int,
+			       body(classes, i, k, e))));
+    }
+    Symbol parent = i == 0 ? Object : id("C", i / 2);
+    all = append_Classes(all, single_Classes(class_(id("C", i), parent,
+						    features, filename)));
+  }
+
+  Expression start = dispatch(new_(id("C", 0)), id("f", 0),
+			      single_Expressions(int_const(integer(0))));
+  all = append_Classes(all, single_Classes(
+    class_(idtable.add_string("Main"), Object,
+	   single_Features(method(idtable.add_string("main"), nil_Formals(),
+				  Object, start)),
+	   filename)));
+  return program(all);
+}
+
+static void run(const char *what, int classes, int edit)
+{
+  Program p = build(classes, classes / 2, 2, edit);
+  clock_t start = clock();
+  p->semant();
+  printf("%-22s %8.1f ms\n", what, seconds_since(start) * 1e3);
+}
+
+int main(int argc, char *argv[])
+{
+  int classes = 2000;
+  if (argc > 2 && strcmp(argv[1], "-n") == 0)
+    classes = atoi(argv[2]);
+  if (classes < 1) {
+    fprintf(stderr, "usage: %s [-n classes]\n", argv[0]);
+    exit(1);
+  }
+
+  char path[] = "/tmp/semant_benchXXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    exit(1);
+  }
+  close(fd);
+  unlink(path);
+
+  printf("%d classes, %d methods each\n", classes, METHODS);
+  run("no cache", classes, 0);
+  semant_cache = path;
+  run("empty cache", classes, 0);
+  run("unchanged", classes, 0);
+  run("one method edited", classes, 1);
+
+  unlink(path);
+  return 0;
+}
@@ -160,7 +160,7 @@
 #include "utilities.h"
 
 void ast_yyerror(char *);
-extern int node_lineno;
+extern thread_local int node_lineno;
 extern int yylex();           /* the entry point to the lexer  */
 Program ast_root;             /* the result of the parse  */
 Classes parse_results;        /* for use in parsing multiple files */
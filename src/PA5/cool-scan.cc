@@ -0,0 +1,581 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  cool-scan.cc
+//
+//  A hand-written scanner that follows the rules of cool.flex exactly.
+//  It maps fin into memory (or reads it, if it is not a regular file),
+//  and interns identifiers, integers and strings without escapes
+//  straight from the mapped text.  It steps over whitespace,
+//  comment bodies, identifiers, integers and the ordinary characters of
+//  strings a vector at a time: 32 bytes with AVX2 when the compiler
+//  targets it (-mavx2), 16 bytes with SSE2 otherwise, or one byte on
+//  machines with neither.  Everything else is handled a character at a
+//  time, in the same order of preference as the flex rules.
+//
+//  The start conditions are those of cool.flex.  As there, a string that
+//  cannot be finished is skipped in BROKENSTRING after the error token
+//  is returned, and an escaped newline in a string does not count as a
+//  new line.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include "cool-parse.h"
+#include "stringtab.h"
+#include "utilities.h"
+#include "cool-scan.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define MAX_STR_CONST 1025
+
+extern thread_local FILE *fin;
+extern thread_local int curr_lineno;
+extern thread_local YYSTYPE cool_yylval;
+extern void yyrestart(FILE *);   // of the flex scanner
+
+//
+// The operations on vectors of bytes that the scanner needs.  Comparisons
+// give a byte of all ones where true, and bits gathers the top bit of
+// each byte into an integer, the first byte in the lowest bit.
+//
+#if defined(__AVX2__)
+
+typedef __m256i vec;
+#define VEC_BYTES 32
+const char *scan_vector_isa = "AVX2";
+
+static inline vec load(const char *p)   { return _mm256_loadu_si256((const vec *) p); }
+static inline vec splat(char c)         { return _mm256_set1_epi8(c); }
+static inline vec eq(vec a, vec b)      { return _mm256_cmpeq_epi8(a, b); }
+static inline vec gt(vec a, vec b)      { return _mm256_cmpgt_epi8(a, b); }
+static inline vec add(vec a, vec b)     { return _mm256_add_epi8(a, b); }
+static inline vec vor(vec a, vec b)     { return _mm256_or_si256(a, b); }
+static inline unsigned bits(vec a)      { return _mm256_movemask_epi8(a); }
+
+#elif defined(__SSE2__)
+
+typedef __m128i vec;
+#define VEC_BYTES 16
+const char *scan_vector_isa = "SSE2";
+
+static inline vec load(const char *p)   { return _mm_loadu_si128((const vec *) p); }
+static inline vec splat(char c)         { return _mm_set1_epi8(c); }
+static inline vec eq(vec a, vec b)      { return _mm_cmpeq_epi8(a, b); }
+static inline vec gt(vec a, vec b)      { return _mm_cmpgt_epi8(a, b); }
+static inline vec add(vec a, vec b)     { return _mm_add_epi8(a, b); }
+static inline vec vor(vec a, vec b)     { return _mm_or_si128(a, b); }
+static inline unsigned bits(vec a)      { return _mm_movemask_epi8(a); }
+
+#else
+
+typedef signed char vec;
+#define VEC_BYTES 1
+const char *scan_vector_isa = "none";
+
+static inline vec load(const char *p)   { return *p; }
+static inline vec splat(char c)         { return c; }
+static inline vec eq(vec a, vec b)      { return a == b ? -1 : 0; }
+static inline vec gt(vec a, vec b)      { return a > b ? -1 : 0; }
+static inline vec add(vec a, vec b)     { return a + b; }
+static inline vec vor(vec a, vec b)     { return a | b; }
+static inline unsigned bits(vec a)      { return a & 1; }
+
+#endif
+
+#define VEC_MASK ((unsigned) ((1ull << VEC_BYTES) - 1))
+
+//
+// in_range is true of the bytes from lo to hi.  Subtracting lo and then
+// 128 maps them, and only them, onto the lowest signed bytes.
+//
+static inline vec in_range(vec v, char lo, char hi)
+{
+  return gt(splat((char) (hi - lo + 1 - 128)), add(v, splat((char) (-128 - lo))));
+}
+
+// [\t\n\v\f\r ]: the characters of {SPACE}, and newline
+static inline vec is_space(vec v)
+{
+  return vor(in_range(v, '\t', '\r'), eq(v, splat(' ')));
+}
+
+// [A-Za-z0-9_]: the characters after the first of an identifier
+static inline vec is_ident(vec v)
+{
+  return vor(vor(in_range(vor(v, splat(0x20)), 'a', 'z'),
+                 in_range(v, '0', '9')),
+             eq(v, splat('_')));
+}
+
+static inline vec is_digit(vec v)
+{
+  return in_range(v, '0', '9');
+}
+
+// where a comment body may change depth: "(*" and "*)"
+static inline vec is_comment_stop(vec v)
+{
+  return vor(vor(eq(v, splat('(')), eq(v, splat('*'))), eq(v, splat('\0')));
+}
+
+static inline vec is_line_stop(vec v)
+{
+  return vor(eq(v, splat('\n')), eq(v, splat('\0')));
+}
+
+// the characters of a string that are not simply copied
+static inline vec is_string_stop(vec v)
+{
+  return vor(vor(eq(v, splat('"')), eq(v, splat('\\'))),
+             vor(eq(v, splat('\n')), eq(v, splat('\0'))));
+}
+
+//
+// skip returns the first character at or after p that is in the class
+// cls, or if OVER is true the first that is not, and adds the
+// newlines it steps over to *lines.  The input is followed by at least
+// VEC_BYTES NULs, and every class stops at a NUL, so skip never reads
+// past the padding.
+//
+template <bool OVER, class Class>
+static inline const char *skip(const char *p, Class cls, int *lines = NULL)
+{
+  for (;; p += VEC_BYTES) {
+    vec v = load(p);
+    unsigned stop = bits(cls(v));
+    if (OVER)
+      stop = ~stop & VEC_MASK;
+    if (stop != 0) {
+      unsigned i = __builtin_ctz(stop);
+      if (lines)
+        *lines += __builtin_popcount(bits(eq(v, splat('\n'))) & ((1u << i) - 1));
+      return p + i;
+    }
+    if (lines)
+      *lines += __builtin_popcount(bits(eq(v, splat('\n'))));
+  }
+}
+
+//
+// The state of the scanner: the input, how far it has got, and the
+// start condition of cool.flex it is in.  Each thread has its own, so
+// that several threads can scan files at once.
+//
+enum { INITIAL, STRING, COMMENT, BROKENSTRING, LINE_COMMENT };
+
+#define NO_TOKEN (-1)      // returned by the states that have none to return
+
+static thread_local std::vector<char> input;  // fin, if it could not be mapped
+static thread_local char *mapped;             // fin, if it could
+static thread_local size_t mapped_size;
+static thread_local const char *pos, *end;
+static thread_local bool loaded;              // false once end of file has been returned
+static thread_local int state;
+static thread_local int depth;                // of nested comments
+static thread_local char string_buf[MAX_STR_CONST];
+static thread_local int string_len;
+static thread_local char error_char[2];       // the text of an unexpected character
+
+//
+// map_input maps the regular file fin, and returns its length, or -1 if
+// it cannot.  The mapping is followed by at least VEC_BYTES NULs: the
+// rest of the file's last page reads as zeros, and it is placed at the
+// start of a larger anonymous mapping, whose pages are zeros too.
+//
+static long map_input()
+{
+  struct stat st;
+  int fd = fileno(fin);
+
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+      ftell(fin) != 0)
+    return -1;
+
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t size = (st.st_size + VEC_BYTES + page - 1) / page * page;
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED)
+    return -1;
+  if (mmap(map, st.st_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0)
+      == MAP_FAILED) {
+    munmap(map, size);
+    return -1;
+  }
+  mapped = (char *) map;
+  mapped_size = size;
+  return st.st_size;
+}
+
+//
+// read_input reads all of fin, and leaves VEC_BYTES NULs after it.
+//
+static long read_input()
+{
+  size_t len = 0;
+  if (input.size() < 1 << 16)
+    input.resize(1 << 16);
+  for (;;) {
+    len += fread(input.data() + len, 1, input.size() - VEC_BYTES - len, fin);
+    if (len < input.size() - VEC_BYTES)
+      break;
+    input.resize(2 * input.size());
+  }
+  memset(input.data() + len, 0, VEC_BYTES);
+  return len;
+}
+
+static void load()
+{
+  if (mapped != NULL) {
+    munmap(mapped, mapped_size);
+    mapped = NULL;
+  }
+
+  long len = map_input();
+  if (len >= 0)
+    pos = mapped;
+  else {
+    len = read_input();
+    pos = input.data();
+  }
+  end = pos + len;
+  state = INITIAL;
+  depth = 0;
+  loaded = true;
+}
+
+static int error(char *msg)
+{
+  cool_yylval.error_msg = msg;
+  return ERROR;
+}
+
+//
+// keyword returns the token of the keyword or boolean constant that the
+// identifier s of length len spells, or 0.  cool.flex lists the keywords
+// first, so they win over identifiers of the same length.
+//
+static int keyword(const char *s, int len)
+{
+  static const struct { const char *name; int len; int token; } keywords[] = {
+    { "class", 5, CLASS }, { "else", 4, ELSE }, { "fi", 2, FI },
+    { "if", 2, IF }, { "in", 2, IN }, { "inherits", 8, INHERITS },
+    { "let", 3, LET }, { "loop", 4, LOOP }, { "pool", 4, POOL },
+    { "then", 4, THEN }, { "while", 5, WHILE }, { "case", 4, CASE },
+    { "esac", 4, ESAC }, { "of", 2, OF }, { "new", 3, NEW },
+    { "isvoid", 6, ISVOID }, { "not", 3, NOT },
+    { "true", 4, BOOL_CONST }, { "false", 5, BOOL_CONST },
+  };
+
+  //
+  // starts[len] has a bit for each letter that begins a keyword of that
+  // length, so that most identifiers are turned away at once.
+  //
+  struct Starts {
+    unsigned bits[9];
+    Starts() : bits() {
+      for (const auto& k : keywords)
+        bits[k.len] |= 1u << (k.name[0] - 'a');
+    }
+  };
+  static const Starts starts_of;
+  const unsigned *starts = starts_of.bits;
+
+  if (len > 8 || !(starts[len] & (1u << ((s[0] | 0x20) - 'a'))))
+    return 0;
+  char lower[8];
+  for (int i = 0; i < len; i++)
+    lower[i] = tolower(s[i]);
+
+  for (const auto& k : keywords) {
+    if (k.len != len || memcmp(k.name, lower, len) != 0)
+      continue;
+    if (k.token == BOOL_CONST) {
+      // only the first letter of true and false is case sensitive
+      if (s[0] != k.name[0])
+        return 0;
+      cool_yylval.boolean = s[0] == 't';
+    }
+    return k.token;
+  }
+  return 0;
+}
+
+static int scan_initial()
+{
+  const char *p = pos = skip<true>(pos, is_space, &curr_lineno);
+  if (p == end) {
+    loaded = false;
+    return 0;
+  }
+
+  char c = *p;
+  if (isalpha((unsigned char) c)) {
+    pos = skip<true>(p + 1, is_ident);
+    int len = pos - p;
+    int token = keyword(p, len);
+    if (token != 0)
+      return token;
+    cool_yylval.symbol = idtable.add_string((char *) p, len);
+    return isupper((unsigned char) c) ? TYPEID : OBJECTID;
+  }
+  if (isdigit((unsigned char) c)) {
+    pos = skip<true>(p + 1, is_digit);
+    cool_yylval.symbol = inttable.add_string((char *) p, pos - p);
+    return INT_CONST;
+  }
+
+  //
+  // The input is followed by NULs, so p[1] can always be read.
+  //
+  pos = p + 1;
+  switch (c) {
+  case '"':
+    string_len = 0;
+    state = STRING;
+    return NO_TOKEN;
+  case '(':
+    if (p[1] == '*') {
+      pos = p + 2;
+      depth = 1;
+      state = COMMENT;
+      return NO_TOKEN;
+    }
+    return c;
+  case '*':
+    if (p[1] == ')') {
+      pos = p + 2;
+      return error("Unmatched *)");
+    }
+    return c;
+  case '-':
+    if (p[1] == '-') {
+      pos = p + 2;
+      state = LINE_COMMENT;
+      return NO_TOKEN;
+    }
+    return c;
+  case '<':
+    if (p[1] == '=') {
+      pos = p + 2;
+      return LE;
+    }
+    if (p[1] == '-') {
+      pos = p + 2;
+      return ASSIGN;
+    }
+    return c;
+  case '=':
+    if (p[1] == '>') {
+      pos = p + 2;
+      return DARROW;
+    }
+    return c;
+  case '.': case '@': case '~': case '+': case '/':
+  case ':': case ';': case ',': case ')': case '{': case '}':
+    return c;
+  default:
+    error_char[0] = c;
+    return error(error_char);
+  }
+}
+
+//
+// A string with no escapes is interned from the input as it is.  Others
+// are copied into string_buf a run of ordinary characters at a time.
+// cool.flex adds one character at a time, and gives up on the first that
+// does not fit, having consumed it.
+//
+static int scan_string()
+{
+  for (;;) {
+    const char *p = pos;
+    const char *q = skip<false>(p, is_string_stop);
+    int room = MAX_STR_CONST - 1 - string_len;
+    if (*q == '"' && string_len == 0 && q - p <= room) {
+      pos = q + 1;
+      state = INITIAL;
+      cool_yylval.symbol = stringtable.add_string((char *) p, q - p);
+      return STR_CONST;
+    }
+    if (q - p > room) {
+      pos = p + room + 1;
+      state = BROKENSTRING;
+      return error("String constant too long");
+    }
+    memcpy(string_buf + string_len, p, q - p);
+    string_len += q - p;
+    pos = q + 1;
+
+    switch (*q) {
+    case '"':
+      string_buf[string_len] = '\0';
+      state = INITIAL;
+      cool_yylval.symbol = stringtable.add_string(string_buf, string_len);
+      return STR_CONST;
+    case '\n':
+      curr_lineno++;
+      state = INITIAL;
+      return error("Unterminated string constant");
+    case '\0':
+      state = BROKENSTRING;
+      if (q == end) {
+        pos = q;
+        return error("EOF in string constant");
+      }
+      return error("String contains null character");
+    }
+
+    // a backslash: with nothing after it, it is an ordinary character
+    if (q + 1 == end) {
+      if (string_len == MAX_STR_CONST - 1) {
+        state = BROKENSTRING;
+        return error("String constant too long");
+      }
+      string_buf[string_len++] = '\\';
+      continue;
+    }
+    pos = q + 2;
+    if (q[1] == '\0') {
+      state = BROKENSTRING;
+      return error("String contains null character");
+    }
+    if (string_len == MAX_STR_CONST - 1) {
+      state = BROKENSTRING;
+      return error("String constant too long");
+    }
+    switch (q[1]) {
+    case 'n': string_buf[string_len++] = '\n'; break;
+    case 't': string_buf[string_len++] = '\t'; break;
+    case 'b': string_buf[string_len++] = '\b'; break;
+    case 'f': string_buf[string_len++] = '\f'; break;
+    default:  string_buf[string_len++] = q[1];
+    }
+  }
+}
+
+//
+// The rest of a string that has had an error, up to an unescaped quote
+// or newline.
+//
+static int scan_broken_string()
+{
+  for (;;) {
+    const char *q = skip<false>(pos, is_string_stop);
+    pos = q + 1;
+    switch (*q) {
+    case '"':
+      state = INITIAL;
+      return NO_TOKEN;
+    case '\n':
+      curr_lineno++;
+      state = INITIAL;
+      return NO_TOKEN;
+    case '\0':
+      if (q == end) {
+        pos = q;
+        state = INITIAL;
+        return NO_TOKEN;
+      }
+      break;
+    case '\\':
+      if (q + 1 == end)
+        break;
+      if (q[1] == '\n')
+        curr_lineno++;
+      pos = q + 2;
+      break;
+    }
+  }
+}
+
+static int scan_comment()
+{
+  for (;;) {
+    const char *q = skip<false>(pos, is_comment_stop, &curr_lineno);
+    pos = q + 1;
+    if (q[0] == '(' && q[1] == '*') {
+      pos = q + 2;
+      depth++;
+    } else if (q[0] == '*' && q[1] == ')') {
+      pos = q + 2;
+      if (--depth == 0) {
+        state = INITIAL;
+        return NO_TOKEN;
+      }
+    } else if (q == end) {
+      pos = q;
+      depth = 0;
+      state = INITIAL;
+      return error("EOF in comment");
+    }
+  }
+}
+
+static int scan_line_comment()
+{
+  for (;;) {
+    const char *q = skip<false>(pos, is_line_stop);
+    pos = q + 1;
+    if (*q == '\n') {
+      curr_lineno++;
+      state = INITIAL;
+      return NO_TOKEN;
+    }
+    if (q == end) {
+      pos = q;
+      state = INITIAL;
+      return NO_TOKEN;
+    }
+  }
+}
+
+int scan_yylex()
+{
+  if (!loaded)
+    load();
+
+  for (;;) {
+    int token = NO_TOKEN;
+    switch (state) {
+    case INITIAL:      token = scan_initial(); break;
+    case STRING:       token = scan_string(); break;
+    case COMMENT:      token = scan_comment(); break;
+    case BROKENSTRING: token = scan_broken_string(); break;
+    case LINE_COMMENT: token = scan_line_comment(); break;
+    }
+    if (token != NO_TOKEN)
+      return token;
+  }
+}
+
+int cool_yylex()
+{
+  return fast_lex ? scan_yylex() : flex_yylex();
+}
+
+void scan_yyrestart()
+{
+  loaded = false;
+}
+
+void cool_yyrestart()
+{
+  scan_yyrestart();
+  yyrestart(fin);
+}
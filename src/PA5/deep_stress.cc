@@ -0,0 +1,160 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  deep_stress.cc
+//
+//  Checks that semant, dump_with_types and cgen keep to a small native
+//  stack however deeply expressions nest.  For each of
+//
+//     let      let x : Int <- x in let x : Int <- x in ... x
+//     plus     ((x + 1) + 1) + ... + 1
+//     if       if b then if b then ... x else x else x
+//     case     case x of x : Int => case x of x : Int => ... x esac esac
+//     dispatch f(f(... f(x)))
+//
+//  a program whose main method nests `depth' (100000, or the number
+//  given with -n) of them is built and put through the three passes, on
+//  a thread whose stack is only STACK bytes, and what each pass took is
+//  printed.  The parser and the binary AST reader and writer still
+//  recurse, so the trees are built in memory.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <fstream>
+#include "cool-tree.h"
+
+extern thread_local int node_lineno;
+
+FILE *ast_file;       // not used, but needed to link with the AST parser
+int cool_yydebug;     // not used, but needed to link with handle_flags
+thread_local char *curr_filename;
+
+static const size_t STACK = 1 << 20;
+
+static int depth = 100000;
+
+static double seconds_since(clock_t start)
+{
+  return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+static Symbol id(const char *name)
+{
+  return idtable.add_string((char *) name);
+}
+
+static Expression x()
+{
+  return object(id("x"));
+}
+
+static Expression one()
+{
+  return int_const(inttable.add_int(1));
+}
+
+//
+// The body of main: `depth' nested expressions of one shape, innermost
+// first, with x the Int the innermost one starts from.
+//
+static Expression nest(const char *shape)
+{
+  Expression e = x();
+  for (int i = 0; i < depth; i++) {
+    if (strcmp(shape, "let") == 0)
+      e = let(id("x"), id("Int"), x(), e);
+    else if (strcmp(shape, "plus") == 0)
+      e = plus(e, one());
+    else if (strcmp(shape, "if") == 0)
+      e = cond(object(id("b")), e, x());
+    else if (strcmp(shape, "case") == 0)
+      e = typcase(x(), single_Cases(branch(id("x"), id("Int"), e)));
+    else
+      e = dispatch(object(id("self")), id("f"), single_Expressions(e));
+  }
+  return e;
+}
+
+//
+// class Main {
+//   x : Int; b : Bool;
+//   f(x : Int) : Int { x };
+//   main() : Int { <nest(shape)> };
+// };
+//
+static Program build(const char *shape)
+{
+  Symbol Int = id("Int");
+  Symbol filename = stringtable.add_string("deep_stress.cl");
+  node_lineno = 1;
+
+  Features features =
+    append_Features(
+      append_Features(single_Features(attr(id("x"), Int, no_expr())),
+		      single_Features(attr(id("b"), id("Bool"), no_expr()))),
+      append_Features(
+	single_Features(method(id("f"), single_Formals(formal(id("x"), Int)),
+			       Int, x())),
+	single_Features(method(id("main"), nil_Formals(), Int, nest(shape)))));
+  return program(single_Classes(class_(id("Main"), id("Object"), features,
+				       filename)));
+}
+
+static void *run(void *)
+{
+  static const char *shapes[] = { "let", "plus", "if", "case", "dispatch" };
+  std::ofstream null("/dev/null");
+
+  printf("depth %d, %lu KB stack\n", depth, (unsigned long) (STACK >> 10));
+  printf("%-10s %12s %12s %12s\n", "", "semant", "dump", "cgen");
+  for (const char *shape : shapes) {
+    Program p = build(shape);
+
+    clock_t start = clock();
+    p->semant();
+    double semant = seconds_since(start);
+
+    start = clock();
+    p->dump_with_types(null, 0);
+    double dump = seconds_since(start);
+
+    start = clock();
+    p->cgen(null);
+    double cgen = seconds_since(start);
+
+    printf("%-10s %9.1f ms %9.1f ms %9.1f ms\n", shape,
+	   semant * 1e3, dump * 1e3, cgen * 1e3);
+  }
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc > 2 && strcmp(argv[1], "-n") == 0)
+    depth = atoi(argv[2]);
+  if (depth < 1) {
+    fprintf(stderr, "usage: %s [-n depth]\n", argv[0]);
+    exit(1);
+  }
+
+  pthread_attr_t attr;
+  pthread_t thread;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, STACK);
+  if (pthread_create(&thread, &attr, run, NULL) != 0) {
+    perror("pthread_create");
+    exit(1);
+  }
+  pthread_join(thread, NULL);
+  return 0;
+}